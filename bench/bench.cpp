@@ -0,0 +1,558 @@
+/*
+ * Microbenchmarks for hot primitives of the inference engine on PC.
+ *
+ * Built with `make -C build bench` and run with `./build/bench/bench [-t min_ms] [filter]`.
+ * Benchmarks whose names do not contain `filter` are skipped. Each case runs for at
+ * least min_ms milliseconds (100 by default).
+ *
+ * Columns:
+ * - ns/op: wall time per operation. An operation is a call, except for MaxPool (a patch),
+ *   Conv (an output value), find_initial_state_bit (a query) and check_next_turning_point
+ *   (a value index). Shapes of Conv include multiplications per output value (mac).
+ * - bytes/op: bytes of operands in VM for DSP functions plus bytes read from and written
+ *   to the simulated NVM, as counted by read_from_nvm/write_to_nvm.
+ *
+ * The synthetic model in bench/data.h replaces data.h from transform.py, so that no model
+ * conversion is needed.
+ */
+
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include "cnn_common.h"
+#include "data.h"
+#include "intermittent-cnn.h"
+#include "my_debug.h"
+#include "my_dsplib.h"
+#include "op_utils.h"
+#include "platform.h"
+
+#ifndef USE_NATIVE_DSP
+#define USE_NATIVE_DSP 0
+#endif
+
+static uint32_t min_time_ms = 100;
+static const char *name_filter = nullptr;
+
+static Model *model;
+// Output of conv1 and pool1. Benchmarks use copies with different lengths or dimensions
+static ParameterInfo conv_output, pool_output;
+
+static bool bench_enabled(const char *name) {
+    return !name_filter || strstr(name, name_filter);
+}
+
+// Run func, which does ops_per_call operations, until min_time_ms passes
+template<typename Func>
+static void run_bench(const char *name, const char *shape, uint32_t ops_per_call, uint32_t vm_bytes_per_op, Func func) {
+    if (!bench_enabled(name)) {
+        return;
+    }
+
+    // warm up caches and branch predictors
+    func();
+
+    uint64_t nvm_read_before, nvm_written_before, nvm_read_after, nvm_written_after;
+    get_nvm_traffic(&nvm_read_before, &nvm_written_before);
+
+    typedef std::chrono::steady_clock clock;
+    const clock::duration min_time = std::chrono::milliseconds(min_time_ms);
+    uint64_t n_calls = 0, batch = 1;
+    clock::duration elapsed;
+    clock::time_point start = clock::now();
+    while (1) {
+        for (uint64_t idx = 0; idx < batch; idx++) {
+            func();
+        }
+        n_calls += batch;
+        elapsed = clock::now() - start;
+        if (elapsed >= min_time) {
+            break;
+        }
+        batch *= 2;
+    }
+
+    get_nvm_traffic(&nvm_read_after, &nvm_written_after);
+    double n_ops = static_cast<double>(n_calls) * ops_per_call;
+    double ns_per_op = std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed).count() / n_ops;
+    double nvm_bytes = static_cast<double>((nvm_read_after - nvm_read_before) + (nvm_written_after - nvm_written_before));
+    double bytes_per_op = vm_bytes_per_op + nvm_bytes / n_ops;
+    my_printf("%-28s %-24s %12.1f %12.1f" NEWLINE, name, shape, ns_per_op, bytes_per_op);
+    my_flush();
+}
+
+static uint32_t rand_seed = 1;
+
+static int16_t rand_q15(int16_t max_abs) {
+    rand_seed = rand_seed * 1103515245 + 12345;
+    return static_cast<int16_t>((rand_seed >> 16) % (2 * max_abs + 1)) - max_abs;
+}
+
+static void fill_random(int16_t *buffer, uint32_t len, int16_t max_abs) {
+    for (uint32_t idx = 0; idx < len; idx++) {
+        buffer[idx] = rand_q15(max_abs);
+    }
+}
+
+// Write value_at(offset) for all values in param, using the end of lea_buffer as a staging area
+template<typename ValueFunc>
+static void fill_param(ParameterInfo *param, ValueFunc value_at) {
+    const uint16_t chunk_len = 512;
+    int16_t *buffer = lea_buffer + LEA_BUFFER_SIZE - chunk_len;
+    uint16_t len = param->params_len / sizeof(int16_t);
+    for (uint16_t offset = 0; offset < len; offset += chunk_len) {
+        uint16_t cur_chunk_len = MIN_VAL(chunk_len, len - offset);
+        for (uint16_t idx = 0; idx < cur_chunk_len; idx++) {
+            buffer[idx] = value_at(offset + idx);
+        }
+        my_memcpy_to_param(param, offset, buffer, cur_chunk_len * sizeof(int16_t), 0);
+    }
+}
+
+#if INDIRECT_RECOVERY
+// Place n_turning_points turning points evenly in the first len values of a slot
+static void set_turning_points(uint8_t slot_id, uint8_t n_turning_points, uint16_t len) {
+    SlotInfo *slot_info = get_slot_info(model, slot_id);
+    slot_info->state_bit = 1;
+    slot_info->n_turning_points = n_turning_points;
+    // Turning points are at batch boundaries (see flip_state_bit)
+    const uint16_t batch_len = BATCH_SIZE + JAPARI;
+    for (uint8_t idx = 0; idx < n_turning_points; idx++) {
+        slot_info->turning_points[idx] = static_cast<uint32_t>(len) * (idx + 1) / (n_turning_points + 1) / batch_len * batch_len;
+    }
+}
+#endif
+
+static void setup(void) {
+    init_bench_data();
+    init_volatile_nvm();
+    first_run();
+
+    model = load_model_from_nvm();
+    model->running = 1;
+    // pretend that conv1 is finished and pool1 is running
+    model->layer_idx = 1;
+
+    conv_output = *get_parameter_info(N_INPUT + 0);
+    conv_output.bitwidth = 16;
+    conv_output.dims[0] = 1;
+    conv_output.dims[1] = conv_output.dims[2] = conv_output.dims[3] = 16;
+    conv_output.params_len = 16 * 16 * 16 * sizeof(int16_t);
+    conv_output.scale = 1;
+    intermediate_parameters_info_vm[0] = conv_output;
+    commit_intermediate_parameter_info(0);
+
+    pool_output = *get_parameter_info(N_INPUT + 1);
+    pool_output.bitwidth = 16;
+    pool_output.scale = 1;
+}
+
+static void bench_matrix_mpy(const char *name, uint16_t A_cols, uint16_t B_cols) {
+    // The same layout as convTask and handle_gemm: a row vector times a matrix, with results preserved to NVM
+    const uint16_t A_rows = 1, B_rows = A_cols;
+    // LEA requires 4-byte aligned buffers
+    int16_t *A = lea_buffer;
+    int16_t *B = A + padding_for_lea(A_rows * A_cols);
+    int16_t *C = B + padding_for_lea(B_rows * B_cols);
+    fill_random(A, A_rows * A_cols, 0x1000);
+    fill_random(B, B_rows * B_cols, 0x1000);
+
+    char shape[32];
+    snprintf(shape, sizeof(shape), "%dx%d * %dx%d", A_rows, A_cols, B_rows, B_cols);
+    uint32_t vm_bytes = (A_rows * A_cols + B_rows * B_cols + A_rows * B_cols) * sizeof(int16_t);
+    ParameterInfo *output = &conv_output;
+    run_bench(name, shape, 1, vm_bytes, [=] () {
+#if STATEFUL
+        my_matrix_mpy_q15(A_rows, A_cols, B_rows, B_cols, A, B, C, output, 0, B_cols, 0x4000, B_cols);
+#else
+        my_matrix_mpy_q15(A_rows, A_cols, B_rows, B_cols, A, B, C, output, 0, B_cols, 0, 0);
+#endif
+    });
+}
+
+#if !INDIRECT_RECOVERY
+static void CountingChunkHandler(uint32_t, uint16_t real_chunk_len, int8_t, void *params) {
+    *reinterpret_cast<uint32_t*>(params) += real_chunk_len;
+}
+#endif
+
+static void bench_iterate_chunks(uint16_t len) {
+    char shape[32];
+    snprintf(shape, sizeof(shape), "n=%d", len);
+    ParameterInfo *param = &pool_output;
+#if INDIRECT_RECOVERY
+    set_turning_points(param->slot, 2, len);
+    fill_random(lea_buffer, len, 0x1000);
+    run_bench("iterate_chunks", shape, 1, len * sizeof(int16_t), [=] () {
+        OutputChunkHandlerParams params;
+        params.buffer = lea_buffer;
+        params.buffer_offset = 0;
+        iterate_chunks(model, param, 0, len, OutputChunkHandler, &params);
+    });
+    set_turning_points(param->slot, 0, len);
+#else
+    run_bench("iterate_chunks", shape, 1, 0, [=] () {
+        uint32_t total_len = 0;
+        iterate_chunks(model, param, 0, len, CountingChunkHandler, &total_len);
+    });
+#endif
+}
+
+#if INDIRECT_RECOVERY
+static void bench_turning_points(uint8_t n_turning_points, uint16_t len) {
+    char shape[32];
+    snprintf(shape, sizeof(shape), "tp=%d n=%d", n_turning_points, len);
+    ParameterInfo *param = &pool_output;
+    set_turning_points(param->slot, n_turning_points, len);
+
+    const uint16_t n_queries = 64;
+    run_bench("find_initial_state_bit", shape, n_queries, 0, [=] () {
+        int16_t offset;
+        uint8_t turning_point_idx;
+        uint16_t next_turning_point;
+        SlotInfo *slot_info;
+        for (uint16_t idx = 0; idx < n_queries; idx++) {
+            find_initial_state_bit(&offset, &turning_point_idx, &next_turning_point, &slot_info,
+                                   static_cast<uint32_t>(len) * idx / n_queries, model, param);
+        }
+    });
+
+    // A sweep like those in handle_maxpool and update_states
+    run_bench("check_next_turning_point", shape, len, 0, [=] () {
+        int16_t offset;
+        uint8_t turning_point_idx;
+        uint16_t next_turning_point;
+        SlotInfo *slot_info;
+        find_initial_state_bit(&offset, &turning_point_idx, &next_turning_point, &slot_info, 0, model, param);
+        for (uint16_t value_idx = 0; value_idx < len; value_idx++) {
+            check_next_turning_point(offset, turning_point_idx, next_turning_point, slot_info, value_idx);
+        }
+    });
+
+    set_turning_points(param->slot, 0, len);
+}
+#endif
+
+#if INTERMITTENT
+static void bench_run_recovery(uint16_t len) {
+    char shape[32];
+    snprintf(shape, sizeof(shape), "n=%d", len);
+    ParameterInfo param = pool_output;
+    param.params_len = len * sizeof(int16_t);
+    // Power failed after half of values were preserved
+    const uint16_t n_finished = len / 2 / (BATCH_SIZE + JAPARI) * (BATCH_SIZE + JAPARI);
+#if STATEFUL
+    set_turning_points(param.slot, 0, len);
+    fill_param(&param, [=] (uint16_t offset) -> int16_t {
+        // The state bit of the slot is 1, and finished values have the opposite state
+        return (offset < n_finished) ? -0x1000 : 0x1000;
+    });
+#elif JAPARI
+    set_turning_points(param.slot, 0, len);
+    fill_param(&param, [=] (uint16_t offset) -> int16_t {
+        // Only footprints are checked
+        return (offset < n_finished) ? -1 : 1;
+    });
+#elif HAWAII
+    reset_hawaii_layer_footprint(model->layer_idx);
+    write_hawaii_layer_footprint(model->layer_idx, n_finished);
+#endif
+    ParameterInfo *param_ptr = &param;
+    run_bench("run_recovery", shape, 1, 0, [=] () {
+#if INDIRECT_RECOVERY
+        reset_recovery_state();
+#endif
+        run_recovery(model, param_ptr);
+    });
+#if HAWAII
+    reset_hawaii_layer_footprint(model->layer_idx);
+#endif
+}
+#endif
+
+static void bench_maxpool(uint16_t n_channels) {
+#if JAPARI
+    // Channels include footprints
+    n_channels = extend_for_footprints(n_channels);
+#endif
+    char shape[32];
+    snprintf(shape, sizeof(shape), "%dx16x16 k=2 s=2", n_channels);
+    ParameterInfo input = conv_output;
+    input.dims[1] = n_channels;
+    input.params_len = n_channels * 16 * 16 * sizeof(int16_t);
+    fill_param(&input, [] (uint16_t) -> int16_t {
+        // values without states, or with state 1 like those from a finished Conv
+        return INDIRECT_RECOVERY ? (rand_q15(0x1000) + 0x4000) : rand_q15(0x1000);
+    });
+#if INDIRECT_RECOVERY
+    set_turning_points(input.slot, 0, 0);
+    set_turning_points(pool_output.slot, 0, 0);
+#endif
+
+    const Node *node = get_node(1);
+    const ParameterInfo *inputs[] = { &input };
+    ParameterInfo output = pool_output;
+    alloc_maxpool(model, inputs, &output, node);
+    uint32_t n_patches = output.dims[2] * output.dims[3];
+
+    run_bench("MaxPool", shape, n_patches, 0, [&] () {
+#if HAWAII
+        reset_hawaii_layer_footprint(model->layer_idx);
+#endif
+        // recovery is done in the warm-up run, and later runs start from the beginning like a normal run
+        handle_maxpool(model, inputs, &output, node);
+    });
+}
+
+// Output values of conv_dense, which are compared with those of conv_dense_q7, conv_sparse, conv_dense_a8, conv_dense_nhwc and
+// conv_dense_is
+static int16_t conv_dense_outputs[BENCH_REGION_SIZE / sizeof(int16_t)];
+static bool has_conv_dense_outputs = false;
+
+// An input or output value of Conv without states of Stateful, or 0 for footprints of JAPARI
+static int16_t get_conv_output_value(const ParameterInfo *output, uint16_t offset) {
+    int16_t val = get_q15_param(model, output, offset);
+#if STATEFUL
+    if (offset_has_state(offset)) {
+        strip_state(&val);
+    }
+#elif JAPARI
+    if (offset_has_state(offset)) {
+        val = 0;
+    }
+#endif
+    return val;
+}
+
+// Channel c of Conv inputs and outputs, which are after footprints of previous batches with JAPARI
+static uint16_t get_conv_channel_offset(uint16_t c) {
+#if JAPARI
+    c += c / BATCH_SIZE;
+#endif
+    return c;
+}
+
+// Offset of an output value at offset nwhc_offset in NWHC, which is in NHWC for nodes with NHWC_OUTPUTS
+static uint16_t get_conv_output_offset(const Node *node, const ParameterInfo *output, uint16_t nwhc_offset) {
+    if (!(node->flags.generic & NHWC_OUTPUTS)) {
+        return nwhc_offset;
+    }
+    const uint16_t OUTPUT_CHANNEL = output->dims[1], OUTPUT_H = output->dims[2], OUTPUT_W = output->dims[3];
+    const uint16_t c = nwhc_offset % OUTPUT_CHANNEL, position = nwhc_offset / OUTPUT_CHANNEL,
+                   output_h = position % OUTPUT_H, output_w = position / OUTPUT_H;
+    return (output_h * OUTPUT_W + output_w) * OUTPUT_CHANNEL + c;
+}
+
+/* Check outputs of conv_depthwise or conv_grouped against sums of products in 32 bits. compute_group_conv_block
+ * truncates each product to q15, so that an output value may be off by less than 1 for each multiplication */
+static void check_group_conv_outputs(const Node *node, const ParameterInfo *input, const ParameterInfo *filter,
+                                     const ParameterInfo *bias, const ParameterInfo *output, uint16_t macs) {
+    const uint16_t N_FILTERS = filter->dims[0], group_channel = filter->dims[1],
+                   group_filters = N_FILTERS / node->flags.extra.conv.group,
+                   H = input->dims[2], W = input->dims[3],
+                   OUTPUT_CHANNEL = output->dims[1], OUTPUT_H = output->dims[2], OUTPUT_W = output->dims[3];
+    for (uint16_t output_w = 0; output_w < OUTPUT_W; output_w++) {
+        for (uint16_t output_h = 0; output_h < OUTPUT_H; output_h++) {
+            for (uint16_t filter_idx = 0; filter_idx < N_FILTERS; filter_idx++) {
+                const uint16_t first_channel = filter_idx / group_filters * group_channel;
+                int32_t sum = 0;
+                for (uint16_t kh = 0; kh < 3; kh++) {
+                    for (uint16_t kw = 0; kw < 3; kw++) {
+                        // Pads are 1 for all Conv nodes
+                        const int16_t input_h = output_h + kh - 1, input_w = output_w + kw - 1;
+                        if (input_h < 0 || input_h >= H || input_w < 0 || input_w >= W) {
+                            continue;
+                        }
+                        for (uint16_t c = 0; c < group_channel; c++) {
+                            // Inputs are NHWC, and filters are NHWC as reordered by transform.py
+                            int16_t input_val = get_conv_output_value(input, (input_h * W + input_w) * input->dims[1] + get_conv_channel_offset(first_channel + c)),
+                                    filter_val = get_q15_param(model, filter, ((filter_idx * 3 + kh) * 3 + kw) * group_channel + c);
+                            sum += static_cast<int32_t>(input_val) * filter_val;
+                        }
+                    }
+                }
+                const int16_t expected = static_cast<int16_t>((sum >> 15) + get_q15_param(model, bias, filter_idx));
+                // Outputs of grouped Conv are NWHC or NHWC (see handle_group_conv)
+                const uint16_t offset = get_conv_output_offset(node, output, (output_w * OUTPUT_H + output_h) * OUTPUT_CHANNEL + get_conv_channel_offset(filter_idx));
+                const int16_t val = get_conv_output_value(output, offset);
+                MY_ASSERT_ALWAYS(val >= expected - static_cast<int16_t>(macs) && val <= expected + static_cast<int16_t>(macs),
+                                 "Output %d of %s at offset %d is not close to %d" NEWLINE, val, node->name, offset, expected);
+            }
+        }
+    }
+}
+
+// Run conv_dense (node 2), conv_depthwise (node 3), conv_dense_q7 (node 4), conv_sparse (node 5), conv_grouped (node 6)
+// conv_dense_a8 (node 7), conv_dense_nhwc (node 8), conv_depthwise_nhwc (node 9) or conv_dense_is (node 10) on a 16x16x16 input
+static void bench_conv(uint8_t node_idx) {
+    const Node *node = get_node(node_idx);
+    const ParameterInfo *filter = get_parameter_info(node->inputs[1]);
+    uint16_t n_channels = 16;
+#if JAPARI
+    // Channels include footprints
+    n_channels = extend_for_footprints(n_channels);
+#endif
+    // Multiplications for an output value
+    uint16_t macs = 3 * 3 * filter->dims[1];
+    if (filter->param_flags & SPARSE) {
+        // Only non-zero blocks of filters are multiplied
+        uint16_t first_block, cols[3 * 3];
+        macs = load_sparse_row(filter, 1, 0, &first_block, cols, 3 * 3) * filter->dims[1];
+    }
+    char shape[48];
+    snprintf(shape, sizeof(shape), "%dx16x16 g=%d q%d mac=%d", n_channels, node->flags.extra.conv.group, filter->bitwidth - 1, macs);
+    ParameterInfo input = conv_output;
+    input.dims[1] = n_channels;
+    input.params_len = n_channels * 16 * 16 * sizeof(int16_t);
+    // All Conv nodes run on the same input, so that outputs can be compared
+    rand_seed = 1;
+    fill_param(&input, [] (uint16_t offset) -> int16_t {
+        int16_t val = rand_q15(0x1000);
+        // Values with states of Stateful are offset (see strip_state())
+        return (INDIRECT_RECOVERY && offset_has_state(offset)) ? (val + 0x4000) : val;
+    });
+#if INDIRECT_RECOVERY
+    set_turning_points(input.slot, 0, 0);
+    set_turning_points(pool_output.slot, 0, 0);
+#endif
+
+    const ParameterInfo *inputs[] = { &input, get_parameter_info(node->inputs[1]), get_parameter_info(node->inputs[2]) };
+    ParameterInfo output = pool_output;
+    model->layer_idx = node_idx;
+    alloc_conv(model, inputs, &output, node);
+    // Like handle_node(), outputs are stored with the bitwidth planned in intermediate parameters info
+    const ParameterInfo *planned_output = reinterpret_cast<const ParameterInfo*>(intermediate_parameters_info_data) + node_idx;
+    set_intermediate_bitwidth(&output, planned_output->bitwidth);
+    uint32_t n_outputs = output.dims[1] * output.dims[2] * output.dims[3];
+
+    run_bench(node->name, shape, n_outputs, 0, [&] () {
+#if HAWAII
+        reset_hawaii_layer_footprint(model->layer_idx);
+#endif
+        handle_conv(model, inputs, &output, node);
+    });
+    model->layer_idx = 1;
+
+    if (!bench_enabled(node->name)) {
+        return;
+    }
+    if (node_idx == 2) {
+        has_conv_dense_outputs = true;
+        MY_ASSERT(n_outputs <= sizeof(conv_dense_outputs) / sizeof(int16_t));
+        for (uint16_t offset = 0; offset < n_outputs; offset++) {
+            conv_dense_outputs[offset] = get_conv_output_value(&output, offset);
+        }
+    } else if (node->flags.extra.conv.group == 1 && has_conv_dense_outputs) {
+        /* Filters of conv_dense_q7 and conv_sparse are the same as filters of conv_dense (see init_conv_parameters()).
+         * Only upper 8 bits of outputs of conv_dense_a8 are kept, so that they are less by less than 256. Outputs of
+         * conv_dense_nhwc are the same as outputs of conv_dense in another layout, and conv_dense_is only visits filters
+         * and output positions in another order */
+        const int16_t tolerance = (output.bitwidth == 8) ? 255 : 0;
+        for (uint16_t nwhc_offset = 0; nwhc_offset < n_outputs; nwhc_offset++) {
+            uint16_t offset = get_conv_output_offset(node, &output, nwhc_offset);
+            int16_t val = get_conv_output_value(&output, offset), expected = conv_dense_outputs[nwhc_offset];
+            MY_ASSERT_ALWAYS(val <= expected && val >= expected - tolerance,
+                             "Output %d of %s at offset %d is not %d of conv_dense" NEWLINE, val, node->name, offset, expected);
+        }
+    } else if (node->flags.extra.conv.group != 1) {
+        check_group_conv_outputs(node, &input, inputs[1], inputs[2], &output, macs);
+    }
+}
+
+static void bench_interleave(uint16_t numChannels, uint16_t len) {
+    char shape[32];
+    snprintf(shape, sizeof(shape), "n=%d channels=%d", len, numChannels);
+    int16_t *src = lea_buffer;
+    int16_t *dst = src + len;
+    fill_random(src, len, 0x1000);
+    run_bench("my_interleave_q15", shape, 1, 2 * len * sizeof(int16_t), [=] () {
+        my_interleave_q15(src, numChannels - 1, numChannels, dst, len);
+    });
+}
+
+static void bench_nvm(uint16_t n) {
+    char shape[32];
+    snprintf(shape, sizeof(shape), "%d bytes", n);
+    int16_t *buffer = lea_buffer;
+    const uint32_t nvm_offset = INTERMEDIATE_VALUES_OFFSET;
+    run_bench("read_from_nvm", shape, 1, 0, [=] () {
+        read_from_nvm(buffer, nvm_offset, n);
+    });
+    run_bench("write_to_nvm", shape, 1, 0, [=] () {
+        write_to_nvm(buffer, nvm_offset, n);
+    });
+}
+
+int main(int argc, char *argv[]) {
+    for (int idx = 1; idx < argc; idx++) {
+        if (!strcmp(argv[idx], "-t") && idx + 1 < argc) {
+            min_time_ms = atoi(argv[++idx]);
+        } else if (argv[idx][0] != '-') {
+            name_filter = argv[idx];
+        } else {
+            my_printf("Usage: %s [-t min_ms] [filter]" NEWLINE, argv[0]);
+            return 1;
+        }
+    }
+
+    setup();
+
+    my_printf("Method: " METHOD ", batch size: %d, DSP: %s" NEWLINE, BATCH_SIZE,
+              USE_NATIVE_DSP ? "native" : (USE_ARM_CMSIS ? "ARM CMSIS" : "TI DSPLib"));
+    my_printf("%-28s %-24s %12s %12s" NEWLINE, "name", "shape", "ns/op", "bytes/op");
+
+    // convTask: 1 x (kH * kW * tile_c + 1 for bias) times a filter tile, with typical 3x3 kernels
+    const uint16_t conv_tile_c[] = {4, 8, 16, 32};
+    const uint16_t conv_n_filters[] = {2, 8, 16};
+    for (uint16_t tile_c : conv_tile_c) {
+        for (uint16_t n_filters : conv_n_filters) {
+            bench_matrix_mpy("my_matrix_mpy_q15 (conv)", 3 * 3 * tile_c + 1, n_filters);
+        }
+    }
+    // handle_gemm: 1 x tile_channel times a tile of full_tile_width columns
+    const uint16_t gemm_shapes[][2] = {{32, 32}, {128, 32}, {256, 16}, {256, 32}};
+    for (const uint16_t *gemm_shape : gemm_shapes) {
+        bench_matrix_mpy("my_matrix_mpy_q15 (gemm)", gemm_shape[0], gemm_shape[1]);
+    }
+
+    const uint16_t lens[] = {256, 1024, 8192};
+    for (uint16_t len : lens) {
+        bench_iterate_chunks(len);
+    }
+#if INDIRECT_RECOVERY
+    const uint8_t n_turning_points_list[] = {1, 4, TURNING_POINTS_LEN};
+    for (uint8_t n_turning_points : n_turning_points_list) {
+        bench_turning_points(n_turning_points, 8192);
+    }
+#endif
+#if INTERMITTENT
+    for (uint16_t len : lens) {
+        bench_run_recovery(len);
+    }
+#endif
+
+    const uint16_t maxpool_channels[] = {4, 8, 16};
+    for (uint16_t n_channels : maxpool_channels) {
+        bench_maxpool(n_channels);
+    }
+
+    // Dense Conv against depthwise and grouped Conv with 16x and 4x fewer MACs, dense Conv with 8-bit and sparse filters,
+    // dense Conv with 8-bit outputs, dense and depthwise Conv writing NHWC, and dense Conv with input-stationary
+    for (uint8_t node_idx = 2; node_idx < MODEL_NODES_LEN; node_idx++) {
+        bench_conv(node_idx);
+    }
+
+    const uint16_t interleave_channels[] = {2, 4, 16};
+    for (uint16_t numChannels : interleave_channels) {
+        bench_interleave(numChannels, 256);
+        bench_interleave(numChannels, 1024);
+    }
+
+    const uint16_t nvm_sizes[] = {2, 16, 128, 1024};
+    for (uint16_t n : nvm_sizes) {
+        bench_nvm(n);
+    }
+
+    return 0;
+}
@@ -0,0 +1,232 @@
+
+#include <cstring>
+#include "data.h"
+#include "cnn_common.h"
+#include "my_debug.h"
+#include "platform.h"
+
+const handler handlers[] = {
+    handle_conv,
+    handle_maxpool,
+    handle_relu,
+};
+const allocator allocators[] = {
+    alloc_conv,
+    alloc_maxpool,
+    alloc_relu,
+};
+const char * const op_names[] = {
+    "Conv",
+    "MaxPool",
+    "Relu",
+};
+
+// Blocks (kh * kW + kw) of filters of conv_sparse that are not zero. Other blocks are also zeros in filters of conv_dense
+static const uint16_t sparse_filter_blocks[] = {0, 2, 4, 6, 8};
+#define N_SPARSE_FILTER_BLOCKS (sizeof(sparse_filter_blocks) / sizeof(sparse_filter_blocks[0]))
+
+/* Filters of conv_dense, conv_depthwise and conv_grouped (NHWC, as reordered by transform.py) and biases are small
+ * enough to keep outputs within the range of q15. Filters of conv_sparse are transformed from filters of conv_dense like get_sparse_weight_rows()
+ * in transform.py, and filters of conv_dense are multiples of 2^CONV_Q7_SHIFT, which are exactly q7 filters of conv_dense_q7
+ * with the shift, so that outputs of these nodes can be compared with those of conv_dense in bench_conv */
+#define CONV_Q7_SHIFT 4
+static void init_conv_parameters(const ParameterInfo *params, uint32_t seed);
+
+/* Storage for data generated by transform.py for real models. They are filled by init_bench_data() */
+static uint8_t _parameters_data[PARAMETERS_DATA_LEN];
+const uint8_t * const parameters_data = _parameters_data;
+static uint8_t _samples_data[SAMPLES_DATA_LEN];
+const uint8_t * const samples_data = _samples_data;
+static uint8_t _model_data[MODEL_DATA_LEN];
+const uint8_t * const model_data = _model_data;
+static uint8_t _nodes_data[NODES_DATA_LEN];
+const uint8_t * const nodes_data = _nodes_data;
+static uint8_t _model_parameters_info_data[MODEL_PARAMETERS_INFO_DATA_LEN];
+const uint8_t * const model_parameters_info_data = _model_parameters_info_data;
+static uint8_t _intermediate_parameters_info_data[INTERMEDIATE_PARAMETERS_INFO_DATA_LEN];
+const uint8_t * const intermediate_parameters_info_data = _intermediate_parameters_info_data;
+static uint8_t _labels_data[LABELS_DATA_LEN];
+const uint8_t * const labels_data = _labels_data;
+
+static_assert(sizeof(Model) == MODEL_DATA_LEN, "Unexpected size for model data");
+static_assert(sizeof(Node) * MODEL_NODES_LEN == NODES_DATA_LEN, "Unexpected size for nodes data");
+
+static void init_node(Node *node, const char *name, int16_t input, uint16_t op_type) {
+    strncpy(node->name, name, NODE_NAME_LEN);
+    strncpy(node->output_name, name, NODE_NAME_LEN);
+    node->inputs_len = 1;
+    node->inputs[0] = input;
+    node->op_type = op_type;
+}
+
+void init_bench_data(void) {
+    // The same as the model data written by transform.py
+    Model *model = reinterpret_cast<Model*>(_model_data);
+    memset(model, 0, sizeof(Model));
+#if INDIRECT_RECOVERY
+    for (uint8_t idx = 0; idx < NUM_SLOTS; idx++) {
+        SlotInfo *cur_slot_info = model->slots_info + idx;
+        cur_slot_info->state_bit = 1;
+        cur_slot_info->n_turning_points = 0;
+        for (uint8_t turning_point_idx = 0; turning_point_idx < TURNING_POINTS_LEN; turning_point_idx++) {
+            cur_slot_info->turning_points[turning_point_idx] = static_cast<uint16_t>(-1);
+        }
+    }
+#endif
+
+    Node *nodes = reinterpret_cast<Node*>(_nodes_data);
+    memset(nodes, 0, NODES_DATA_LEN);
+    // conv1 is never run. Its output is filled by benchmarks directly
+    init_node(nodes + 0, "conv1", 0, OpConv);
+    init_node(nodes + 1, "pool1", N_INPUT + 0, OpMaxPool);
+    nodes[1].flags.extra.maxpool.kernel_shape[0] = nodes[1].flags.extra.maxpool.kernel_shape[1] = 2;
+    nodes[1].flags.extra.maxpool.strides[0] = nodes[1].flags.extra.maxpool.strides[1] = 2;
+    // Dense and depthwise 3x3 Conv on the output of conv1, with filters in VM for all output channels,
+    // dense Conv with 8-bit or sparse filters or with 8-bit outputs, grouped Conv with 4 channels in a group, dense
+    // and depthwise Conv writing NHWC, as transform.py does without ConvMerge, and dense Conv with input-stationary
+    // over 2 filter tiles
+    const char * const conv_names[] = {"conv_dense", "conv_depthwise", "conv_dense_q7", "conv_sparse", "conv_grouped", "conv_dense_a8",
+                                       "conv_dense_nhwc", "conv_depthwise_nhwc", "conv_dense_is"};
+    const uint16_t conv_groups[] = {1, 16, 1, 1, 4, 1, 1, 16, 1};
+    const int16_t conv_filters[] = {1, 2, 4, 5, 6, 1, 1, 2, 1};
+    const uint8_t conv_generic_flags[] = {0, 0, 0, 0, 0, 0, NHWC_OUTPUTS, NHWC_OUTPUTS, 0};
+    for (uint8_t idx = 0; idx < 9; idx++) {
+        Node *conv_node = nodes + 2 + idx;
+        init_node(conv_node, conv_names[idx], N_INPUT + 0, OpConv);
+        conv_node->inputs_len = 3;
+        conv_node->inputs[1] = conv_filters[idx];
+        conv_node->inputs[2] = 3;
+        conv_node->flags.generic = conv_generic_flags[idx];
+        conv_node->flags.stride = 1;
+        ConvNodeFlags *conv_flags = &conv_node->flags.extra.conv;
+        conv_flags->input_tile_c = 16;
+        conv_flags->output_tile_c = (idx == 8) ? 8 : 16;
+        conv_flags->dataflow = (idx == 8) ? CONV_DATAFLOW_INPUT_STATIONARY : CONV_DATAFLOW_FILTER_STATIONARY;
+        conv_flags->pads[0] = conv_flags->pads[1] = conv_flags->pads[2] = conv_flags->pads[3] = 1;
+        // An output row at a time with NHWC_OUTPUTS
+        conv_flags->tile_h = (conv_generic_flags[idx] & NHWC_OUTPUTS) ? 1 : 4;
+        conv_flags->group = conv_groups[idx];
+    }
+
+    ParameterInfo *input = reinterpret_cast<ParameterInfo*>(_model_parameters_info_data);
+    memset(input, 0, MODEL_PARAMETERS_INFO_DATA_LEN);
+    input->params_len = SAMPLES_DATA_LEN;
+    input->bitwidth = 16;
+    input->slot = SLOT_TEST_SET;
+    input->dims[0] = 1;
+    input->dims[1] = 4;
+    input->dims[2] = input->dims[3] = 16;
+    input->scale = 1;
+    input->parameter_info_idx = 0;
+
+    // Filters of conv_dense, conv_depthwise, conv_dense_q7, conv_sparse and conv_grouped, and biases shared by them
+    uint32_t params_offset = 0;
+    for (uint8_t idx = 1; idx < N_INPUT; idx++) {
+        ParameterInfo *param = input + idx;
+        param->params_offset = params_offset;
+        param->bitwidth = (idx == 4) ? 8 : 16;
+        param->slot = SLOT_PARAMETERS;
+        param->dims[0] = 16;
+        if (idx != 3) {
+            param->dims[1] = (idx == 2) ? 1 : ((idx == 6) ? 4 : 16);
+            param->dims[2] = param->dims[3] = 3;
+            // Only non-zero blocks of filters of conv_sparse are kept (see init_conv_parameters())
+            const uint16_t kernel_len = (idx == 5) ? N_SPARSE_FILTER_BLOCKS : 3 * 3;
+            param->params_len = 16 * param->dims[1] * kernel_len * param->bitwidth / 8;
+            if (idx == 5) {
+                param->param_flags = SPARSE;
+            }
+        } else {
+            param->params_len = 16 * sizeof(int16_t);
+        }
+        param->scale = 1;
+        param->parameter_info_idx = idx;
+        params_offset += param->params_len;
+        if (param->bitwidth == 8) {
+            // Shifts for all output channels after q7 values (see read_q7_parameters())
+            params_offset += param->params_len % 2 + param->dims[0] * sizeof(int16_t);
+        }
+        if (param->param_flags & SPARSE) {
+            // Block-CSR indices after values: 2 row pointers for the only row and a column index for each block
+            params_offset += (2 + N_SPARSE_FILTER_BLOCKS) * sizeof(uint16_t);
+        }
+    }
+    MY_ASSERT(params_offset <= PARAMETERS_DATA_LEN);
+
+    ParameterInfo *intermediate_parameters_info = reinterpret_cast<ParameterInfo*>(_intermediate_parameters_info_data);
+    memset(intermediate_parameters_info, 0, INTERMEDIATE_PARAMETERS_INFO_DATA_LEN);
+    for (uint8_t idx = 0; idx < MODEL_NODES_LEN; idx++) {
+        // Like the plan from transform.py: the output of conv1 in the first region, and outputs of other
+        // nodes, which read the output of conv1, in the second region
+        ParameterInfo *output = intermediate_parameters_info + idx;
+        output->slot = (idx == 0) ? 0 : 1;
+        output->params_offset = output->slot * BENCH_REGION_SIZE;
+        output->params_len = BENCH_REGION_SIZE;
+        // Outputs of conv_dense_a8 are planned as 8-bit values, like --activation-precision 8 of transform.py
+        output->bitwidth = (idx == 7) ? 8 : 16;
+        output->parameter_info_idx = N_INPUT + idx;
+    }
+
+    // Deterministic pseudo-random values so that runs are comparable
+    uint32_t seed = 1;
+    for (uint16_t idx = 0; idx < PARAMETERS_DATA_LEN; idx++) {
+        seed = seed * 1103515245 + 12345;
+        _parameters_data[idx] = seed >> 16;
+    }
+    for (uint16_t idx = 0; idx < SAMPLES_DATA_LEN; idx++) {
+        seed = seed * 1103515245 + 12345;
+        _samples_data[idx] = seed >> 16;
+    }
+    init_conv_parameters(input, seed);
+    _labels_data[0] = 0;
+}
+
+static void init_conv_parameters(const ParameterInfo *params, uint32_t seed) {
+    const uint16_t N_FILTERS = params[1].dims[0], CHANNEL = params[1].dims[1];
+    int16_t *dense_filters = reinterpret_cast<int16_t*>(_parameters_data + params[1].params_offset);
+    int16_t *biases = reinterpret_cast<int16_t*>(_parameters_data + params[3].params_offset);
+    int16_t *sparse_filters = reinterpret_cast<int16_t*>(_parameters_data + params[5].params_offset);
+    for (uint16_t idx = 0; idx < N_FILTERS * 3 * 3 * CHANNEL; idx++) {
+        seed = seed * 1103515245 + 12345;
+        const uint16_t block = idx / CHANNEL % (3 * 3);
+        bool is_zero_block = true;
+        for (uint16_t sparse_block : sparse_filter_blocks) {
+            is_zero_block &= (sparse_block != block);
+        }
+        dense_filters[idx] = is_zero_block ? 0 : static_cast<int16_t>(static_cast<int8_t>(seed >> 16) * (1 << CONV_Q7_SHIFT));
+    }
+    int8_t *q7_filters = reinterpret_cast<int8_t*>(_parameters_data + params[4].params_offset);
+    for (uint16_t idx = 0; idx < params[4].params_len; idx++) {
+        q7_filters[idx] = static_cast<int8_t>(dense_filters[idx] / (1 << CONV_Q7_SHIFT));
+    }
+    int16_t *q7_shifts = reinterpret_cast<int16_t*>(_parameters_data + params[4].params_offset + params[4].params_len + params[4].params_len % 2);
+    for (uint16_t idx = 0; idx < N_FILTERS; idx++) {
+        q7_shifts[idx] = CONV_Q7_SHIFT;
+    }
+    for (uint16_t idx = 0; idx < N_FILTERS; idx++) {
+        seed = seed * 1103515245 + 12345;
+        biases[idx] = static_cast<int16_t>((seed >> 16) % 0x1001) - 0x800;
+    }
+    // Filters of conv_depthwise and conv_grouped, whose outputs are checked against sums computed in bench_conv
+    const uint8_t group_conv_filters[] = {2, 6};
+    for (uint8_t param_idx : group_conv_filters) {
+        int16_t *filters = reinterpret_cast<int16_t*>(_parameters_data + params[param_idx].params_offset);
+        for (uint16_t idx = 0; idx < params[param_idx].params_len / sizeof(int16_t); idx++) {
+            seed = seed * 1103515245 + 12345;
+            filters[idx] = static_cast<int16_t>((seed >> 16) % 0x1001) - 0x800;
+        }
+    }
+
+    // A block of conv_sparse is output_tile_c filters x input_tile_c channels at a pixel in the kernel (see convTask)
+    int16_t *sparse_ptr = sparse_filters;
+    for (uint16_t sparse_block : sparse_filter_blocks) {
+        for (uint16_t n = 0; n < N_FILTERS; n++) {
+            memcpy(sparse_ptr, dense_filters + (n * 3 * 3 + sparse_block) * CHANNEL, CHANNEL * sizeof(int16_t));
+            sparse_ptr += CHANNEL;
+        }
+    }
+    uint16_t *sparse_indices = reinterpret_cast<uint16_t*>(sparse_ptr);
+    sparse_indices[0] = 0;
+    sparse_indices[1] = N_SPARSE_FILTER_BLOCKS;
+    memcpy(sparse_indices + 2, sparse_filter_blocks, sizeof(sparse_filter_blocks));
+}
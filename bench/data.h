@@ -0,0 +1,122 @@
+
+#pragma once
+
+#include <stdint.h>
+
+struct ParameterInfo;
+struct Model;
+struct Node;
+
+/*
+ * A hand-written counterpart of data.h generated by dnn-models/transform.py, so
+ * that kernels can be benchmarked without converting a model. Constants follow
+ * those of the msp432 target and the kws/har configurations. The intermittent
+ * inference approach and the batch size are selected with BENCH_METHOD and
+ * BENCH_BATCH_SIZE (see bench/CMakeLists.txt).
+ */
+
+#ifndef BENCH_METHOD
+#define BENCH_METHOD 1
+#endif
+#ifndef BENCH_BATCH_SIZE
+#define BENCH_BATCH_SIZE 1
+#endif
+
+#define ARM_PSTATE_LEN 8704
+#define BATCH_SIZE BENCH_BATCH_SIZE
+// Sizes of both regions of intermediate values (see init_bench_data())
+#define BENCH_REGION_SIZE 20000l
+#define CONFIG "bench"
+#define DEFAULT_TILE_H 8
+#define EXTRA_INFO_LEN 3
+#define FIRST_SAMPLE_OUTPUTS {0}
+#define FP32_ACCURACY 0
+#define GEMM_TILE_LENGTH 0
+#define HAWAII (BENCH_METHOD == 2)
+#define INDIRECT_RECOVERY (STATEFUL | JAPARI)
+#define INPUTS_DATA_LEN 0
+#define INPUT_SCALE 1
+#define INTERMEDIATE_VALUES_SIZE (NUM_SLOTS * BENCH_REGION_SIZE)
+#define INTERMITTENT (STATEFUL | HAWAII | JAPARI)
+#define JAPARI (BENCH_METHOD == 3)
+#define LEA_BUFFER_SIZE 18000
+#if BENCH_METHOD == 1
+#define METHOD "STATEFUL"
+#elif BENCH_METHOD == 2
+#define METHOD "HAWAII"
+#elif BENCH_METHOD == 3
+#define METHOD "JAPARI"
+#else
+#define METHOD "Baseline"
+#endif
+#define MAX_MODEL_NODES_LEN MODEL_NODES_LEN
+#define MAX_NUM_SLOTS NUM_SLOTS
+#define MODEL_BUNDLE 0
+#define MODEL_NODES_LEN 11
+#define NODE_NAME_LEN 60
+#define NUM_INPUTS 3
+#define NUM_SLOTS 2
+#define NVM_SIZE 524288
+#define N_ALL_SAMPLES 1
+#define N_INPUT 7
+#define N_SAMPLES 1
+#define OP_FILTERS 4
+#define PROGRESS_HINT_INTERVAL 0
+#define RECOVERY_BLOCK_LEN 64
+#define SCALE 1
+#define SLOT_PARAMETERS 254
+#define SLOT_TEST_SET 255
+#define STATEFUL (BENCH_METHOD == 1)
+#define TEMP_FILTER_WIDTH 1
+#define TOTAL_SAMPLE_SIZE 1024
+#define TURNING_POINTS_LEN 8
+#ifndef USE_ARM_CMSIS
+#define USE_ARM_CMSIS 1
+#endif
+
+#define OpConv 0
+#define OpMaxPool 1
+#define OpRelu 2
+void alloc_conv(struct Model *model, const struct ParameterInfo *input[], struct ParameterInfo *output, const struct Node* node);
+void handle_conv(struct Model *model, const struct ParameterInfo *input[], struct ParameterInfo *output, const struct Node* node);
+void alloc_maxpool(struct Model *model, const struct ParameterInfo *input[], struct ParameterInfo *output, const struct Node* node);
+void handle_maxpool(struct Model *model, const struct ParameterInfo *input[], struct ParameterInfo *output, const struct Node* node);
+void alloc_relu(struct Model *model, const struct ParameterInfo *input[], struct ParameterInfo *output, const struct Node* node);
+void handle_relu(struct Model *model, const struct ParameterInfo *input[], struct ParameterInfo *output, const struct Node* node);
+extern const char * const op_names[];
+#define NHWC2NCHW 1
+#define MAXPOOL_CEIL 2
+#define FUSED_RELU 4
+#define FUSED_MAXPOOL 8
+#define NHWC_OUTPUTS 16
+#define CHANNEL_FIRST 32
+#define SEPARATE_TILING 64
+#define SPARSE 128
+
+/* Sizes below are derived from struct definitions in cnn_common.h */
+
+extern const uint8_t * const parameters_data;
+#define PARAMETERS_DATA_LEN 16384
+
+extern const uint8_t * const samples_data;
+#define SAMPLES_DATA_LEN (2 * TOTAL_SAMPLE_SIZE)
+
+extern const uint8_t * const model_data;
+#define MODEL_DATA_LEN (8 + INDIRECT_RECOVERY * NUM_SLOTS * (2 + TURNING_POINTS_LEN * 2))
+
+extern const uint8_t * const nodes_data;
+#define NODES_DATA_LEN (MODEL_NODES_LEN * (NODE_NAME_LEN * 2 + 18 + NUM_INPUTS * 2 + HAWAII * 8))
+
+extern const uint8_t * const model_parameters_info_data;
+#define MODEL_PARAMETERS_INFO_DATA_LEN (N_INPUT * 28)
+
+extern const uint8_t * const intermediate_parameters_info_data;
+#define INTERMEDIATE_PARAMETERS_INFO_DATA_LEN (MODEL_NODES_LEN * 28)
+
+extern const uint8_t * const labels_data;
+#define LABELS_DATA_LEN 1
+
+// Fill the above data with a synthetic model: a 16x16x16 input (NHWC) for a 2x2 MaxPool and
+// 3x3 Conv layers with 16 output channels, either dense, depthwise or grouped, with 16-bit or 8-bit filters,
+// with dense or sparse filters, with 16-bit or 8-bit outputs, and with outputs in NWHC or NHWC
+void init_bench_data(void);
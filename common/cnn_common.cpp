@@ -11,8 +11,8 @@
 #include "op_utils.h"
 #include "platform.h"
 
-ParameterInfo intermediate_parameters_info_vm[MODEL_NODES_LEN];
-uint16_t sample_idx;
+PLAT_THREAD_LOCAL ParameterInfo intermediate_parameters_info_vm[MAX_MODEL_NODES_LEN];
+PLAT_THREAD_LOCAL uint16_t sample_idx;
 
 const ParameterInfo* get_parameter_info(uint16_t i) {
     if (i < N_INPUT) {
@@ -30,6 +30,7 @@ const Node* get_node(const ParameterInfo* param) {
     return get_node(param->parameter_info_idx - N_INPUT);
 }
 
+#if INDIRECT_RECOVERY
 SlotInfo* get_slot_info(Model* model, uint8_t i) {
     if (i < NUM_SLOTS) {
         return model->slots_info + i;
@@ -37,9 +38,67 @@ SlotInfo* get_slot_info(Model* model, uint8_t i) {
         return nullptr;
     }
 }
+#endif
+
+/* 8-bit parameters are q7 values followed by a 16-bit left shift for each output channel, which is a slice
+ * along dims[0] for Conv filters and a column along dims[1] for 2-D Gemm weights. They are
+ * widened to _q15 values while loading, so that kernels are the same as for 16-bit parameters.
+ * Parameters may be read with DMA in 16-bit units, so q7 values are read from and to even offsets
+ * into the upper part of dest, and widened in place from the beginning. */
+static void read_q7_parameters(int16_t *dest, const ParameterInfo *param, uint16_t offset_in_word, uint16_t n) {
+    uint16_t aligned_begin = offset_in_word / 2 * 2,
+             aligned_len = (offset_in_word + n + 1) / 2 * 2 - aligned_begin;
+    // At most n + 2 bytes, so q7 values are not overwritten before they are widened
+    const int8_t *q7_values = reinterpret_cast<int8_t*>(dest) + 2 * n - aligned_len;
+    my_memcpy_from_parameters(dest + n - aligned_len / 2, param, aligned_begin, aligned_len);
+    q7_values += offset_in_word - aligned_begin;
+
+    const uint32_t shifts_offset = param->params_len + param->params_len % 2;
+    if (!param->dims[2]) {
+        // Shifts of consecutive columns are read together, as each value is in another column
+        const uint8_t SHIFTS_BUFFER_LEN = 16;
+        int16_t shifts[SHIFTS_BUFFER_LEN];
+        const uint16_t n_cols = param->dims[1];
+        uint16_t col = offset_in_word % n_cols, shift_idx = 0, n_shifts = 0;
+        for (uint16_t idx = 0; idx < n; idx++) {
+            if (shift_idx == n_shifts) {
+                n_shifts = MIN_VAL(SHIFTS_BUFFER_LEN, n_cols - col);
+                my_memcpy_from_parameters(shifts, param, shifts_offset + col * sizeof(int16_t), n_shifts * sizeof(int16_t));
+                shift_idx = 0;
+            }
+            dest[idx] = static_cast<int16_t>(q7_values[idx] * (1 << shifts[shift_idx]));
+            shift_idx++;
+            col++;
+            if (col == n_cols) {
+                // Values continue with the next row
+                col = 0;
+                shift_idx = n_shifts;
+            }
+        }
+        return;
+    }
+
+    const uint16_t slice_len = param->params_len / param->dims[0];
+    uint16_t slice_idx = offset_in_word / slice_len, slice_end = (slice_idx + 1) * slice_len;
+    int16_t shift;
+    my_memcpy_from_parameters(&shift, param, shifts_offset + slice_idx * sizeof(int16_t), sizeof(int16_t));
+    for (uint16_t idx = 0; idx < n; idx++) {
+        if (offset_in_word + idx == slice_end) {
+            slice_idx++;
+            slice_end += slice_len;
+            my_memcpy_from_parameters(&shift, param, shifts_offset + slice_idx * sizeof(int16_t), sizeof(int16_t));
+        }
+        dest[idx] = static_cast<int16_t>(q7_values[idx] * (1 << shift));
+    }
+}
 
 int16_t get_q15_param(Model* model, const ParameterInfo *param, uint16_t i) {
-    MY_ASSERT(param->bitwidth == 16);
+    if (param->bitwidth == 8 && param->slot == SLOT_PARAMETERS) {
+        int16_t ret;
+        read_q7_parameters(&ret, param, i, 1);
+        return ret;
+    }
+    MY_ASSERT(param->bitwidth == 16 || (param->bitwidth == 8 && param->slot < NUM_SLOTS));
     if (param->slot == SLOT_TEST_SET) {
         int16_t ret;
         read_from_samples(&ret, i, sizeof(int16_t));
@@ -55,6 +114,23 @@ int16_t get_q15_param(Model* model, const ParameterInfo *param, uint16_t i) {
     }
 }
 
+/* Parameters with SPARSE are non-zero blocks of values followed by block-CSR indices: n_rows + 1 row
+ * pointers and a column index for each block, all uint16_t. How rows, columns and blocks map to
+ * filters and weights is up to operators (see convTask and handle_gemm_tile). */
+uint16_t load_sparse_row(const ParameterInfo *param, uint16_t n_rows, uint16_t row, uint16_t *first_block, uint16_t *cols, uint16_t max_blocks) {
+    MY_ASSERT(param->param_flags & SPARSE);
+    MY_ASSERT(row < n_rows);
+    uint16_t row_ptrs[2];
+    my_memcpy_from_parameters(row_ptrs, param, param->params_len + row * sizeof(uint16_t), sizeof(row_ptrs));
+    uint16_t n_blocks = row_ptrs[1] - row_ptrs[0];
+    MY_ASSERT(n_blocks <= max_blocks);
+    if (n_blocks) {
+        my_memcpy_from_parameters(cols, param, param->params_len + (n_rows + 1 + row_ptrs[0]) * sizeof(uint16_t), n_blocks * sizeof(uint16_t));
+    }
+    *first_block = row_ptrs[0];
+    return n_blocks;
+}
+
 void put_q15_param(ParameterInfo *param, uint16_t i, int16_t val) {
     my_memcpy_to_param(param, i, &val, sizeof(int16_t), 0);
 }
@@ -68,54 +144,30 @@ int64_t get_int64_param(const ParameterInfo *param, size_t i) {
 
 }
 
-uint16_t get_next_slot(Model *model, const ParameterInfo *param) {
-    uint16_t slot_id = param->slot;
-    /* pick the next unused slot */
-    uint16_t next_slot_id = slot_id;
-    uint8_t cycle_count = 0;
-    while (1) {
-        next_slot_id++;
-        // Fail if the loop has run a cycle
-        if (next_slot_id >= NUM_SLOTS) {
-            next_slot_id = 0;
-            cycle_count++;
-            MY_ASSERT(cycle_count <= 1);
-        }
-        int16_t slot_user_id = get_slot_info(model, next_slot_id)->user;
-        if (slot_user_id < 0) {
-            break;
-        }
-        // previously allocated, most likely in a previous power cycle
-        if (slot_user_id == model->layer_idx) {
-            break;
-        }
-        const Node *slot_user = get_node(slot_user_id);
-        if (slot_user->max_output_id < model->layer_idx) {
-            break;
-        }
-        // The recorded slot user is not the actual user. This happens when Concat
-        // uses a new slot for scaled IFM. The old slot is actually used by nobody
-        // and available for allocation.
-        if (get_parameter_info(N_INPUT + slot_user_id)->slot != next_slot_id) {
-            break;
-        }
-    }
-    my_printf_debug("next_slot_id = %d" NEWLINE, next_slot_id);
-    get_slot_info(model, next_slot_id)->user = model->layer_idx;
-    return next_slot_id;
+// Store intermediate values in param, which are allocated as q15 values, with the given bitwidth
+void set_intermediate_bitwidth(ParameterInfo *param, uint8_t bitwidth) {
+    MY_ASSERT(param->slot < NUM_SLOTS && (bitwidth == 16 || bitwidth == 8));
+    param->params_len = get_values_len(param) * bitwidth / 8;
+    param->bitwidth = bitwidth;
 }
 
 void my_memcpy_from_param(Model* model, void *dest, const ParameterInfo *param, uint16_t offset_in_word, size_t n) {
     if (param->slot == SLOT_TEST_SET) {
         read_from_samples(dest, offset_in_word, n);
     } else if (param->slot == SLOT_PARAMETERS) {
-        my_memcpy_from_parameters(dest, param, offset_in_word * sizeof(int16_t), n);
+        if (param->bitwidth == 8) {
+            read_q7_parameters(reinterpret_cast<int16_t*>(dest), param, offset_in_word, n / sizeof(int16_t));
+        } else {
+            my_memcpy_from_parameters(dest, param, offset_in_word * sizeof(int16_t), n);
+        }
     } else {
         my_memcpy_from_intermediate_values(dest, param, offset_in_word, n);
     }
 }
 
 static void handle_node(Model *model, uint16_t node_idx) {
+    profiler_node_begin(node_idx);
+
     const Node *cur_node = get_node(node_idx);
 #if MY_DEBUG >= MY_DEBUG_LAYERS
     my_printf("Current node: %d, ", node_idx);
@@ -136,11 +188,25 @@ static void handle_node(Model *model, uint16_t node_idx) {
     /* Allocate an ParameterInfo for output. Details are filled by
      * individual operation handlers */
     ParameterInfo *output = get_intermediate_parameter_info(node_idx);
+    // The region and the offset are planned by transform.py, and kept in NVM across runs
+    uint8_t planned_slot = output->slot, planned_bitwidth = output->bitwidth;
+    uint32_t planned_params_offset = output->params_offset;
     my_memcpy(output, input[0], sizeof(ParameterInfo) - sizeof(uint16_t)); // don't overwrite parameter_info_idx
-    output->params_offset = 0;
+    output->slot = planned_slot;
+    output->params_offset = planned_params_offset;
     allocators[cur_node->op_type](model, input, output, cur_node);
-    my_printf_debug("Needed mem = %d" NEWLINE, output->params_len);
-    MY_ASSERT(output->params_len < INTERMEDIATE_VALUES_SIZE);
+    // Intermediate values may be planned as 8-bit values, while allocators give the size of q15 values
+    // or the size of the input
+    if (planned_bitwidth && output->slot < NUM_SLOTS && output->bitwidth != planned_bitwidth) {
+        set_intermediate_bitwidth(output, planned_bitwidth);
+    }
+    my_printf_debug("Needed mem = %d at offset %d in slot %d" NEWLINE, output->params_len, output->params_offset, output->slot);
+#if MY_DEBUG >= MY_DEBUG_NORMAL
+    // params_len in NVM is overwritten by allocators, so the planned size of the region is from the original data
+    uint32_t planned_len = (reinterpret_cast<const ParameterInfo*>(intermediate_parameters_info_data) + node_idx)->params_len;
+    MY_ASSERT(output->params_len <= planned_len, "Needed mem = %d is larger than the planned %d" NEWLINE, output->params_len, planned_len);
+#endif
+    MY_ASSERT(output->slot >= NUM_SLOTS || output->params_offset + output->params_len <= INTERMEDIATE_VALUES_SIZE);
 
 #if STATEFUL
     my_printf_debug("Old output state bit=%d" NEWLINE, get_state_bit(model, output->slot));
@@ -166,10 +232,13 @@ static void handle_node(Model *model, uint16_t node_idx) {
         }
 #endif
     }
+
+    profiler_node_end(node_idx);
 }
 
-#if MY_DEBUG >= MY_DEBUG_NORMAL
+#if MY_DEBUG >= MY_DEBUG_NORMAL && !MODEL_BUNDLE
 const float first_sample_outputs[] = FIRST_SAMPLE_OUTPUTS;
+#define FIRST_SAMPLE_OUTPUTS_LEN (sizeof(first_sample_outputs) / sizeof(float))
 #endif
 
 static void run_model(int8_t *ansptr, const ParameterInfo **output_node_ptr) {
@@ -179,10 +248,6 @@ static void run_model(int8_t *ansptr, const ParameterInfo **output_node_ptr) {
     if (!model->running) {
         // reset model
         model->layer_idx = 0;
-        for (uint8_t idx = 0; idx < NUM_SLOTS; idx++) {
-            SlotInfo *cur_slot_info = get_slot_info(model, idx);
-            cur_slot_info->user = -1;
-        }
 #if HAWAII
         for (uint16_t node_idx = 0; node_idx < MODEL_NODES_LEN; node_idx++) {
             reset_hawaii_layer_footprint(node_idx);
@@ -212,7 +277,7 @@ static void run_model(int8_t *ansptr, const ParameterInfo **output_node_ptr) {
 #if MY_DEBUG >= MY_DEBUG_NORMAL
     int16_t max = INT16_MIN;
     uint16_t u_ans;
-    uint8_t ans_len = sizeof(first_sample_outputs) / sizeof(float);
+    uint8_t ans_len = FIRST_SAMPLE_OUTPUTS_LEN;
 #if JAPARI
     ans_len = extend_for_footprints(ans_len);
 #endif
@@ -220,9 +285,7 @@ static void run_model(int8_t *ansptr, const ParameterInfo **output_node_ptr) {
     my_memcpy_from_param(model, lea_buffer, output_node, 0, buffer_len * sizeof(int16_t));
 
 #if STATEFUL
-    for (uint8_t idx = BATCH_SIZE - 1; idx < buffer_len; idx += BATCH_SIZE) {
-        strip_state(lea_buffer + idx);
-    }
+    my_strip_states_q15(lea_buffer, buffer_len, 0, BATCH_SIZE, false);
 #endif
 
     if (sample_idx == 0) {
@@ -257,46 +320,58 @@ static void run_model(int8_t *ansptr, const ParameterInfo **output_node_ptr) {
 #endif
 }
 
-uint8_t run_cnn_tests(uint16_t n_samples) {
-    int8_t predicted = -1;
-    const ParameterInfo *output_node;
+uint16_t get_n_test_samples(uint16_t n_samples) {
 #if MY_DEBUG >= MY_DEBUG_NORMAL
-    int8_t label = -1;
-    uint32_t correct = 0, total = 0;
     if (!n_samples) {
         n_samples = PLAT_LABELS_DATA_LEN;
     }
-    const uint8_t *labels = labels_data;
 #endif
-    for (uint16_t i = 0; i < n_samples; i++) {
-        sample_idx = i;
-        run_model(&predicted, &output_node);
+    return n_samples;
+}
+
+void run_cnn_test_sample(uint16_t idx, TestResults *results) {
+    int8_t predicted = -1;
+    sample_idx = idx;
+    run_model(&predicted, nullptr);
 #if MY_DEBUG >= MY_DEBUG_NORMAL
-        label = labels[i];
-        total++;
-        if (label == predicted) {
-            correct++;
-        }
-        if (i % 100 == 99) {
-            my_printf("Sample %d finished" NEWLINE, sample_idx);
-            // stdout is not flushed at \n if it is not a terminal
-            my_flush();
-        }
-        my_printf_debug("idx=%d label=%d predicted=%d correct=%d" NEWLINE, i, label, predicted, label == predicted);
-#endif
+    int8_t label = labels_data[idx];
+    results->total++;
+    if (label == predicted) {
+        results->correct++;
     }
-#if MY_DEBUG >= MY_DEBUG_NORMAL
-    if (n_samples == 1) {
-        dump_params(get_model(), output_node);
+    if (idx % 100 == 99) {
+        my_printf("Sample %d finished" NEWLINE, idx);
+        // stdout is not flushed at \n if it is not a terminal
+        my_flush();
     }
-    my_printf("correct=%" PRId32 " ", correct);
-    my_printf("total=%" PRId32 " ", total);
-    my_printf("rate=%f" NEWLINE, 1.0*correct/total);
+    my_printf_debug("idx=%d label=%d predicted=%d correct=%d" NEWLINE, idx, label, predicted, label == predicted);
+#endif
+}
+
+uint8_t report_cnn_test_results(const TestResults *results) {
+#if MY_DEBUG >= MY_DEBUG_NORMAL
+    my_printf("correct=%" PRId32 " ", results->correct);
+    my_printf("total=%" PRId32 " ", results->total);
+    my_printf("rate=%f" NEWLINE, 1.0*results->correct/results->total);
 
     // Allow only 1% of accuracy drop
-    if (N_SAMPLES == N_ALL_SAMPLES && correct < (FP32_ACCURACY - 0.01) * total) {
+    if (N_SAMPLES == N_ALL_SAMPLES && results->correct < (FP32_ACCURACY - 0.01) * results->total) {
         return 1;
     }
 #endif
     return 0;
 }
+
+uint8_t run_cnn_tests(uint16_t n_samples) {
+    TestResults results = {0, 0};
+    n_samples = get_n_test_samples(n_samples);
+    for (uint16_t i = 0; i < n_samples; i++) {
+        run_cnn_test_sample(i, &results);
+    }
+#if MY_DEBUG >= MY_DEBUG_NORMAL
+    if (n_samples == 1) {
+        dump_params(get_model(), get_parameter_info(MODEL_NODES_LEN + N_INPUT - 1));
+    }
+#endif
+    return report_cnn_test_results(&results);
+}
@@ -3,15 +3,30 @@
 #include <cstddef> /* size_t, see https://stackoverflow.com/a/26413264 */
 #include <cstdint>
 #include "data.h"
+#include "platform.h"
 
 /**********************************
  *        Data structures         *
  **********************************/
 
+// Loop orders of Conv. With filter-stationary, a filter tile stays in VM while all input
+// windows are streamed past it. With input-stationary, an input window stays in VM while all
+// filter tiles are streamed past it, and output values are written in the order of offsets.
+enum ConvDataflow {
+    CONV_DATAFLOW_FILTER_STATIONARY = 0,
+    CONV_DATAFLOW_INPUT_STATIONARY = 1,
+};
+
 struct ConvNodeFlags {
     uint16_t input_tile_c;
     uint16_t output_tile_c;
     uint8_t pads[4];
+    uint8_t dataflow;
+    // Output rows computed from an input window
+    uint8_t tile_h;
+    // Input and output channels are split into this number of groups. With group > 1,
+    // output_tile_c is the number of output channels computed with filters in VM at a time
+    uint16_t group;
 };
 
 struct MaxPoolFlags {
@@ -21,6 +36,8 @@ struct MaxPoolFlags {
 
 struct GemmNodeFlags {
     uint16_t tile_channel;
+    // Output values computed at a time, at most OP_FILTERS
+    uint16_t op_filters;
 };
 
 struct GemmMergeNodeFlags {
@@ -46,14 +63,13 @@ struct NodeFlags {
     ExtraNodeFlags extra;
 };
 
-static_assert(sizeof(NodeFlags) == 10, "Unexpected size for NodeFlags");
+static_assert(sizeof(NodeFlags) == 14, "Unexpected size for NodeFlags");
 
 typedef struct Node {
     char name[NODE_NAME_LEN];
     char output_name[NODE_NAME_LEN];
     uint16_t inputs_len;
     int16_t inputs[NUM_INPUTS];
-    uint16_t max_output_id;
     uint16_t op_type;
     NodeFlags flags;
 #if HAWAII
@@ -64,20 +80,24 @@ typedef struct Node {
 #endif
 } Node;
 
-static_assert(sizeof(Node) == NODE_NAME_LEN * 2 + 16 + NUM_INPUTS * 2 + HAWAII * 8, "Unexpected size for Node");
+static_assert(sizeof(Node) == NODE_NAME_LEN * 2 + 18 + NUM_INPUTS * 2 + HAWAII * 8, "Unexpected size for Node");
 
 /* ParameterInfo may indicate data from the model (parameters) or intermediate values */
 typedef struct ParameterInfo {
+    // For intermediate values, the offset of the region in the arena of intermediate values, planned by transform.py
     uint32_t params_offset;
     uint32_t params_len;  /* in bytes */
     /* Known bitwidth values:
+     * 8: q7 with a shift for each output channel for parameters (see read_q7_parameters()), or
+     *    upper 8 bits of q15 values for intermediate values (see narrow_intermediate_value())
      * 16: q15
      * 32: iq31
      * 64: INT64 (from ONNX)
      */
     uint8_t bitwidth;
     /* A flag to indicate where the data are. Possible values are SLOT_TEST_SET,
-     * SLOT_PARAMETERS and a value in [0, NUM_SLOTS-1].
+     * SLOT_PARAMETERS and a value in [0, NUM_SLOTS-1] for the region of intermediate
+     * values with state bits and turning points in Model.slots_info.
      */
     uint8_t slot;
     uint16_t dummy;
@@ -91,36 +111,57 @@ typedef struct ParameterInfo {
 
 static_assert(sizeof(ParameterInfo) == 28, "Unexpected size for ParameterInfo");
 
-typedef struct SlotInfo {
 #if INDIRECT_RECOVERY
+/* States of values in a region of intermediate values. Intermediate values sharing NVM are in the same
+ * region (see plan_intermediate_values() in transform.py), so that states of old values are known. */
+typedef struct SlotInfo {
     int8_t state_bit;
     uint8_t n_turning_points;
     uint16_t turning_points[TURNING_POINTS_LEN];
-#endif
-    int16_t user;
 } SlotInfo;
+#endif
 
 typedef struct Model {
     uint16_t running;
     uint16_t run_counter;
     uint16_t layer_idx;
-    SlotInfo slots_info[NUM_SLOTS];
+#if INDIRECT_RECOVERY
+    SlotInfo slots_info[MAX_NUM_SLOTS];
+#endif
     uint8_t dummy;
     uint8_t version; // must be the last field in this struct
 } Model;
 
-static_assert(sizeof(Model) == 8 + NUM_SLOTS * (2 + INDIRECT_RECOVERY * (2 + TURNING_POINTS_LEN * 2)), "Unexpected size for Model");
+static_assert(sizeof(Model) == 8 + INDIRECT_RECOVERY * MAX_NUM_SLOTS * (2 + TURNING_POINTS_LEN * 2), "Unexpected size for Model");
+
+// Jobs finished in a layer as of some time, written without versioning every PROGRESS_HINT_INTERVAL
+// jobs. It may be stale or partially written, and progress seeking verifies it with state bits.
+typedef struct ProgressHint {
+    uint16_t layer_idx;
+    uint16_t n_finished_jobs;
+} ProgressHint;
+
+static_assert(sizeof(ProgressHint) == PROGRESS_HINT_DATA_LEN, "Unexpected size for ProgressHint");
 
 /**********************************
  *          Global data           *
  **********************************/
-extern ParameterInfo intermediate_parameters_info_vm[MODEL_NODES_LEN];
-extern uint16_t sample_idx;
+extern PLAT_THREAD_LOCAL ParameterInfo intermediate_parameters_info_vm[MAX_MODEL_NODES_LEN];
+extern PLAT_THREAD_LOCAL uint16_t sample_idx;
 
 /**********************************
  *         The entry point        *
  **********************************/
+struct TestResults {
+    uint32_t correct;
+    uint32_t total;
+};
+
 uint8_t run_cnn_tests(uint16_t n_samples);
+// Building blocks of run_cnn_tests, also used by the sample-parallel driver on PC
+uint16_t get_n_test_samples(uint16_t n_samples);
+void run_cnn_test_sample(uint16_t idx, TestResults *results);
+uint8_t report_cnn_test_results(const TestResults *results);
 
 /**********************************
  *          Miscellaneous         *
@@ -143,12 +184,20 @@ const uint8_t* get_param_base_pointer(const ParameterInfo *param, uint32_t *limi
 int16_t get_q15_param(Model* model, const ParameterInfo *param, uint16_t offset_in_word);
 void put_q15_param(ParameterInfo *param, uint16_t offset_in_word, int16_t val);
 int64_t get_int64_param(const ParameterInfo *param, size_t i);
-uint16_t get_next_slot(Model *model, const ParameterInfo *param);
+uint16_t load_sparse_row(const ParameterInfo *param, uint16_t n_rows, uint16_t row, uint16_t *first_block, uint16_t *cols, uint16_t max_blocks);
 const ParameterInfo* get_parameter_info(uint16_t i);
 const Node* get_node(size_t i);
 const Node* get_node(const ParameterInfo* param);
+#if INDIRECT_RECOVERY
 SlotInfo * get_slot_info(Model* model, uint8_t i);
+#endif
 void my_memcpy_from_param(Model* model, void *dest, const ParameterInfo *param, uint16_t offset_in_word, size_t n);
+void set_intermediate_bitwidth(ParameterInfo *param, uint8_t bitwidth);
+
+// Values in param, which are q15 values in VM for any bitwidth
+static inline uint32_t get_values_len(const ParameterInfo *param) {
+    return param->params_len * 8 / param->bitwidth;
+}
 
 /**********************************
  *       Operation handlers       *
@@ -1,5 +1,6 @@
 #include <cstddef>
 #include <cstdint>
+#include <cstring>
 #include <cinttypes> // for PRId32
 #include "cnn_common.h"
 #include "counters.h"
@@ -8,6 +9,7 @@
 #include "op_utils.h"
 #include "intermittent-cnn.h"
 #include "my_dsplib.h"
+#include "parallel.h"
 #include "platform.h"
 
 // TODO: make these adjustable on runtime
@@ -17,6 +19,11 @@
 #define OUTPUT_LEN 256
 #endif
 
+// Blocks of a filter tile with sparse filters, which are up to kH * kW. Should match transform.py
+#define CONV_MAX_SPARSE_BLOCKS 32
+// Filter tiles kept in VM for input-stationary. Should match transform.py
+#define CONV_MAX_RESIDENT_FILTER_TILES 8
+
 /* Better to not use macros
  * https://stackoverflow.com/a/3437484/3786245
  */
@@ -74,6 +81,12 @@ typedef struct ConvTaskParams {
     uint8_t output_padding;
 #endif
 
+    // Final outputs are written in NHWC instead of NWHC, as ConvMerge is removed (see handle_conv)
+    uint8_t nhwc_outputs;
+    // (h, w) of the input window in VM, which is slid to the next output column instead of reloaded with NHWC outputs
+    int16_t window_input_h;
+    int16_t window_input_w;
+
     uint16_t filter_idx;
     uint16_t filter_tile_index;
     // (h, w) for left-top corner of each input window
@@ -84,17 +97,42 @@ typedef struct ConvTaskParams {
     int16_t *filter_buffer_addr;
     int16_t cached_filter_idx;
     uint16_t cached_input_tile_c_offset;
+    // Filters in a filter tile in VM, including footprints for JAPARI
+    uint16_t max_n_filters;
+    // With input-stationary, all filter tiles are kept in VM if they fit, each at its own buffer (see handle_conv)
+    uint8_t n_resident_filter_tiles;
+    int16_t resident_filter_idx[CONV_MAX_RESIDENT_FILTER_TILES];
+#if INDIRECT_RECOVERY
+    // old_output_offset that state bits in each resident filter tile are for
+    int16_t resident_old_output_offset[CONV_MAX_RESIDENT_FILTER_TILES];
+#endif
+    // Rows of filters in VM, which is less than filter_offset if zero blocks of sparse filters are skipped
+    uint16_t filter_rows;
+    // With sparse filters, non-zero blocks (kh * kW + kw) of filters in VM and inputs gathered for them
+    uint16_t n_sparse_blocks;
+    uint16_t sparse_blocks[CONV_MAX_SPARSE_BLOCKS];
+    int16_t *sparse_input_buffer;
 } ConvTaskParams;
 
-static ConvTaskParams conv_params_obj;
+static PLAT_THREAD_LOCAL ConvTaskParams conv_params_obj;
 
-int16_t * const matrix_mpy_results = lea_buffer + LEA_BUFFER_SIZE - OUTPUT_LEN;
+void reset_conv_states(void) {
+    memset(&conv_params_obj, 0, sizeof(conv_params_obj));
+}
+
+PLAT_THREAD_LOCAL int16_t * const matrix_mpy_results = lea_buffer + LEA_BUFFER_SIZE - OUTPUT_LEN;
+
+static void invalidate_resident_filter_tiles(ConvTaskParams *conv_params) {
+    for (uint8_t idx = 0; idx < CONV_MAX_RESIDENT_FILTER_TILES; idx++) {
+        conv_params->resident_filter_idx[idx] = -1;
+    }
+}
 
 #if INDIRECT_RECOVERY
 static void flip_filter_state_bits(ConvTaskParams *conv_params, uint16_t n_filters, uint16_t len, uint8_t first_round) {
     MY_ASSERT(len < OUTPUT_LEN);
 #if STATEFUL
-    int16_t *to_flip_state_bits = conv_params->filter_buffer_addr + n_filters * conv_params->filter_offset;
+    int16_t *to_flip_state_bits = conv_params->filter_buffer_addr + n_filters * conv_params->filter_rows;
     if (first_round) {
         to_flip_state_bits -= len;
     } else {
@@ -107,7 +145,7 @@ static void flip_filter_state_bits(ConvTaskParams *conv_params, uint16_t n_filte
     my_offset_q15_batched(to_flip_state_bits, offset, to_flip_state_bits, len);
 #endif
 #if JAPARI
-    int16_t *to_flip_state_bits = conv_params->filter_buffer_addr + n_filters * (conv_params->filter_offset - 1);
+    int16_t *to_flip_state_bits = conv_params->filter_buffer_addr + n_filters * (conv_params->filter_rows - 1);
     if (first_round) {
         for (uint16_t idx = BATCH_SIZE; idx < n_filters; idx += BATCH_SIZE + 1) {
             if (idx < n_filters - len) {
@@ -151,12 +189,18 @@ static void convTask(int16_t cur_input_h, ConvTaskParams *conv_params) {
 #endif
     uint16_t output_h = (cur_input_h - conv_params->input_h_first) / conv_params->stride,
              output_w = (conv_params->input_w - conv_params->input_w_first) / conv_params->stride;
-    // use NWHC so that output is written continuously on the address space
-    uint16_t cur_output_data_offset =
+    uint16_t cur_output_data_offset;
+    if (conv_params->nhwc_outputs) {
+        // Output rows are visited in order with a single input channel tile
+        cur_output_data_offset = (output_h * conv_params->OUTPUT_W + output_w) * conv_params->OUTPUT_CHANNEL + channel_offset_c;
+    } else {
+        // use NWHC so that output is written continuously on the address space
+        cur_output_data_offset =
              conv_params->OUTPUT_W * conv_params->OUTPUT_H * (conv_params->input_tile_c_index * conv_params->OUTPUT_CHANNEL) +  // n
              output_w * conv_params->OUTPUT_H * conv_params->OUTPUT_CHANNEL +                                                   // w
              output_h * conv_params->OUTPUT_CHANNEL +                                                                           // h
              channel_offset_c;                                                                                                  // c
+    }
 
 #if INDIRECT_RECOVERY
     start_cpu_counter(offsetof(Counters, embedding));
@@ -175,8 +219,15 @@ static void convTask(int16_t cur_input_h, ConvTaskParams *conv_params) {
 #endif
 
     /* copy filter data */
+    // Resident filter tiles are placed before the buffer for values before transpose in the order of filter tiles
+    uint16_t filter_slot = 0;
+    if (conv_params->n_resident_filter_tiles) {
+        filter_slot = conv_params->filter_idx / output_tile_c;
+        conv_params->cached_filter_idx = conv_params->resident_filter_idx[filter_slot];
+        conv_params->filter_buffer_addr = matrix_mpy_results - conv_params->filter_offset * (filter_slot * conv_params->max_n_filters + n_filters + TEMP_FILTER_WIDTH);
+    }
     if (conv_params->cached_filter_idx != conv_params->filter_idx || conv_params->cached_input_tile_c_offset != conv_params->input_tile_c_offset) {
-        conv_params->filter_buffer_addr = matrix_mpy_results - conv_params->filter_offset * (n_filters + TEMP_FILTER_WIDTH);
+        conv_params->filter_buffer_addr = matrix_mpy_results - conv_params->filter_offset * (filter_slot * conv_params->max_n_filters + n_filters + TEMP_FILTER_WIDTH);
         my_fill_q15(0, conv_params->filter_buffer_addr, conv_params->filter_offset * n_filters);
 
         int16_t *filter_tmp = matrix_mpy_results - conv_params->filter_offset; // before transpose
@@ -184,34 +235,62 @@ static void convTask(int16_t cur_input_h, ConvTaskParams *conv_params) {
         my_fill_q15(0, filter_tmp, fill_length);
         uint16_t buffer_size = sizeof(int16_t) * conv_params->cur_filter_tile_c;
         uint16_t filter_len = conv_params->kH * conv_params->kW * conv_params->CHANNEL;
+        const uint8_t sparse = (conv_params->conv_filter->param_flags & SPARSE);
+        // Blocks of a sparse filter tile are output_tile_c filters x input_tile_c channels, in the order of filters
+        const uint16_t input_tile_c = conv_params->flags->extra.conv.input_tile_c,
+                       sparse_block_len = output_tile_c * input_tile_c;
+        uint16_t sparse_row_offset = 0;
+        if (sparse) {
+            // A row of block-CSR for each input channel tile and filter tile
+            uint16_t n_filter_tiles = upper_gauss(conv_params->N_FILTERS, output_tile_c), first_block;
+            conv_params->n_sparse_blocks = load_sparse_row(conv_params->conv_filter, conv_params->n_tiles_c * n_filter_tiles,
+                                                           conv_params->input_tile_c_index * n_filter_tiles + conv_params->filter_idx / output_tile_c,
+                                                           &first_block, conv_params->sparse_blocks, CONV_MAX_SPARSE_BLOCKS);
+            sparse_row_offset = first_block * sparse_block_len;
+            // Zero blocks are skipped, followed by a row for biases. LEA requires an even number of rows
+            conv_params->filter_rows = padding_for_lea(conv_params->n_sparse_blocks * conv_params->cur_filter_tile_c + 1);
+            my_printf_debug("Loading %d non-zero blocks of sparse filters" NEWLINE, conv_params->n_sparse_blocks);
+        } else {
+            conv_params->filter_rows = conv_params->filter_offset;
+        }
         for (uint16_t idx = 0; idx < cur_output_tile_c; idx++) {
             uint16_t filter_src_offset = (conv_params->filter_idx + idx) * filter_len;
             my_printf_debug("Copying filter %d" NEWLINE, conv_params->filter_idx + idx);
-            for (uint16_t h = 0; h < conv_params->kH; h++) {
-                int16_t *filter_dest_ptr = filter_tmp + h * conv_params->dest_offset;
-                uint16_t cur_filter_src_offset = filter_src_offset + h * conv_params->kW * conv_params->CHANNEL + conv_params->input_tile_c_offset;
-                for (uint16_t w = 0; w < conv_params->kW; w++) {
+            if (sparse) {
+                uint16_t cur_filter_src_offset = sparse_row_offset + (conv_params->filter_idx + idx) % output_tile_c * input_tile_c;
+                int16_t *filter_dest_ptr = filter_tmp;
+                for (uint16_t block_idx = 0; block_idx < conv_params->n_sparse_blocks; block_idx++) {
                     my_memcpy_from_param(conv_params->model, filter_dest_ptr, conv_params->conv_filter, cur_filter_src_offset, buffer_size);
                     filter_dest_ptr += conv_params->cur_filter_tile_c;
-                    cur_filter_src_offset += conv_params->CHANNEL;
+                    cur_filter_src_offset += sparse_block_len;
+                }
+            } else {
+                for (uint16_t h = 0; h < conv_params->kH; h++) {
+                    int16_t *filter_dest_ptr = filter_tmp + h * conv_params->dest_offset;
+                    uint16_t cur_filter_src_offset = filter_src_offset + h * conv_params->kW * conv_params->CHANNEL + conv_params->input_tile_c_offset;
+                    for (uint16_t w = 0; w < conv_params->kW; w++) {
+                        my_memcpy_from_param(conv_params->model, filter_dest_ptr, conv_params->conv_filter, cur_filter_src_offset, buffer_size);
+                        filter_dest_ptr += conv_params->cur_filter_tile_c;
+                        cur_filter_src_offset += conv_params->CHANNEL;
+                    }
                 }
             }
 #if STATEFUL
             start_cpu_counter(offsetof(Counters, embedding));
             if (conv_params->real_conv_input->slot == SLOT_TEST_SET) {
-                my_scale_q15(filter_tmp, 0x4000, 0, filter_tmp, conv_params->filter_offset);
+                my_scale_q15(filter_tmp, 0x4000, 0, filter_tmp, conv_params->filter_rows);
             }
             bool has_state = offset_has_state(cur_output_data_offset + idx);
             if (has_state) {
                 my_printf_debug("Adding state bit for newly loaded filter idx=%d" NEWLINE, idx);
-                filter_tmp[conv_params->filter_offset - 1] = -(idx < n_keep_state_bits ? -conv_params->old_output_offset : conv_params->old_output_offset);
+                filter_tmp[conv_params->filter_rows - 1] = -(idx < n_keep_state_bits ? -conv_params->old_output_offset : conv_params->old_output_offset);
             }
             stop_cpu_counter();
             if (!has_state)
 #endif
             {
                 // XXX: why is this needed? Should already be zero with my_fill_q15 above
-                filter_tmp[conv_params->filter_offset - 1] = 0;
+                filter_tmp[conv_params->filter_rows - 1] = 0;
             }
             if (conv_params->input_tile_c_index == 0) {
                 // convert int16_t to int32_t first as on MSP430, registers are 20 bit while there are only 16 bits when int16_t is converted to uint16_t
@@ -227,7 +306,7 @@ static void convTask(int16_t cur_input_h, ConvTaskParams *conv_params) {
                 }
                 stop_cpu_counter();
 #endif
-                filter_tmp[conv_params->filter_offset - 1] += bias_val;
+                filter_tmp[conv_params->filter_rows - 1] += bias_val;
             }
 
             uint16_t channel = idx;
@@ -236,12 +315,12 @@ static void convTask(int16_t cur_input_h, ConvTaskParams *conv_params) {
             channel += channel / BATCH_SIZE;
             stop_cpu_counter();
 #endif
-            my_interleave_q15(filter_tmp, channel, n_filters, conv_params->filter_buffer_addr, conv_params->filter_offset);
+            my_interleave_q15(filter_tmp, channel, n_filters, conv_params->filter_buffer_addr, conv_params->filter_rows);
         }
 
 #if JAPARI
         start_cpu_counter(offsetof(Counters, embedding));
-        int16_t* footprint_channels_ptr = conv_params->filter_buffer_addr + n_filters * (conv_params->filter_offset - 1);
+        int16_t* footprint_channels_ptr = conv_params->filter_buffer_addr + n_filters * (conv_params->filter_rows - 1);
         for (int16_t idx = BATCH_SIZE; idx < n_filters; idx += BATCH_SIZE + 1) {
             if (idx < n_keep_state_bits) {
                 *(footprint_channels_ptr + idx) = (conv_params->old_output_offset > 0 ? 1 : -1);
@@ -255,7 +334,7 @@ static void convTask(int16_t cur_input_h, ConvTaskParams *conv_params) {
 #if STATEFUL
         start_cpu_counter(offsetof(Counters, memory_layout));
         if (conv_params->output_padding) {
-            conv_params->filter_buffer_addr[n_filters * conv_params->filter_offset - 1] = -((n_filters - 1 < n_keep_state_bits) ? -conv_params->old_output_offset : conv_params->old_output_offset);
+            conv_params->filter_buffer_addr[n_filters * conv_params->filter_rows - 1] = -((n_filters - 1 < n_keep_state_bits) ? -conv_params->old_output_offset : conv_params->old_output_offset);
         }
         stop_cpu_counter();
 #endif
@@ -265,6 +344,11 @@ static void convTask(int16_t cur_input_h, ConvTaskParams *conv_params) {
     } else {
 #if INDIRECT_RECOVERY
         start_cpu_counter(offsetof(Counters, embedding));
+        if (conv_params->n_resident_filter_tiles &&
+                (conv_params->resident_old_output_offset[filter_slot] > 0) != (conv_params->old_output_offset > 0)) {
+            // old_output_offset is flipped after this filter tile is used
+            flip_filter_state_bits(conv_params, n_filters, n_filters, 1);
+        }
         if (n_keep_state_bits != n_filters) {
             int16_t n_flip_state_bits = n_filters - n_keep_state_bits;
             flip_filter_state_bits(conv_params, n_filters, n_flip_state_bits, 1);
@@ -277,9 +361,30 @@ static void convTask(int16_t cur_input_h, ConvTaskParams *conv_params) {
 
     int16_t *input_buffer_addr = lea_buffer + (cur_input_h-conv_params->input_h) * conv_params->dest_offset;
 
+    if (conv_params->conv_filter->param_flags & SPARSE) {
+        // Gather inputs for non-zero blocks of filters, so that zero blocks are not multiplied
+        start_cpu_counter(offsetof(Counters, memory_layout));
+        const uint16_t cur_filter_tile_c = conv_params->cur_filter_tile_c;
+        int16_t *sparse_input_ptr = conv_params->sparse_input_buffer;
+        for (uint16_t block_idx = 0; block_idx < conv_params->n_sparse_blocks; block_idx++) {
+            uint16_t block = conv_params->sparse_blocks[block_idx];
+            my_memcpy(sparse_input_ptr, input_buffer_addr + block / conv_params->kW * conv_params->dest_offset + block % conv_params->kW * cur_filter_tile_c,
+                      cur_filter_tile_c * sizeof(int16_t));
+            sparse_input_ptr += cur_filter_tile_c;
+        }
+        input_buffer_addr = conv_params->sparse_input_buffer;
+        // Padding for LEA, if any, and the bias multiplier
+        int16_t *bias_multiplier = input_buffer_addr + conv_params->filter_rows - 1;
+        if (sparse_input_ptr != bias_multiplier) {
+            *sparse_input_ptr = 0;
+        }
+        *bias_multiplier = -0x8000; // _Q15(-1.0)
+        stop_cpu_counter();
+    }
+
     uint16_t A_rows, A_cols, B_rows, B_cols;
     A_rows = 1;
-    A_cols = B_rows = conv_params->filter_offset;
+    A_cols = B_rows = conv_params->filter_rows;
     B_cols = n_filters;
     MY_ASSERT(A_rows * B_cols <= OUTPUT_LEN);
     MY_ASSERT(input_buffer_addr + A_rows * A_cols <= filter_buffer_addr);
@@ -318,7 +423,7 @@ static void convTask(int16_t cur_input_h, ConvTaskParams *conv_params) {
 
     my_printf_debug("output_data offset = %d" NEWLINE, cur_output_data_offset);
 
-    MY_ASSERT(cur_output_data_offset + n_filters < INTERMEDIATE_VALUES_SIZE * NUM_SLOTS);
+    MY_ASSERT(cur_output_data_offset + n_filters < INTERMEDIATE_VALUES_SIZE);
 
 #if HAWAII
     hawaii_record_footprints(conv_params->model, values_to_preserve);
@@ -328,8 +433,13 @@ static void convTask(int16_t cur_input_h, ConvTaskParams *conv_params) {
     start_cpu_counter(offsetof(Counters, embedding));
     if (n_keep_state_bits != n_filters) {
         start_cpu_counter(offsetof(Counters, state_query));
+        // The next task is for the next output row with filter-stationary, or for the next filter tile with input-stationary
+        uint16_t next_output_data_offset = cur_output_data_offset + conv_params->OUTPUT_CHANNEL;
+        if (conv_params->flags->extra.conv.dataflow == CONV_DATAFLOW_INPUT_STATIONARY) {
+            next_output_data_offset = cur_output_data_offset + values_to_preserve;
+        }
         check_next_turning_point(conv_params->old_output_offset, conv_params->turning_point_idx,
-                                 conv_params->next_turning_point, conv_params->cur_slot_info, cur_output_data_offset + conv_params->OUTPUT_CHANNEL);
+                                 conv_params->next_turning_point, conv_params->cur_slot_info, next_output_data_offset);
         stop_cpu_counter();
         my_printf_debug("old_output_offset flipped to %d" NEWLINE, conv_params->old_output_offset);
 
@@ -337,6 +447,12 @@ static void convTask(int16_t cur_input_h, ConvTaskParams *conv_params) {
     }
     stop_cpu_counter();
 #endif
+    if (conv_params->n_resident_filter_tiles) {
+        conv_params->resident_filter_idx[filter_slot] = conv_params->cached_filter_idx;
+#if INDIRECT_RECOVERY
+        conv_params->resident_old_output_offset[filter_slot] = conv_params->old_output_offset;
+#endif
+    }
 }
 
 static inline uint16_t load_input_vector(uint32_t src_addr, int16_t* dest_addr, uint16_t len, const ConvTaskParams* conv_params) {
@@ -413,28 +529,52 @@ static void handle_conv_inner_loop(Model *model, ConvTaskParams *conv_params) {
      */
     int32_t w_start = int16_max(0, conv_params->input_w),
             w_end   = int16_min(conv_params->input_w+conv_params->kW-1, conv_params->W-1);
+    // With NHWC outputs, columns shared with the window of the previous output column are kept in VM
+    int16_t kept_w = 0;
+    if (conv_params->nhwc_outputs && conv_params->window_input_h == conv_params->input_h &&
+        conv_params->window_input_w + conv_params->stride == conv_params->input_w &&
+        conv_params->real_conv_input->scale == conv_params->conv_input->scale) {
+        kept_w = int16_max(0, conv_params->kW - conv_params->stride);
+    }
+    w_start = int16_max(w_start, conv_params->input_w + kept_w);
     int16_t *dest;
-    int16_t max_n_filters = conv_params->flags->extra.conv.output_tile_c;
-#if JAPARI
-    start_cpu_counter(offsetof(Counters, memory_layout));
-    max_n_filters *= 2;
-    stop_cpu_counter();
-#endif
+    uint16_t n_filter_buffers = int16_max(conv_params->n_resident_filter_tiles, 1);
+    // Inputs gathered for sparse filters are up to filter_offset values
+    uint16_t sparse_inputs_len = (conv_params->conv_filter->param_flags & SPARSE) ? conv_params->filter_offset : 0;
     // TEMP_FILTER_WIDTH additional filters for values before transpose
     uint16_t inputs_len = MIN_VAL(
-        LEA_BUFFER_SIZE - OUTPUT_LEN - (max_n_filters + TEMP_FILTER_WIDTH) * conv_params->filter_offset,
+        LEA_BUFFER_SIZE - OUTPUT_LEN - (n_filter_buffers * conv_params->max_n_filters + TEMP_FILTER_WIDTH) * conv_params->filter_offset - sparse_inputs_len,
         (conv_params->tile_h + 2 * field_size) * conv_params->dest_offset
     );
     MY_ASSERT(inputs_len < LEA_BUFFER_SIZE); // make sure no overflow occurs in the previous line
+    conv_params->sparse_input_buffer = lea_buffer + inputs_len;
 
     dest = lea_buffer;
 
     int32_t h_start = int16_max(conv_params->input_h,                                                           0             ),
             h_end =   int16_min(conv_params->input_h+conv_params->tile_h+(conv_params->kH-conv_params->stride), conv_params->H)-1;
 
-    my_printf_debug("Reinitialize input buffer" NEWLINE "inputs_len = %d" NEWLINE, inputs_len);
+    uint8_t im2col_channel_offset = conv_params->cur_input_tile_c;
+    if (kept_w) {
+        my_printf_debug("Slide input buffer by %d columns" NEWLINE, conv_params->stride);
+        uint16_t kept_len = kept_w * im2col_channel_offset,
+                 shift_len = conv_params->stride * im2col_channel_offset,
+                 window_row_len = conv_params->kW * im2col_channel_offset;
+        for (uint16_t row_offset = 0; row_offset + window_row_len <= inputs_len; row_offset += conv_params->dest_offset) {
+            int16_t *row = lea_buffer + row_offset;
+            // a plain loop as ranges overlap
+            for (uint16_t idx = 0; idx < kept_len; idx++) {
+                row[idx] = row[idx + shift_len];
+            }
+            my_fill_q15(0, row + kept_len, window_row_len - kept_len);
+        }
+    } else {
+        my_printf_debug("Reinitialize input buffer" NEWLINE "inputs_len = %d" NEWLINE, inputs_len);
 
-    my_fill_q15(0, lea_buffer, inputs_len);
+        my_fill_q15(0, lea_buffer, inputs_len);
+    }
+    conv_params->window_input_h = conv_params->input_h;
+    conv_params->window_input_w = conv_params->input_w;
 
     dest += (h_start-conv_params->input_h) * conv_params->dest_offset;
 
@@ -442,7 +582,6 @@ static void handle_conv_inner_loop(Model *model, ConvTaskParams *conv_params) {
     my_printf_debug("h_end=%" PRId32 NEWLINE, h_end);
 
     uint16_t cur_input_tile_c = conv_params->cur_input_tile_c;
-    uint8_t im2col_channel_offset = cur_input_tile_c;
     my_printf_debug("Copying row to lea_buffer + %d" NEWLINE,
                     static_cast<int>(dest - lea_buffer));
     uint16_t cur_input_channel = conv_params->CHANNEL;
@@ -469,7 +608,8 @@ static void handle_conv_inner_loop(Model *model, ConvTaskParams *conv_params) {
 #if INDIRECT_RECOVERY
     dump_turning_points_debug(model, conv_params->real_conv_input);
 #endif
-    for (int32_t h = h_start; h <= h_end; h++) {
+    // no new columns are needed if the slid window is beyond the right edge of inputs
+    for (int32_t h = h_start; h <= h_end && w_start <= w_end; h++) {
         int16_t *dest_addr = dest + (w_start-conv_params->input_w) * im2col_channel_offset;
 #if STATEFUL
         int16_t *orig_dest_addr = dest_addr;
@@ -490,20 +630,16 @@ static void handle_conv_inner_loop(Model *model, ConvTaskParams *conv_params) {
         start_cpu_counter(offsetof(Counters, stripping));
         if (conv_params->real_conv_input->slot != SLOT_TEST_SET) {
             // stripping states inside the h loop is faster as biases multipliers can be skipped
-            int16_t *input_row_end = orig_dest_addr + input_row_len;
             // if input_tile_c is smaller than BATCH_SIZE, state bits are not always at offset BATCH_SIZE - 1
             my_printf_debug("Using a loop for stripping state bits" NEWLINE);
             MY_ASSERT(cur_input_tile_c % BATCH_SIZE == 0 || BATCH_SIZE % cur_input_tile_c == 0);
             if (cur_input_tile_c % BATCH_SIZE == 0) {
-                for (int16_t *dest_ptr = orig_dest_addr + BATCH_SIZE - 1; dest_ptr < input_row_end; dest_ptr += BATCH_SIZE) {
-                    strip_state(dest_ptr);
-                }
+                my_strip_states_q15(orig_dest_addr, input_row_len, 0, BATCH_SIZE, false);
             } else {
                 int16_t offset = BATCH_SIZE - 1 - src_addr % BATCH_SIZE;
                 if (offset < cur_input_tile_c) {
-                    for (; offset < input_row_len; offset += cur_input_tile_c) {
-                        strip_state(orig_dest_addr + offset);
-                    }
+                    // the first value with states is at offset
+                    my_strip_states_q15(orig_dest_addr, input_row_len, cur_input_tile_c - 1 - offset, cur_input_tile_c, false);
                 }
             }
         }
@@ -528,23 +664,59 @@ static void handle_conv_inner_loop(Model *model, ConvTaskParams *conv_params) {
     // state = 0 as state bits are already removed by my_offset_q15 above
     dump_matrix_debug(lea_buffer, inputs_len, ValueInfo(conv_params->real_conv_input, nullptr), false);
 
+    uint16_t output_tile_c = conv_params->flags->extra.conv.output_tile_c;
     int16_t max_input_h = MIN_VAL(conv_params->input_h+conv_params->tile_h-1, conv_params->input_h_last);
     for (int16_t cur_input_h = conv_params->input_h; cur_input_h <= max_input_h; cur_input_h += conv_params->stride) {
         // filter_idx is set to initial_c in handle_conv
         convTask(cur_input_h, conv_params);
+        if (conv_params->flags->extra.conv.dataflow == CONV_DATAFLOW_INPUT_STATIONARY) {
+            // stream remaining filter tiles past the loaded input window
+            while (++conv_params->filter_tile_index * output_tile_c < conv_params->N_FILTERS) {
+                conv_params->filter_idx = conv_params->filter_tile_index * output_tile_c;
+                convTask(cur_input_h, conv_params);
+            }
+            conv_params->filter_tile_index = 0;
+        }
         // reset here for further processing
-        conv_params->filter_idx = conv_params->filter_tile_index * conv_params->flags->extra.conv.output_tile_c;
+        conv_params->filter_idx = conv_params->filter_tile_index * output_tile_c;
     }
 }
 
+#if PARALLEL_LAYERS
+// A task for all jobs with the same input channel tile, filter tile (all filter tiles with input-stationary) and input_w
+static void conv_column_task(ConvTaskParams *conv_params) {
+    // Start from the same states as recovering from a power failure at the first job
+    conv_params->model = get_model();
+    conv_params->cached_filter_idx = -1;
+    invalidate_resident_filter_tiles(conv_params);
+#if INDIRECT_RECOVERY
+    uint16_t output_w = (conv_params->input_w - conv_params->input_w_first) / conv_params->stride;
+    uint32_t first_output_offset = conv_params->input_tile_c_index * conv_params->OUTPUT_CHANNEL * conv_params->OUTPUT_H * conv_params->OUTPUT_W +
+                                   output_w * conv_params->OUTPUT_H * conv_params->OUTPUT_CHANNEL;
+#if JAPARI
+    first_output_offset += extend_for_footprints(conv_params->filter_idx);
+#else
+    first_output_offset += conv_params->filter_idx;
+#endif
+    find_initial_state_bit(&conv_params->old_output_offset, &conv_params->turning_point_idx, &conv_params->next_turning_point, &conv_params->cur_slot_info,
+                           first_output_offset, conv_params->model, conv_params->output);
+#endif
+    for (; conv_params->input_h <= conv_params->input_h_last; conv_params->input_h += conv_params->tile_h) {
+        handle_conv_inner_loop(conv_params->model, conv_params);
+    }
+}
+#endif
+
+static void handle_group_conv(Model *model, ConvTaskParams *conv_params, const Node* node);
+
 void alloc_conv(Model *model, const ParameterInfo *input[], ParameterInfo *output, const Node* node) {
     const ParameterInfo *conv_input = input[0], *conv_filter = input[1];
 
-    MY_ASSERT(conv_input->bitwidth == 16 && conv_filter->bitwidth == 16);
+    MY_ASSERT((conv_input->bitwidth == 16 || conv_input->bitwidth == 8) && (conv_filter->bitwidth == 16 || conv_filter->bitwidth == 8));
 
 #if !JAPARI
     // skip the check for JAPARI as it is too complex
-    MY_ASSERT(conv_input->dims[1] == conv_filter->dims[1]);
+    MY_ASSERT(conv_input->dims[1] == conv_filter->dims[1] * node->flags.extra.conv.group);
 #endif
 
     /* input: N x C x H x W, filter: M x C x kH x kW */
@@ -585,10 +757,15 @@ void alloc_conv(Model *model, const ParameterInfo *input[], ParameterInfo *outpu
     {
         conv_params->n_tiles_c = CHANNEL / conv_params->flags->extra.conv.input_tile_c;
     }
+    // Grouped convolution does not split input channels, and writes all output channels at an output position at once
+    const bool in_order_outputs = (conv_params->flags->extra.conv.group != 1);
+    MY_ASSERT(!in_order_outputs || conv_params->n_tiles_c == 1);
+    (void)in_order_outputs; // silent a compiler warning without assertions and Stateful
 #if STATEFUL
     start_cpu_counter(offsetof(Counters, memory_layout));
-    if (conv_params->flags->extra.conv.output_tile_c % BATCH_SIZE) {
-        conv_params->output_padding = BATCH_SIZE - conv_params->flags->extra.conv.output_tile_c % BATCH_SIZE;
+    uint16_t padded_tile_c = in_order_outputs ? OUTPUT_CHANNEL : conv_params->flags->extra.conv.output_tile_c;
+    if (padded_tile_c % BATCH_SIZE) {
+        conv_params->output_padding = BATCH_SIZE - padded_tile_c % BATCH_SIZE;
     } else {
         conv_params->output_padding = 0;
     }
@@ -599,7 +776,6 @@ void alloc_conv(Model *model, const ParameterInfo *input[], ParameterInfo *outpu
 
     /* XXX: extend flags; assume dilation=(1, 1) for now */
     output->bitwidth = 16;
-    output->slot = get_next_slot(model, conv_input);
     output->params_len = conv_params->n_tiles_c * conv_params->OUTPUT_H * conv_params->OUTPUT_W * OUTPUT_CHANNEL * sizeof(int16_t);
     output->dims[0] = 1;
     output->dims[1] = OUTPUT_CHANNEL;
@@ -626,7 +802,7 @@ void handle_conv(Model *model, const ParameterInfo *input[], ParameterInfo *outp
 
     ConvTaskParams *conv_params = &conv_params_obj;
 
-    conv_params->tile_h = MIN_VAL(H, DEFAULT_TILE_H * conv_params->stride);
+    conv_params->tile_h = MIN_VAL(H, conv_params->flags->extra.conv.tile_h * conv_params->stride);
 
     my_printf_debug("n_tiles_c = %d" NEWLINE, conv_params->n_tiles_c);
 
@@ -636,6 +812,13 @@ void handle_conv(Model *model, const ParameterInfo *input[], ParameterInfo *outp
     conv_params->output = output;
     conv_params->filter_buffer_addr = NULL;
     conv_params->cached_filter_idx = -1;
+    conv_params->max_n_filters = conv_params->flags->extra.conv.output_tile_c;
+#if JAPARI
+    start_cpu_counter(offsetof(Counters, memory_layout));
+    conv_params->max_n_filters *= 2;
+    stop_cpu_counter();
+#endif
+    conv_params->n_resident_filter_tiles = 0;
     conv_params->H = H;
     conv_params->W = W;
 #if JAPARI
@@ -647,6 +830,25 @@ void handle_conv(Model *model, const ParameterInfo *input[], ParameterInfo *outp
     conv_params->CHANNEL = CHANNEL;
     conv_params->OUTPUT_CHANNEL = output->dims[1];
     conv_params->N_FILTERS = conv_filter->dims[0];
+    /* Output positions are visited in NWHC order, so that input windows of tile_h output rows are reused. With a single
+     * input channel tile, outputs are final, and transform.py may remove ConvMerge and set NHWC_OUTPUTS, so that
+     * output positions are visited in NHWC order with an output row at a time */
+    conv_params->nhwc_outputs = (node->flags.generic & NHWC_OUTPUTS) ? 1 : 0;
+    MY_ASSERT(!conv_params->nhwc_outputs || conv_params->n_tiles_c == 1);
+    // VM contents are lost after power failures, so windows are not slid from ones loaded before
+    conv_params->window_input_h = INT16_MIN;
+
+    if (conv_params->flags->extra.conv.group != 1) {
+        handle_group_conv(model, conv_params, node);
+        return;
+    }
+
+    MY_ASSERT(!conv_params->nhwc_outputs || conv_params->flags->extra.conv.tile_h == 1);
+    if (conv_params->flags->extra.conv.dataflow == CONV_DATAFLOW_INPUT_STATIONARY) {
+        // Output offsets are monotonic only if filter tiles are contiguous in each output row
+        MY_ASSERT(conv_params->N_FILTERS % conv_params->flags->extra.conv.output_tile_c == 0 &&
+                  conv_params->flags->extra.conv.output_tile_c % BATCH_SIZE == 0);
+    }
 
     conv_params->input_tile_c_offset = 0;
     conv_params->input_tile_c_index = 0;
@@ -702,10 +904,15 @@ void handle_conv(Model *model, const ParameterInfo *input[], ParameterInfo *outp
     conv_params->filter_idx += filter_offset_in_tile;
     first_unfinished_value_offset /= conv_params->OUTPUT_CHANNEL;
 
-    conv_params->input_w += first_unfinished_value_offset / conv_params->OUTPUT_H * conv_params->stride;
-    first_unfinished_value_offset %= conv_params->OUTPUT_H;
+    if (conv_params->nhwc_outputs) {
+        conv_params->input_h += first_unfinished_value_offset / conv_params->OUTPUT_W * conv_params->stride;
+        conv_params->input_w += first_unfinished_value_offset % conv_params->OUTPUT_W * conv_params->stride;
+    } else {
+        conv_params->input_w += first_unfinished_value_offset / conv_params->OUTPUT_H * conv_params->stride;
+        first_unfinished_value_offset %= conv_params->OUTPUT_H;
 
-    conv_params->input_h += first_unfinished_value_offset * conv_params->stride;
+        conv_params->input_h += first_unfinished_value_offset * conv_params->stride;
+    }
 
     my_printf_debug("initial output N = %d" NEWLINE, conv_params->input_tile_c_index);
     my_printf_debug("initial output H = %d" NEWLINE, (conv_params->input_h - conv_params->input_h_first) / conv_params->stride);
@@ -723,6 +930,12 @@ void handle_conv(Model *model, const ParameterInfo *input[], ParameterInfo *outp
         input_channels = input_channels / (BATCH_SIZE + 1) * BATCH_SIZE;
     }
     stop_cpu_counter();
+#endif
+#if PARALLEL_LAYERS
+    TaskGroup task_group;
+    if (parallel_layers_enabled()) {
+        init_task_group(&task_group);
+    }
 #endif
     for (; conv_params->input_tile_c_offset < input_channels; conv_params->input_tile_c_offset += conv_params->flags->extra.conv.input_tile_c) {
         conv_params->cur_input_tile_c = MIN_VAL(conv_params->flags->extra.conv.input_tile_c, input_channels - conv_params->input_tile_c_offset);
@@ -747,15 +960,57 @@ void handle_conv(Model *model, const ParameterInfo *input[], ParameterInfo *outp
         }
         conv_params->filter_offset = conv_params->kH * conv_params->dest_offset;
 
+        /* Input-stationary loads all filter tiles at each output position. Keep them in VM instead if they fit with the
+         * input window, so that each filter is loaded once for an input channel tile. Zero blocks of sparse filters differ
+         * among filter tiles, and thus sparse filters are not kept */
+        conv_params->n_resident_filter_tiles = 0;
+        invalidate_resident_filter_tiles(conv_params);
+        uint16_t n_filter_tiles = conv_params->N_FILTERS / conv_params->flags->extra.conv.output_tile_c;
+        if (conv_params->flags->extra.conv.dataflow == CONV_DATAFLOW_INPUT_STATIONARY && !(conv_filter->param_flags & SPARSE) &&
+                n_filter_tiles <= CONV_MAX_RESIDENT_FILTER_TILES) {
+            uint32_t needed_len = (conv_params->tile_h + 2 * ((conv_params->kH - 1) / 2)) * conv_params->dest_offset +
+                                  (n_filter_tiles * conv_params->max_n_filters + TEMP_FILTER_WIDTH) * static_cast<uint32_t>(conv_params->filter_offset) + OUTPUT_LEN;
+            if (needed_len <= LEA_BUFFER_SIZE) {
+                conv_params->n_resident_filter_tiles = n_filter_tiles;
+            }
+        }
+        my_printf_debug("n_resident_filter_tiles = %d" NEWLINE, conv_params->n_resident_filter_tiles);
+
         while (true) {
-            for (; conv_params->input_w <= conv_params->input_w_last; conv_params->input_w += conv_params->stride) {
+            if (conv_params->nhwc_outputs) {
                 for (; conv_params->input_h <= conv_params->input_h_last; conv_params->input_h += conv_params->tile_h) {
-                    handle_conv_inner_loop(model, conv_params);
+                    for (; conv_params->input_w <= conv_params->input_w_last; conv_params->input_w += conv_params->stride) {
+                        handle_conv_inner_loop(model, conv_params);
+                    }
+                    conv_params->input_w = conv_params->input_w_first;
+                    report_progress();
                 }
                 conv_params->input_h = conv_params->input_h_first;
-                report_progress();
+            } else {
+                for (; conv_params->input_w <= conv_params->input_w_last; conv_params->input_w += conv_params->stride) {
+#if PARALLEL_LAYERS
+                    // Columns partially finished before a power failure are handled serially
+                    if (parallel_layers_enabled() && conv_params->input_h == conv_params->input_h_first &&
+                        conv_params->filter_idx == conv_params->filter_tile_index * conv_params->flags->extra.conv.output_tile_c) {
+                        submit_task(&task_group, [column_params = *conv_params] () mutable {
+                            conv_column_task(&column_params);
+                        });
+                    } else
+#endif
+                    {
+                        for (; conv_params->input_h <= conv_params->input_h_last; conv_params->input_h += conv_params->tile_h) {
+                            handle_conv_inner_loop(model, conv_params);
+                        }
+                    }
+                    conv_params->input_h = conv_params->input_h_first;
+                    report_progress();
+                }
+                conv_params->input_w = conv_params->input_w_first;
+            }
+            if (conv_params->flags->extra.conv.dataflow == CONV_DATAFLOW_INPUT_STATIONARY) {
+                // all filter tiles are already handled in handle_conv_inner_loop
+                break;
             }
-            conv_params->input_w = conv_params->input_w_first;
             conv_params->filter_tile_index++;
             if (conv_params->filter_tile_index * conv_params->flags->extra.conv.output_tile_c >= conv_params->N_FILTERS) {
                 break;
@@ -787,6 +1042,12 @@ void handle_conv(Model *model, const ParameterInfo *input[], ParameterInfo *outp
 #endif
     }
 
+#if PARALLEL_LAYERS
+    if (parallel_layers_enabled()) {
+        wait_task_group(&task_group);
+    }
+#endif
+
 #if INDIRECT_RECOVERY
     start_cpu_counter(offsetof(Counters, table_updates));
     flip_state_bit(model, output);
@@ -797,15 +1058,29 @@ void handle_conv(Model *model, const ParameterInfo *input[], ParameterInfo *outp
     dump_params_nhwc_debug(model, output, node->output_name);
 }
 
-void alloc_convmerge(Model *model, const ParameterInfo *input[], ParameterInfo *output, const Node*) {
+void alloc_convmerge(Model *model, const ParameterInfo *input[], ParameterInfo *output, const Node* node) {
     const ParameterInfo *data = input[0];
 
     uint16_t OUTPUT_CHANNEL = data->dims[1],
              OUTPUT_H = data->dims[2],
              OUTPUT_W = data->dims[3];
 
-    output->slot = get_next_slot(model, data);
+    if (node->flags.generic & FUSED_MAXPOOL) {
+        // The same output shape as alloc_maxpool
+        const MaxPoolFlags *maxpool_flags = &node->flags.extra.maxpool;
+        if (!(node->flags.generic & MAXPOOL_CEIL)) {
+            OUTPUT_H /= maxpool_flags->strides[0];
+            OUTPUT_W /= maxpool_flags->strides[1];
+        } else {
+            OUTPUT_H = (OUTPUT_H + maxpool_flags->strides[0] - 1) / maxpool_flags->strides[0];
+            OUTPUT_W = (OUTPUT_W + maxpool_flags->strides[1] - 1) / maxpool_flags->strides[1];
+        }
+        output->dims[2] = OUTPUT_H;
+        output->dims[3] = OUTPUT_W;
+    }
+
     output->params_len = OUTPUT_CHANNEL * OUTPUT_H * OUTPUT_W * sizeof(int16_t);
+    output->bitwidth = 16;
 }
 
 #if STATEFUL
@@ -848,35 +1123,46 @@ void handle_convmerge(Model *model, const ParameterInfo *input[], ParameterInfo
 
     my_printf_debug("ConvMerge!" NEWLINE);
 
-    uint8_t n_tiles_c = data->params_len / sizeof(int16_t) / (OUTPUT_CHANNEL * OUTPUT_H * OUTPUT_W);
+    uint8_t n_tiles_c = get_values_len(data) / (OUTPUT_CHANNEL * OUTPUT_H * OUTPUT_W);
 
     MY_ASSERT(n_tiles_c);
 
     uint32_t tiling_results_len = OUTPUT_CHANNEL * OUTPUT_H * OUTPUT_W;
 
+    // With a fused MaxPool, each output chunk is the maximum of merged chunks in a pooling
+    // window, and merged chunks are put after the output chunk in lea_buffer.
+    uint8_t fused_maxpool = (node->flags.generic & FUSED_MAXPOOL) ? 1 : 0,
+            fused_relu = (node->flags.generic & FUSED_RELU) ? 1 : 0;
+    uint8_t kernel_h = 1, kernel_w = 1, stride_h = 1, stride_w = 1;
+    if (fused_maxpool) {
+        const MaxPoolFlags *maxpool_flags = &node->flags.extra.maxpool;
+        kernel_h = maxpool_flags->kernel_shape[0];
+        kernel_w = maxpool_flags->kernel_shape[1];
+        stride_h = maxpool_flags->strides[0];
+        stride_w = maxpool_flags->strides[1];
+    }
+    const uint16_t NEW_H = output->dims[2], NEW_W = output->dims[3];
+
     uint16_t chunk_len = OUTPUT_CHANNEL;
+    int16_t *merged = lea_buffer + fused_maxpool * chunk_len;
+    MY_ASSERT(chunk_len * (n_tiles_c + fused_maxpool) < LEA_BUFFER_SIZE);
+
     uint16_t output_h = 0, output_w = 0, chunk_offset = 0;
 #if INTERMITTENT
     start_cpu_counter(offsetof(Counters, progress_seeking));
     uint32_t first_unfinished_job_idx = run_recovery(model, output);
     uint32_t first_unfinished_value_offset = batch_start(job_index_to_offset(output, first_unfinished_job_idx));
 
-    MY_ASSERT(chunk_len * n_tiles_c < LEA_BUFFER_SIZE);
-
-    // value offset = output_h * OUTPUT_W * chunk_len + output_w * chunk_len + chunk_offset;
+    // value offset = output_h * NEW_W * chunk_len + output_w * chunk_len + chunk_offset;
     chunk_offset = first_unfinished_value_offset % chunk_len;
     first_unfinished_value_offset /= chunk_len;
-    output_w = first_unfinished_value_offset % OUTPUT_W;
-    first_unfinished_value_offset /= OUTPUT_W;
+    output_w = first_unfinished_value_offset % NEW_W;
+    first_unfinished_value_offset /= NEW_W;
     output_h = first_unfinished_value_offset;
     stop_cpu_counter();
 #endif
 
-    // Here IFM and OFM have different data layouts as I do the conversion in this handler
-    uint32_t input_offset = output_w * OUTPUT_H * OUTPUT_CHANNEL +
-                            output_h * OUTPUT_CHANNEL +
-                            chunk_offset; // NWHC
-    uint32_t output_offset = output_h * OUTPUT_W * OUTPUT_CHANNEL +
+    uint32_t output_offset = output_h * NEW_W * OUTPUT_CHANNEL +
                              output_w * OUTPUT_CHANNEL +
                              chunk_offset; // NHWC
 
@@ -894,28 +1180,55 @@ void handle_convmerge(Model *model, const ParameterInfo *input[], ParameterInfo
     stop_cpu_counter();
 #endif
 
-    for (; output_h < OUTPUT_H;) {
-        for (; output_w < OUTPUT_W; output_w++) {
+    for (; output_h < NEW_H; output_h++) {
+        for (; output_w < NEW_W; output_w++) {
             uint16_t real_chunk_len = chunk_len - chunk_offset;
             my_printf_debug("real_chunk_len = %d" NEWLINE, real_chunk_len);
-            for (uint16_t input_tile_c_index = 0; input_tile_c_index < n_tiles_c; input_tile_c_index++) {
-                int16_t *to_add = lea_buffer + input_tile_c_index * chunk_len;
-                uint16_t cur_input_offset = input_tile_c_index * tiling_results_len + input_offset;
-                my_memcpy_from_param(model, to_add, data, cur_input_offset, real_chunk_len * sizeof(int16_t));
+            if (fused_maxpool) {
+                // ReLU is the same as max pooling with an additional zero in each window
+                my_fill_q15(fused_relu ? 0 : INT16_MIN, lea_buffer, real_chunk_len);
+            }
+            for (uint8_t sH = 0; sH < kernel_h; sH++) {
+                for (uint8_t sW = 0; sW < kernel_w; sW++) {
+                    uint16_t input_h = output_h * stride_h + sH,
+                             input_w = output_w * stride_w + sW;
+                    if (input_h >= OUTPUT_H || input_w >= OUTPUT_W) {
+                        continue;
+                    }
+                    // Here IFM and OFM have different data layouts as I do the conversion in this handler
+                    uint32_t input_offset = input_w * OUTPUT_H * OUTPUT_CHANNEL +
+                                            input_h * OUTPUT_CHANNEL +
+                                            chunk_offset; // NWHC
+                    for (uint16_t input_tile_c_index = 0; input_tile_c_index < n_tiles_c; input_tile_c_index++) {
+                        int16_t *to_add = merged + input_tile_c_index * chunk_len;
+                        uint16_t cur_input_offset = input_tile_c_index * tiling_results_len + input_offset;
+                        my_memcpy_from_param(model, to_add, data, cur_input_offset, real_chunk_len * sizeof(int16_t));
 #if JAPARI && ENABLE_COUNTERS
-                counters()->data_loading += (real_chunk_len/2)*(4*8);
+                        add_counter(offsetof(Counters, data_loading), (real_chunk_len/2)*(4*8));
 #endif
 #if STATEFUL
-                start_cpu_counter(offsetof(Counters, stripping));
-                ConvMergeInputChunkHandlerParams params({to_add, cur_input_offset});
-                iterate_chunks(model, data, cur_input_offset, real_chunk_len, ConvMergeInputChunkHandler, &params);
-                stop_cpu_counter();
+                        start_cpu_counter(offsetof(Counters, stripping));
+                        ConvMergeInputChunkHandlerParams params({to_add, cur_input_offset});
+                        iterate_chunks(model, data, cur_input_offset, real_chunk_len, ConvMergeInputChunkHandler, &params);
+                        stop_cpu_counter();
 #endif
-                my_printf_debug(NEWLINE "Input offset %d, input tile %d, output offset %d" NEWLINE, cur_input_offset, input_tile_c_index, output_offset);
-                my_printf_debug("Added chunk" NEWLINE);
-                dump_matrix_debug(to_add, real_chunk_len, ValueInfo(data));
-                if (input_tile_c_index != 0) {
-                    my_add_q15(lea_buffer, to_add, lea_buffer, real_chunk_len);
+                        my_printf_debug(NEWLINE "Input offset %d, input tile %d, output offset %d" NEWLINE, cur_input_offset, input_tile_c_index, output_offset);
+                        my_printf_debug("Added chunk" NEWLINE);
+                        dump_matrix_debug(to_add, real_chunk_len, ValueInfo(data));
+                        if (input_tile_c_index != 0) {
+                            my_add_q15(merged, to_add, merged, real_chunk_len);
+                        }
+                    }
+                    if (fused_maxpool) {
+                        for (uint16_t idx = 0; idx < real_chunk_len; idx++) {
+                            lea_buffer[idx] = MAX_VAL(lea_buffer[idx], merged[idx]);
+                        }
+                    }
+                }
+            }
+            if (fused_relu && !fused_maxpool) {
+                for (uint16_t idx = 0; idx < real_chunk_len; idx++) {
+                    lea_buffer[idx] = MAX_VAL(lea_buffer[idx], 0);
                 }
             }
 #if INDIRECT_RECOVERY
@@ -945,12 +1258,9 @@ void handle_convmerge(Model *model, const ParameterInfo *input[], ParameterInfo
             hawaii_record_footprints(model, real_chunk_len);
 #endif
             output_offset += real_chunk_len;
-            input_offset += OUTPUT_H * OUTPUT_CHANNEL - chunk_offset; // NWHC
             chunk_offset = 0;
         }
         output_w = 0;
-        output_h++;
-        input_offset = output_h * OUTPUT_CHANNEL; // NWHC, where only output_h is nonzero at this point
 
         report_progress();
     }
@@ -965,3 +1275,390 @@ void handle_convmerge(Model *model, const ParameterInfo *input[], ParameterInfo
 
     dump_params_nhwc_debug(model, output, node->output_name);
 }
+
+// Output values written in the order of offsets, with states of indirect recovery at the next offset
+struct InOrderOutputs {
+    uint32_t offset;
+    // Output values written at once by write_in_order_outputs
+    uint16_t max_len;
+#if INDIRECT_RECOVERY
+    int16_t old_embedding_offset;
+    uint8_t turning_point_idx;
+    uint16_t next_turning_point;
+    SlotInfo *cur_slot_info;
+#endif
+};
+
+// Values at the end of lea_buffer used by write_in_order_outputs for up to max_len output values
+static uint16_t in_order_outputs_reserved_len(uint16_t max_len) {
+#if JAPARI
+    // Footprints are filled there before being interleaved with output values (see ConvMergeOutputChunkHandler)
+    return padding_for_lea((max_len + BATCH_SIZE) / (BATCH_SIZE + 1));
+#else
+    return 0;
+#endif
+}
+
+// Start writing output values from offset. Buffers of the caller in lea_buffer should end before buffers_end
+static void init_in_order_outputs(Model *model, const ParameterInfo *output, uint32_t offset, uint16_t max_len,
+                                  const int16_t *buffers_end, InOrderOutputs *outputs) {
+    const int16_t *reserved_begin = lea_buffer + LEA_BUFFER_SIZE - in_order_outputs_reserved_len(max_len);
+    MY_ASSERT(buffers_end <= reserved_begin);
+    (void)buffers_end, (void)reserved_begin; // silent a compiler warning without assertions
+    outputs->offset = offset;
+    outputs->max_len = max_len;
+#if INDIRECT_RECOVERY
+    start_cpu_counter(offsetof(Counters, state_query));
+    find_initial_state_bit(&outputs->old_embedding_offset, &outputs->turning_point_idx, &outputs->next_turning_point,
+                           &outputs->cur_slot_info, offset, model, output);
+
+    my_printf_debug("old_embedding_offset = %d" NEWLINE, outputs->old_embedding_offset);
+    stop_cpu_counter();
+#endif
+}
+
+// Embed states or footprints into len values at output_chunk in lea_buffer, and write them at the next offset
+static void write_in_order_outputs(Model *model, ParameterInfo *output, int16_t *output_chunk, uint16_t len, InOrderOutputs *outputs) {
+    MY_ASSERT(len <= outputs->max_len);
+#if INDIRECT_RECOVERY
+
+#if STATEFUL
+    start_cpu_counter(offsetof(Counters, embedding));
+    update_states(output_chunk, len, outputs->offset, outputs->old_embedding_offset, outputs->next_turning_point, true);
+    stop_cpu_counter();
+
+    start_cpu_counter(offsetof(Counters, state_query));
+    check_next_turning_point(outputs->old_embedding_offset, outputs->turning_point_idx,
+                             outputs->next_turning_point, outputs->cur_slot_info, outputs->offset + len);
+    stop_cpu_counter();
+#elif JAPARI
+    start_cpu_counter(offsetof(Counters, embedding));
+    ConvMergeOutputChunkHandlerParams params({static_cast<uint32_t>(outputs->offset - (output_chunk - lea_buffer))});
+    iterate_chunks(model, output, outputs->offset, len, ConvMergeOutputChunkHandler, &params);
+    stop_cpu_counter();
+#endif
+
+#endif
+    dump_matrix_debug(output_chunk, len, ValueInfo(output));
+
+    my_memcpy_to_param(output, outputs->offset, output_chunk, len * sizeof(int16_t), 0);
+#if HAWAII
+    hawaii_record_footprints(model, len);
+#endif
+    outputs->offset += len;
+}
+
+/* Load input channels [c_begin, c_begin + len) of n_pixels consecutive pixels in a row from pixel_idx (h * W + w),
+ * with states or footprints removed. Values of a pixel are put at dest with a stride of dest_stride. Like
+ * handle_conv_inner_loop, pixels are loaded with a single DMA if their values are placed as in the input. */
+static void load_group_conv_input(ConvTaskParams *conv_params, uint16_t pixel_idx, uint16_t n_pixels, uint16_t c_begin, uint16_t len,
+                                  int16_t *dest, uint16_t dest_stride) {
+    const ParameterInfo *conv_input = conv_params->conv_input;
+    // Values of a pixel in the input, including footprints
+    const uint16_t pixel_len = conv_input->dims[1];
+    uint16_t src_offset = pixel_idx * pixel_len;
+#if JAPARI
+    if (conv_params->conv_input_has_footprints) {
+        start_cpu_counter(offsetof(Counters, stripping));
+        uint16_t ext_begin = extend_for_footprints(c_begin),
+                 ext_end = extend_for_footprints(c_begin + len - 1) + 1,
+                 ext_len = ext_end - ext_begin;
+        MY_ASSERT(ext_len <= INPUT_BUFFER_WITH_FOOTPRINTS_LEN);
+        // Pixels are loaded together if all of their values are used
+        uint16_t pixels_per_load = (ext_len == pixel_len) ? INPUT_BUFFER_WITH_FOOTPRINTS_LEN / pixel_len : 1;
+        for (uint16_t pixel_begin = 0; pixel_begin < n_pixels; pixel_begin += pixels_per_load) {
+            uint16_t cur_n_pixels = MIN_VAL(pixels_per_load, n_pixels - pixel_begin);
+            my_memcpy_from_param(conv_params->model, input_buffer_with_footprints, conv_input, src_offset + pixel_begin * pixel_len + ext_begin,
+                                 ((cur_n_pixels - 1) * pixel_len + ext_len) * sizeof(int16_t));
+            for (uint16_t pixel = 0; pixel < cur_n_pixels; pixel++) {
+                const int16_t *src_ptr = input_buffer_with_footprints + pixel * pixel_len;
+                int16_t *dest_ptr = dest + (pixel_begin + pixel) * dest_stride;
+                for (uint16_t ext_idx = ext_begin; ext_idx < ext_end; ext_idx++, src_ptr++) {
+                    if (ext_idx % (BATCH_SIZE + 1) != BATCH_SIZE) {
+                        *dest_ptr = *src_ptr;
+                        dest_ptr++;
+                    }
+                }
+            }
+        }
+        stop_cpu_counter();
+        return;
+    }
+#endif
+    src_offset += c_begin;
+    // Channels not in [c_begin, c_begin + len) are loaded into the padding between pixels
+    const uint16_t pixels_per_load = (dest_stride == pixel_len) ? n_pixels : 1;
+    for (uint16_t pixel_begin = 0; pixel_begin < n_pixels; pixel_begin += pixels_per_load) {
+        uint16_t loaded_len = (pixels_per_load - 1) * pixel_len + len;
+        int16_t *cur_dest = dest + pixel_begin * dest_stride;
+        uint16_t cur_src_offset = src_offset + pixel_begin * pixel_len;
+        my_memcpy_from_param(conv_params->model, cur_dest, conv_input, cur_src_offset, loaded_len * sizeof(int16_t));
+#if STATEFUL
+        start_cpu_counter(offsetof(Counters, stripping));
+        if (conv_input->slot != SLOT_TEST_SET) {
+            my_strip_states_q15(cur_dest, loaded_len, cur_src_offset % BATCH_SIZE, BATCH_SIZE, false);
+        }
+        stop_cpu_counter();
+#endif
+    }
+}
+
+/* Load filters of filter_len values and biases of output channels [filter_idx, filter_idx + output_tile_c). Filters are
+ * loaded into filter_tmp of filter_tmp_len values and interleaved, so that filters of each block of block_filters output
+ * channels are vectors of output channels, with a stride of padding_for_lea(block_filters). */
+static void load_group_conv_filters(ConvTaskParams *conv_params, uint16_t filter_idx, uint16_t filter_len, uint16_t block_filters,
+                                    int16_t *filter_buffer, int16_t *bias_buffer, int16_t *filter_tmp, uint16_t filter_tmp_len) {
+    const uint16_t output_tile_c = conv_params->flags->extra.conv.output_tile_c,
+                   filter_stride = padding_for_lea(block_filters);
+    my_printf_debug("Loading filters [%d, %d)" NEWLINE, filter_idx, filter_idx + output_tile_c);
+    const uint16_t filters_per_load = filter_tmp_len / filter_len;
+    MY_ASSERT(filters_per_load);
+    for (uint16_t idx = 0; idx < output_tile_c; idx += filters_per_load) {
+        uint16_t n_filters = MIN_VAL(filters_per_load, output_tile_c - idx);
+        my_memcpy_from_param(conv_params->model, filter_tmp, conv_params->conv_filter, (filter_idx + idx) * filter_len, n_filters * filter_len * sizeof(int16_t));
+        start_cpu_counter(offsetof(Counters, memory_layout));
+        for (uint16_t cur_idx = idx; cur_idx < idx + n_filters; cur_idx++) {
+            int16_t *block_ptr = filter_buffer + cur_idx / block_filters * filter_len * filter_stride;
+            my_interleave_q15(filter_tmp + (cur_idx - idx) * filter_len, cur_idx % block_filters, filter_stride, block_ptr, filter_len);
+        }
+        stop_cpu_counter();
+    }
+    for (uint16_t idx = 0; idx < output_tile_c; idx++) {
+        // The same as the bias in the last row of filters in convTask
+        int16_t bias_val = 0;
+        if (conv_params->conv_bias) {
+            bias_val = static_cast<int32_t>(get_q15_param(conv_params->model, conv_params->conv_bias, filter_idx + idx)) / conv_params->conv_input->scale;
+        }
+        bias_buffer[idx] = bias_val;
+    }
+#if STATEFUL
+    start_cpu_counter(offsetof(Counters, embedding));
+    if (conv_params->conv_input->slot == SLOT_TEST_SET) {
+        my_scale_q15(filter_buffer, 0x4000, 0, filter_buffer, output_tile_c / block_filters * filter_len * filter_stride);
+        for (uint16_t idx = 0; idx < output_tile_c; idx++) {
+            bias_buffer[idx] /= 2;
+        }
+    }
+    stop_cpu_counter();
+#endif
+    conv_params->cached_filter_idx = filter_idx;
+}
+
+static inline uint16_t group_conv_output_channel(uint16_t channel) {
+#if JAPARI
+    channel += channel / BATCH_SIZE;
+#endif
+    return channel;
+}
+
+/* Output values of a block of block_filters output channels from filter_idx, with filters interleaved by
+ * load_group_conv_filters. Rows and pixels in a row of the window are rings starting from first_row_offset and
+ * first_col. Products are accumulated as vectors of output channels in sum_buffer, from biases.
+ * For depthwise Conv, each output channel uses its own input channel, and the window values of all channels
+ * at a pixel are multiplied with filters at once. Otherwise, output channels in a block are in a group, and
+ * filters are scaled by a window value of the group at a time. */
+static void compute_group_conv_block(const ConvTaskParams *conv_params, const int16_t *window_buffer, uint16_t first_row_offset, uint16_t first_col,
+                                     uint16_t row_len, uint16_t window_c_offset, bool depthwise, const int16_t *filter_buffer, const int16_t *bias_buffer,
+                                     uint16_t block_filters, int16_t *sum_buffer, int16_t *product_buffer) {
+    const uint16_t group_channel = conv_params->CHANNEL,
+                   filter_stride = padding_for_lea(block_filters),
+                   window_stride = row_len / conv_params->kW;
+    my_memcpy(sum_buffer, bias_buffer, block_filters * sizeof(int16_t));
+    const int16_t *cur_filter = filter_buffer;
+    uint16_t row_offset = first_row_offset;
+    for (uint16_t kh = 0; kh < conv_params->kH; kh++) {
+        const int16_t *row_window = window_buffer + row_offset + window_c_offset;
+        row_offset += row_len;
+        if (row_offset == conv_params->kH * row_len) {
+            row_offset = 0;
+        }
+        uint16_t col = first_col;
+        for (uint16_t kw = 0; kw < conv_params->kW; kw++) {
+            const int16_t *cur_window = row_window + col * window_stride;
+            if (depthwise) {
+                my_mpy_q15(cur_window, cur_filter, product_buffer, block_filters);
+                my_add_q15(sum_buffer, product_buffer, sum_buffer, block_filters);
+                cur_filter += filter_stride;
+            } else {
+                for (uint16_t c = 0; c < group_channel; c++) {
+                    my_scale_q15(cur_filter, cur_window[c], 0, product_buffer, block_filters);
+                    my_add_q15(sum_buffer, product_buffer, sum_buffer, block_filters);
+                    cur_filter += filter_stride;
+                }
+            }
+            col++;
+            if (col == conv_params->kW) {
+                col = 0;
+            }
+        }
+    }
+}
+
+/* Depthwise and grouped convolution. An output channel only uses input channels in its group,
+ * so output values are accumulated over input windows of the group instead of multiplying full
+ * input windows with filters that are mostly zeros. Multiply-accumulate operations are on vectors
+ * of output channels (see compute_group_conv_block). Output values of all channels at an output
+ * position are written at once in NWHC, the same layout as handle_conv with a single input
+ * channel tile, or in NHWC with NHWC_OUTPUTS. As output positions are visited in the order of
+ * the layout, output values are written in the order of offsets, and jobs are mapped as other
+ * operators in job_index_to_offset(). The input window slides along output columns in NWHC or
+ * output rows in NHWC, and only new rows or pixels are loaded if all filters are in VM.
+ */
+static void handle_group_conv(Model *model, ConvTaskParams *conv_params, const Node* node) {
+    ParameterInfo *output = conv_params->output;
+    const ConvNodeFlags *conv_flags = &conv_params->flags->extra.conv;
+
+    const uint16_t group_channel = conv_params->CHANNEL,
+                   group_filters = conv_params->N_FILTERS / conv_flags->group,
+                   window_len = conv_params->kH * conv_params->kW,
+                   filter_len = window_len * group_channel,
+                   output_tile_c = conv_flags->output_tile_c,
+                   // Input channels used by a tile of output channels, which consists of whole groups or is in a group
+                   tile_input_c = MAX_VAL(output_tile_c / group_filters, 1) * group_channel,
+                   // Values of a pixel in the input window, which start at even offsets for DSP functions
+                   window_stride = padding_for_lea(tile_input_c),
+                   // Values of a row in the input window. Rows are kept in a ring indexed by input rows
+                   row_len = conv_params->kW * window_stride,
+                   OUTPUT_CHANNEL = conv_params->OUTPUT_CHANNEL,
+                   OUTPUT_H = conv_params->OUTPUT_H,
+                   OUTPUT_W = conv_params->OUTPUT_W;
+
+    // Each output channel uses an input channel
+    const bool depthwise = (group_channel == 1 && group_filters == 1);
+    // Output channels in a vector for compute_group_conv_block, which are all output channels in the tile for depthwise Conv,
+    // or output channels of a group in the tile otherwise
+    const uint16_t block_filters = depthwise ? output_tile_c : MIN_VAL(output_tile_c, group_filters),
+                   filters_buffer_len = output_tile_c / block_filters * filter_len * padding_for_lea(block_filters);
+
+    my_printf_debug("GroupConv! group=%d, output_tile_c=%d, depthwise=%d" NEWLINE, conv_flags->group, output_tile_c, depthwise);
+
+    MY_ASSERT((output_tile_c % group_filters == 0 || group_filters % output_tile_c == 0) && conv_params->N_FILTERS % output_tile_c == 0);
+    MY_ASSERT(!(conv_params->conv_input->param_flags & SEPARATE_TILING));
+    conv_params->real_conv_input = conv_params->conv_input;
+
+    // Output values at an output position, followed by an input window, a tile of filters and biases, and sums and
+    // products of a block of output channels
+    int16_t *output_buffer = lea_buffer,
+            *window_buffer = output_buffer + padding_for_lea(OUTPUT_CHANNEL),
+            *filter_buffer = window_buffer + window_len * window_stride,
+            *bias_buffer = filter_buffer + filters_buffer_len,
+            *sum_buffer = bias_buffer + padding_for_lea(output_tile_c),
+            *product_buffer = sum_buffer + padding_for_lea(block_filters);
+
+    const bool nhwc_outputs = conv_params->nhwc_outputs;
+    // Output positions are (outer, inner) in the layout, which are (output_w, output_h) in NWHC or (output_h, output_w) in NHWC
+    const uint16_t n_outer = nhwc_outputs ? OUTPUT_H : OUTPUT_W,
+                   n_inner = nhwc_outputs ? OUTPUT_W : OUTPUT_H;
+    uint16_t outer = 0, inner = 0, chunk_offset = 0;
+#if INTERMITTENT
+    start_cpu_counter(offsetof(Counters, progress_seeking));
+    uint32_t first_unfinished_value_offset = batch_start(job_index_to_offset(output, run_recovery(model, output)));
+
+    // value offset = outer * n_inner * OUTPUT_CHANNEL + inner * OUTPUT_CHANNEL + chunk_offset
+    chunk_offset = first_unfinished_value_offset % OUTPUT_CHANNEL;
+    first_unfinished_value_offset /= OUTPUT_CHANNEL;
+    inner = first_unfinished_value_offset % n_inner;
+    outer = first_unfinished_value_offset / n_inner;
+    stop_cpu_counter();
+#endif
+
+    InOrderOutputs outputs;
+    init_in_order_outputs(model, output, (outer * n_inner + inner) * OUTPUT_CHANNEL + chunk_offset, OUTPUT_CHANNEL,
+                          product_buffer + padding_for_lea(block_filters), &outputs);
+
+    for (; outer < n_outer; outer++) {
+        // Input rows (NWHC) or pixels in rows (NHWC) before this one are in the window
+        int16_t loaded_input_end = nhwc_outputs ? conv_params->input_w_first : conv_params->input_h_first;
+        for (; inner < n_inner; inner++) {
+            const uint16_t output_h = nhwc_outputs ? outer : inner,
+                           output_w = nhwc_outputs ? inner : outer;
+            int16_t input_h = conv_params->input_h_first + output_h * conv_params->stride,
+                    input_w = conv_params->input_w_first + output_w * conv_params->stride;
+            uint16_t real_chunk_len = OUTPUT_CHANNEL - chunk_offset;
+            my_printf_debug("output_h=%d output_w=%d real_chunk_len=%d" NEWLINE, output_h, output_w, real_chunk_len);
+
+            // Channels for output padding or footprints stay zero
+            my_fill_q15(0, output_buffer, OUTPUT_CHANNEL);
+            for (uint16_t filter_idx = 0; filter_idx < conv_params->N_FILTERS; filter_idx += output_tile_c) {
+                if (conv_params->cached_filter_idx != filter_idx) {
+                    // The window is not used yet, as it is loaded below for a new tile of filters
+                    load_group_conv_filters(conv_params, filter_idx, filter_len, block_filters, filter_buffer, bias_buffer, window_buffer, window_len * window_stride);
+                }
+
+                uint16_t first_group = filter_idx / group_filters,
+                         input_c_begin = first_group * group_channel;
+                // Rows (NWHC) or pixels in rows (NHWC) of the window are kept if all filters are in VM, and only new ones
+                // are loaded after moving along the inner dimension
+                const bool keep_window = (output_tile_c == conv_params->N_FILTERS);
+                uint16_t first_row_offset = 0, first_col = 0;
+                if (!nhwc_outputs) {
+                    int16_t first_input_h = keep_window ? MAX_VAL(input_h, loaded_input_end) : input_h;
+                    // Pixels of a row in the window that are in the input
+                    const int16_t kw_begin = MAX_VAL(-input_w, 0),
+                                  kw_end = MIN_VAL(static_cast<int16_t>(conv_params->W - input_w), static_cast<int16_t>(conv_params->kW));
+                    for (int16_t cur_input_h = first_input_h; cur_input_h < input_h + conv_params->kH; cur_input_h++) {
+                        int16_t *window_ptr = window_buffer + (cur_input_h - conv_params->input_h_first) % conv_params->kH * row_len;
+                        if (cur_input_h < 0 || cur_input_h >= conv_params->H) {
+                            my_fill_q15(0, window_ptr, row_len);
+                            continue;
+                        }
+                        if (kw_begin != 0 || kw_end != conv_params->kW) {
+                            my_fill_q15(0, window_ptr, row_len);
+                        }
+                        load_group_conv_input(conv_params, cur_input_h * conv_params->W + input_w + kw_begin, kw_end - kw_begin, input_c_begin, tile_input_c,
+                                              window_ptr + kw_begin * window_stride, window_stride);
+                    }
+                    loaded_input_end = input_h + conv_params->kH;
+                    // Offset of the top row in the window
+                    first_row_offset = (input_h - conv_params->input_h_first) % conv_params->kH * row_len;
+                } else {
+                    int16_t first_input_w = keep_window ? MAX_VAL(input_w, loaded_input_end) : input_w;
+                    for (int16_t cur_input_w = first_input_w; cur_input_w < input_w + conv_params->kW; cur_input_w++) {
+                        int16_t *window_ptr = window_buffer + (cur_input_w - conv_params->input_w_first) % conv_params->kW * window_stride;
+                        for (uint16_t kh = 0; kh < conv_params->kH; kh++, window_ptr += row_len) {
+                            int16_t cur_input_h = input_h + kh;
+                            if (cur_input_h < 0 || cur_input_h >= conv_params->H || cur_input_w < 0 || cur_input_w >= conv_params->W) {
+                                my_fill_q15(0, window_ptr, window_stride);
+                                continue;
+                            }
+                            load_group_conv_input(conv_params, cur_input_h * conv_params->W + cur_input_w, 1, input_c_begin, tile_input_c,
+                                                  window_ptr, window_stride);
+                        }
+                    }
+                    loaded_input_end = input_w + conv_params->kW;
+                    // The leftmost pixel in rows of the window
+                    first_col = (input_w - conv_params->input_w_first) % conv_params->kW;
+                }
+
+                for (uint16_t block_begin = 0; block_begin < output_tile_c; block_begin += block_filters) {
+                    // Input channels of the group in the window, for a tile of whole groups
+                    const uint16_t window_c_offset = depthwise ? 0 : (filter_idx + block_begin) / group_filters * group_channel - input_c_begin;
+                    compute_group_conv_block(conv_params, window_buffer, first_row_offset, first_col, row_len, window_c_offset, depthwise,
+                                             filter_buffer + block_begin / block_filters * filter_len * padding_for_lea(block_filters),
+                                             bias_buffer + block_begin, block_filters, sum_buffer, product_buffer);
+                    for (uint16_t idx = 0; idx < block_filters; idx++) {
+                        output_buffer[group_conv_output_channel(filter_idx + block_begin + idx)] = sum_buffer[idx];
+                    }
+                }
+#if ENABLE_COUNTERS
+                add_counter(offsetof(Counters, macs), window_len * group_channel * output_tile_c);
+#endif
+            }
+
+            write_in_order_outputs(model, output, output_buffer + chunk_offset, real_chunk_len, &outputs);
+            chunk_offset = 0;
+        }
+        inner = 0;
+
+        report_progress();
+    }
+
+#if INDIRECT_RECOVERY
+    start_cpu_counter(offsetof(Counters, table_updates));
+    flip_state_bit(model, output);
+    stop_cpu_counter();
+#endif
+
+    my_printf_debug("handle_group_conv output" NEWLINE);
+    dump_params_nhwc_debug(model, output, node->output_name);
+}
@@ -5,29 +5,35 @@
 #include "platform.h"
 
 #if ENABLE_COUNTERS
-uint8_t current_counter = INVALID_POINTER;
-uint8_t prev_counter = INVALID_POINTER;
+PLAT_THREAD_LOCAL uint8_t current_counter = INVALID_POINTER;
+PLAT_THREAD_LOCAL uint8_t prev_counter = INVALID_POINTER;
+#if PLAT_RUNTIME_COUNTERS
+uint8_t runtime_counters_enabled = 0;
+#endif
 
 Counters *counters() {
-#if ENABLE_PER_LAYER_COUNTERS
+#if COLLECT_PER_LAYER_COUNTERS
     return counters_data[counters_cur_copy_id] + model_vm.layer_idx;
 #else
     return counters_data[counters_cur_copy_id];
 #endif
 }
 
-template<uint32_t Counters::* MemPtr>
-static uint32_t print_counters() {
-    uint32_t total = 0;
-    for (uint16_t i = 0; i < MODEL_NODES_LEN; i++) {
+template<counter_t Counters::* MemPtr>
+static counter_t print_counters() {
+    counter_t total = 0;
+    // The last entry is for counters after all layers are finished
+    for (uint16_t i = 0; i < COUNTERS_LEN; i++) {
         total += counters_data[counters_cur_copy_id][i].*MemPtr;
 #if ENABLE_PER_LAYER_COUNTERS
-        my_printf("%12" PRIu32, counters_data[counters_cur_copy_id][i].*MemPtr);
-#else
+        if (i < MODEL_NODES_LEN) {
+            my_printf("%12" PRIcounter, counters_data[counters_cur_copy_id][i].*MemPtr);
+        }
+#elif !COLLECT_PER_LAYER_COUNTERS
         break;
 #endif
     }
-    my_printf(" total=%12" PRIu32, total);
+    my_printf(" total=%12" PRIcounter, total);
     return total;
 }
 
@@ -42,7 +48,7 @@ void print_all_counters() {
         my_printf("% 12d", get_node(i)->op_type);
     }
 #endif
-    uint32_t total_dma_bytes = 0, total_macs = 0, total_overhead = 0;
+    counter_t total_dma_bytes = 0, total_macs = 0, total_overhead = 0;
     my_printf(NEWLINE "Power counters:          "); print_counters<&Counters::power_counters>();
     my_printf(NEWLINE "DMA invocations:         "); print_counters<&Counters::dma_invocations>();
     my_printf(NEWLINE "DMA bytes:               "); total_dma_bytes = print_counters<&Counters::dma_bytes>();
@@ -58,6 +64,10 @@ void print_all_counters() {
     my_printf(NEWLINE "Table loading:           "); total_overhead += print_counters<&Counters::table_loading>();
     // recovery overheads
     my_printf(NEWLINE "Progress seeking:        "); total_overhead += print_counters<&Counters::progress_seeking>();
+#if INDIRECT_RECOVERY
+    my_printf(NEWLINE "Recovery reads:          "); print_counters<&Counters::recovery_reads>();
+    my_printf(NEWLINE "Recovery bytes:          "); print_counters<&Counters::recovery_bytes>();
+#endif
     // misc
     my_printf(NEWLINE "Memory layout:           "); total_overhead += print_counters<&Counters::memory_layout>();
     my_printf(NEWLINE "Job preservation:        "); total_overhead += print_counters<&Counters::job_preservation>();
@@ -65,10 +75,28 @@ void print_all_counters() {
     my_printf(NEWLINE "Footprint preservation:  "); total_overhead += print_counters<&Counters::footprint_preservation>();
     my_printf(NEWLINE "Data loading:            "); total_overhead += print_counters<&Counters::data_loading>();
 #endif
+#if INDIRECT_RECOVERY && PROGRESS_HINT_INTERVAL
+    my_printf(NEWLINE "Progress hints:          "); total_overhead += print_counters<&Counters::progress_hint_preservation>();
+#endif
+
+#if PLAT_RUNTIME_COUNTERS
+    my_printf(NEWLINE "Node time (us):          "); print_counters<&Counters::node_time>();
+    my_printf(NEWLINE "CPU instructions:        "); print_counters<&Counters::cpu_instructions>();
+    my_printf(NEWLINE "Cache misses:            "); print_counters<&Counters::cache_misses>();
+#endif
 
-    my_printf(NEWLINE "Total DMA bytes: %d", total_dma_bytes);
-    my_printf(NEWLINE "Total MACs: %d", total_macs);
-    my_printf(NEWLINE "Total overhead: %" PRIu32, total_overhead);
+#if PLAT_HAS_THREADS
+    // Speedup of a layer = task time / wall time
+    my_printf(NEWLINE "Parallel task time (us): "); counter_t total_task_time = print_counters<&Counters::parallel_task_time>();
+    my_printf(NEWLINE "Parallel wall time (us): "); counter_t total_wall_time = print_counters<&Counters::parallel_wall_time>();
+    if (total_wall_time) {
+        my_printf(NEWLINE "Parallel speedup: %.2f", 1.0 * total_task_time / total_wall_time);
+    }
+#endif
+
+    my_printf(NEWLINE "Total DMA bytes: %" PRIcounter, total_dma_bytes);
+    my_printf(NEWLINE "Total MACs: %" PRIcounter, total_macs);
+    my_printf(NEWLINE "Total overhead: %" PRIcounter, total_overhead);
     my_printf(NEWLINE "run_counter: %d" NEWLINE, get_model()->run_counter);
 }
 
@@ -79,6 +107,20 @@ void reset_counters() {
 #endif
 }
 
+void add_counters(Counters* dest, const Counters* src) {
+    // All fields in Counters are counter_t
+    static_assert(sizeof(Counters) % sizeof(counter_t) == 0, "Unexpected size for Counters");
+    const counter_t *src_fields = reinterpret_cast<const counter_t*>(src);
+    counter_t *dest_fields = reinterpret_cast<counter_t*>(dest);
+    for (uint32_t idx = 0; idx < COUNTERS_LEN * sizeof(Counters) / sizeof(counter_t); idx++) {
+        dest_fields[idx] += src_fields[idx];
+    }
+}
+
+void merge_counters(Counters* dest) {
+    add_counters(dest, counters_data[counters_cur_copy_id]);
+}
+
 void report_progress() {
 #if ENABLE_DEMO_COUNTERS
     static uint8_t last_progress = 0;
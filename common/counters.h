@@ -2,11 +2,19 @@
 
 #include "my_debug.h"
 #include "cnn_common.h"
+#include <cinttypes>
 #include <cstdint>
 
+#if PLAT_RUNTIME_COUNTERS
+// Counters are always compiled on PC, and switched on at run time (see profiler.h)
+#define ENABLE_COUNTERS 1
+#else
 #define ENABLE_COUNTERS 0
+#endif
 #define ENABLE_PER_LAYER_COUNTERS 0
 #define ENABLE_DEMO_COUNTERS 0
+// Per-layer counters are always collected on PC for exporting, and ENABLE_PER_LAYER_COUNTERS is for printing them
+#define COLLECT_PER_LAYER_COUNTERS (ENABLE_PER_LAYER_COUNTERS || PLAT_RUNTIME_COUNTERS)
 // Some demo codes assume counters are accumulated across layers
 static_assert((!ENABLE_PER_LAYER_COUNTERS) || (!ENABLE_DEMO_COUNTERS), "ENABLE_PER_LAYER_COUNTERS and ENABLE_DEMO_COUNTERS are mutually exclusive");
 
@@ -15,58 +23,113 @@ static_assert((!ENABLE_PER_LAYER_COUNTERS) || (!ENABLE_DEMO_COUNTERS), "ENABLE_P
 // as the latter involves pointer arithmetic and is slower for platforms with special pointer bitwidths (ex: MSP430)
 #if ENABLE_COUNTERS
 
+#if PLAT_RUNTIME_COUNTERS
+// CPU cycles on PC overflow 32 bits in about a second
+typedef uint64_t counter_t;
+#define PRIcounter PRIu64
+#else
+typedef uint32_t counter_t;
+#define PRIcounter PRIu32
+#endif
+
 #define COUNTERS_LEN (MODEL_NODES_LEN+1)
+#define MAX_COUNTERS_LEN (MAX_MODEL_NODES_LEN+1)
+// Field offsets below are for 32-bit counters
 struct Counters {
     // field offset = 0
-    uint32_t power_counters;
-    uint32_t dma_invocations;
-    uint32_t dma_bytes;
-    uint32_t macs;
+    counter_t power_counters;
+    counter_t dma_invocations;
+    counter_t dma_bytes;
+    counter_t macs;
 
     // field offset = 16
-    uint32_t embedding;
-    uint32_t stripping;
-    uint32_t overflow_handling;
+    counter_t embedding;
+    counter_t stripping;
+    counter_t overflow_handling;
 
     // field offset = 28
-    uint32_t state_query;
-    uint32_t table_updates;
-    uint32_t table_preservation;
-    uint32_t table_loading;
+    counter_t state_query;
+    counter_t table_updates;
+    counter_t table_preservation;
+    counter_t table_loading;
 
     // field offset = 44
-    uint32_t progress_seeking;
+    counter_t progress_seeking;
 
     // field offset = 48
-    uint32_t memory_layout;
+    counter_t memory_layout;
 
     // field offset = 52
-    uint32_t data_loading;
+    counter_t data_loading;
 
     // field offset = 56
-    uint32_t job_preservation;
-    uint32_t footprint_preservation;
+    counter_t job_preservation;
+    counter_t footprint_preservation;
+    counter_t progress_hint_preservation;
+    // NVM reads and bytes for progress seeking
+    counter_t recovery_reads;
+    counter_t recovery_bytes;
+
+#if PLAT_HAS_THREADS
+    // in microseconds, for intra-layer parallelism (parallel.h)
+    counter_t parallel_task_time;
+    counter_t parallel_wall_time;
+#endif
+#if PLAT_RUNTIME_COUNTERS
+    // in microseconds, time spent in handle_node
+    counter_t node_time;
+    // in regions of CPU counters, with -E (see plat-pc.cpp)
+    counter_t cpu_instructions;
+    counter_t cache_misses;
+#endif
 };
 
-extern uint8_t counters_cur_copy_id;
-extern Counters counters_data[2][COUNTERS_LEN];
+extern PLAT_THREAD_LOCAL uint8_t counters_cur_copy_id;
+extern PLAT_THREAD_LOCAL Counters counters_data[2][MAX_COUNTERS_LEN];
 Counters *counters();
 #if ENABLE_DEMO_COUNTERS
 extern uint32_t total_jobs;
 #endif
 
-extern uint8_t current_counter;
-extern uint8_t prev_counter;
+extern PLAT_THREAD_LOCAL uint8_t current_counter;
+extern PLAT_THREAD_LOCAL uint8_t prev_counter;
 const uint8_t INVALID_POINTER = 0xff;
 
-static inline void add_counter(uint8_t counter, uint32_t value) {
-    *reinterpret_cast<uint32_t*>(reinterpret_cast<uint8_t*>(counters()) + counter) += value;
+#if PLAT_RUNTIME_COUNTERS
+// Set before any thread other than the main one starts
+extern uint8_t runtime_counters_enabled;
+static inline bool counters_enabled(void) {
+    return runtime_counters_enabled;
+}
+#else
+static inline bool counters_enabled(void) {
+    return true;
+}
+#endif
+
+#if PLAT_RUNTIME_COUNTERS
+#include "profiler.h"
+#else
+#define profiler_node_begin(node_idx)
+#define profiler_node_end(node_idx)
+#define profiler_region_begin()
+#define profiler_region_end(counter)
+#endif
+
+static inline void add_counter(uint8_t counter, counter_t value) {
+    if (!counters_enabled()) {
+        return;
+    }
+    *reinterpret_cast<counter_t*>(reinterpret_cast<uint8_t*>(counters()) + counter) += value;
 }
 
 static inline void start_cpu_counter(uint8_t mem_ptr) {
 #if ENABLE_DEMO_COUNTERS
     return;
 #endif
+    if (!counters_enabled()) {
+        return;
+    }
 
     MY_ASSERT(prev_counter == INVALID_POINTER, "There is already two counters - prev_counter=%d, current_counter=%d", prev_counter, current_counter);
 
@@ -77,6 +140,7 @@ static inline void start_cpu_counter(uint8_t mem_ptr) {
     }
     my_printf_debug("Start CPU counter %d" NEWLINE, mem_ptr);
     current_counter = mem_ptr;
+    profiler_region_begin();
     plat_start_cpu_counter();
 }
 
@@ -84,11 +148,15 @@ static inline void stop_cpu_counter(void) {
 #if ENABLE_DEMO_COUNTERS
     return;
 #endif
+    if (!counters_enabled()) {
+        return;
+    }
 
     MY_ASSERT(current_counter != INVALID_POINTER);
 
     my_printf_debug("Stop inner CPU counter %d" NEWLINE, current_counter);
     add_counter(current_counter, plat_stop_cpu_counter());
+    profiler_region_end(current_counter);
     if (prev_counter != INVALID_POINTER) {
         current_counter = prev_counter;
         my_printf_debug("Restarting outer CPU counter %d" NEWLINE, current_counter);
@@ -102,11 +170,19 @@ static inline void stop_cpu_counter(void) {
 void print_all_counters();
 void reset_counters();
 void report_progress();
+// Add counters in src to dest. Both have COUNTERS_LEN entries
+void add_counters(Counters* dest, const Counters* src);
+// Add counters of the current thread to dest
+void merge_counters(Counters* dest);
 
 #else
 #define start_cpu_counter(mem_ptr)
 #define stop_cpu_counter()
+#define profiler_node_begin(node_idx)
+#define profiler_node_end(node_idx)
 #define print_all_counters()
 #define reset_counters()
 #define report_progress()
+#define add_counters(dest, src)
+#define merge_counters(dest)
 #endif
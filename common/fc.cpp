@@ -8,6 +8,7 @@
 #include "op_utils.h"
 #include "my_dsplib.h"
 #include "intermittent-cnn.h"
+#include "parallel.h"
 
 /**
  * For fully-connected layers, which are implemented via Gemm in ONNX.
@@ -17,6 +18,8 @@ void alloc_gemm(Model *model, const ParameterInfo *input[], ParameterInfo *outpu
     const ParameterInfo *A = input[0], *B = input[1];
 
     MY_ASSERT(A->dims[0] == 1);
+    // buffers in handle_gemm_tile are for OP_FILTERS output values
+    MY_ASSERT(node->flags.extra.gemm.op_filters && node->flags.extra.gemm.op_filters <= OP_FILTERS);
 
     output->dims[0] = A->dims[0];
 #if JAPARI
@@ -27,7 +30,6 @@ void alloc_gemm(Model *model, const ParameterInfo *input[], ParameterInfo *outpu
     output->dims[1] = B->dims[1];
 #endif
     output->bitwidth = 16;
-    output->slot = get_next_slot(model, A);
     output->scale = A->scale * B->scale;
 
     uint16_t output_len = output->dims[0] * output->dims[1];
@@ -47,12 +49,26 @@ void GemmInputChunkHandler(uint32_t offset, uint16_t real_chunk_len, int8_t stat
     my_offset_q15_batched(to_offset, -state_bit*0x4000, to_offset, real_chunk_len);
 }
 
-void handle_gemm(Model *model, const ParameterInfo *input[], ParameterInfo *output, const Node* node) {
-    const ParameterInfo *A = input[0], *B = input[1], *matC = input[2];
-    const NodeFlags* flags = &node->flags;
+struct GemmTileParams {
+    Model *model;
+    const ParameterInfo *A;
+    const ParameterInfo *B;
+    const ParameterInfo *matC;
+    ParameterInfo *output;
+    const NodeFlags* flags;
+#if INDIRECT_RECOVERY
+    int16_t offset;
+    uint16_t next_output_turning_point;
+    uint8_t output_turning_point_idx;
+    SlotInfo *output_slot_info;
+#endif
+};
 
-    my_printf_debug("Gemm! A: (%dx%d), B: (%dx%d)" NEWLINE,
-              A->dims[0], A->dims[1], B->dims[0], B->dims[1]);
+static void handle_gemm_tile(GemmTileParams *tile_params, uint16_t tile, uint16_t j, uint16_t j_with_footprints) {
+    Model *model = tile_params->model;
+    const ParameterInfo *A = tile_params->A, *B = tile_params->B, *matC = tile_params->matC;
+    ParameterInfo *output = tile_params->output;
+    const NodeFlags* flags = tile_params->flags;
 
     int16_t A_len = A->dims[0] * A->dims[1] + 2,
             output_len = output->dims[0] * output->dims[1];
@@ -69,173 +85,268 @@ void handle_gemm(Model *model, const ParameterInfo *input[], ParameterInfo *outp
 #endif
     make_buffer_aligned(&buffer_b);
 
-    uint16_t i = 0, tile = 0, j = 0, j_with_footprints = 0;
-
-#if INTERMITTENT
-    start_cpu_counter(offsetof(Counters, progress_seeking));
-    uint32_t first_unfinished_value_offset = job_index_to_offset(output, run_recovery(model, output));
-
-#if INDIRECT_RECOVERY
-    start_cpu_counter(offsetof(Counters, state_query));
-    int16_t offset;
-    uint16_t next_output_turning_point;
-    uint8_t output_turning_point_idx;
-    SlotInfo *output_slot_info;
-    find_initial_state_bit(&offset, &output_turning_point_idx, &next_output_turning_point, &output_slot_info, first_unfinished_value_offset, model, output);
-    offset = -offset;
-    stop_cpu_counter();
-#endif
-
-    first_unfinished_value_offset = batch_start(first_unfinished_value_offset);
-
-    fix_first_unfinished_value_offset(model, &first_unfinished_value_offset);
-
-    tile = first_unfinished_value_offset / output_len;
-    i = tile * flags->extra.gemm.tile_channel;
-    j_with_footprints = first_unfinished_value_offset % output_len;
+    uint16_t i = tile * flags->extra.gemm.tile_channel;
+    const uint16_t tile_channels = MIN_VAL(flags->extra.gemm.tile_channel, B->dims[0] - i);
+    uint16_t extended_tile_channels = tile_channels + 2;
+
+    const uint16_t op_filters = flags->extra.gemm.op_filters;
+    // With sparse weights, a block is a row of weights for op_filters output values. Inputs are gathered
+    // for non-zero blocks into buffer_sparse_a, which keeps block column indices before that
+    const uint8_t sparse = (B->param_flags & SPARSE);
+    int16_t *buffer_sparse_a = nullptr;
+    if (sparse) {
+        buffer_sparse_a = buffer_b;
+        buffer_b += flags->extra.gemm.tile_channel + 2;
+        make_buffer_aligned(&buffer_b);
+    }
 
 #if JAPARI
-    start_cpu_counter(offsetof(Counters, embedding));
-    j = j_with_footprints / (BATCH_SIZE + 1) * BATCH_SIZE;
+    start_cpu_counter(offsetof(Counters, stripping));
+    bool need_skipping = has_footprints(A);
+    if (need_skipping) {
+        // somehow loading many pieces is faster than loading a chunk and moving values around to remove footprints, even with external FRAM
+        uint16_t input_offset = extend_for_footprints(i);
+        for (uint16_t idx = 0, output_idx = 0; output_idx < tile_channels; idx += BATCH_SIZE + 1, output_idx += BATCH_SIZE) {
+            my_memcpy_from_param(model, buffer_a + output_idx, A, input_offset + idx, BATCH_SIZE * sizeof(uint16_t));
+        }
+    }
     stop_cpu_counter();
-#else
-    j = j_with_footprints;
+    if (!need_skipping)
 #endif
+    {
+        my_memcpy_from_param(model, buffer_a, A, i, tile_channels * sizeof(uint16_t));
+    }
 
+#if STATEFUL
+    start_cpu_counter(offsetof(Counters, stripping));
+    GemmInputChunkHandlerParams params{buffer_a, i};
+    iterate_chunks(model, A, i, tile_channels, GemmInputChunkHandler, &params);
     stop_cpu_counter();
 #endif
-
-    for (; i < B->dims[0]; i += flags->extra.gemm.tile_channel, tile++) {
-        const uint16_t tile_channels = MIN_VAL(flags->extra.gemm.tile_channel, B->dims[0] - i);
-        const uint16_t extended_tile_channels = tile_channels + 2;
-
-#if JAPARI
-        start_cpu_counter(offsetof(Counters, stripping));
-        bool need_skipping = has_footprints(A);
-        if (need_skipping) {
-            // somehow loading many pieces is faster than loading a chunk and moving values around to remove footprints, even with external FRAM
-            uint16_t input_offset = extend_for_footprints(i);
-            for (uint16_t idx = 0, output_idx = 0; output_idx < tile_channels; idx += BATCH_SIZE + 1, output_idx += BATCH_SIZE) {
-                my_memcpy_from_param(model, buffer_a + output_idx, A, input_offset + idx, BATCH_SIZE * sizeof(uint16_t));
-            }
+    buffer_a[tile_channels] = -0x8000;
+    buffer_a[tile_channels + 1] = 0;
+
+    my_printf_debug("Tile for A" NEWLINE);
+    dump_matrix_debug(buffer_a, 1, extended_tile_channels, ValueInfo(A, model));
+
+    int16_t output_offset = tile * output_len + j_with_footprints;
+
+    int16_t tile_width;
+    for (; j < B->dims[1]; j += tile_width) {
+        // this variable is used only for JAPARI. Don't use [[maybe_unused]] until TI CGT support C++17.
+        bool exact_tile = true;
+        if (op_filters > B->dims[1] - j) {
+            tile_width = B->dims[1] - j;
+            exact_tile = true;
+        } else {
+            tile_width = op_filters;
         }
-        stop_cpu_counter();
-        if (!need_skipping)
-#endif
-        {
-            my_memcpy_from_param(model, buffer_a, A, i, tile_channels * sizeof(uint16_t));
+        int16_t *cur_buffer_a = buffer_a;
+        uint16_t n_rows = tile_channels, first_block = 0;
+        if (sparse) {
+            // Blocks are aligned to op_filters, so a tile resumed in the middle is finished first
+            tile_width = MIN_VAL(tile_width, op_filters - j % op_filters);
+            uint16_t n_col_tiles = upper_gauss(B->dims[1], op_filters);
+            n_rows = load_sparse_row(B, upper_gauss(B->dims[0], flags->extra.gemm.tile_channel) * n_col_tiles, tile * n_col_tiles + j / op_filters,
+                                     &first_block, reinterpret_cast<uint16_t*>(buffer_sparse_a), tile_channels);
+            my_printf_debug("%d non-zero rows of sparse weights" NEWLINE, n_rows);
+            cur_buffer_a = buffer_sparse_a;
+            // Rows for zero blocks are skipped. LEA requires an even number of rows
+            extended_tile_channels = padding_for_lea(n_rows) + 2;
         }
-
-#if STATEFUL
-        start_cpu_counter(offsetof(Counters, stripping));
-        GemmInputChunkHandlerParams params{buffer_a, i};
-        iterate_chunks(model, A, i, tile_channels, GemmInputChunkHandler, &params);
+        int16_t values_to_preserve = tile_width,
+                full_tile_width = tile_width;
+#if JAPARI
+        start_cpu_counter(offsetof(Counters, embedding));
+        values_to_preserve = extend_for_footprints(tile_width);
+        full_tile_width = (values_to_preserve + 1) / 2 * 2;
         stop_cpu_counter();
 #endif
-        buffer_a[tile_channels] = -0x8000;
-        buffer_a[tile_channels + 1] = 0;
-
-        my_printf_debug("Tile for A" NEWLINE);
-        dump_matrix_debug(buffer_a, 1, extended_tile_channels, ValueInfo(A, model));
-
-        int16_t output_offset = tile * output_len + j_with_footprints;
-
-        for (; j < B->dims[1]; j += OP_FILTERS) {
-            int16_t tile_width;
-            // this variable is used only for JAPARI. Don't use [[maybe_unused]] until TI CGT support C++17.
-            bool exact_tile = true;
-            if (OP_FILTERS > B->dims[1] - j) {
-                tile_width = B->dims[1] - j;
-                exact_tile = true;
+        int16_t *filter_ptr = buffer_b;
+        my_fill_q15(0, filter_ptr, extended_tile_channels * full_tile_width);
+        for (uint16_t row = 0; row < n_rows; row++) {
+            if (sparse) {
+                my_memcpy_from_param(model, filter_ptr,
+                          B, (first_block + row) * op_filters + j % op_filters,
+                          tile_width * sizeof(uint16_t));
+                // Column indices are rows in the tile. Each of them is read before overwritten
+                buffer_sparse_a[row] = buffer_a[buffer_sparse_a[row]];
             } else {
-                tile_width = OP_FILTERS;
-            }
-            int16_t values_to_preserve = tile_width,
-                    full_tile_width = tile_width;
-#if JAPARI
-            start_cpu_counter(offsetof(Counters, embedding));
-            values_to_preserve = extend_for_footprints(tile_width);
-            full_tile_width = (values_to_preserve + 1) / 2 * 2;
-            stop_cpu_counter();
-#endif
-            int16_t *filter_ptr = buffer_b;
-            my_fill_q15(0, filter_ptr, extended_tile_channels * full_tile_width);
-            for (uint16_t row = 0; row < tile_channels; row++) {
                 my_memcpy_from_param(model, filter_ptr,
                           B, (i + row) * B->dims[1] + j,
                           tile_width * sizeof(uint16_t));
+            }
 #if JAPARI
-                start_cpu_counter(offsetof(Counters, embedding));
-                move_weights(filter_ptr, exact_tile, values_to_preserve, tile_width);
-                stop_cpu_counter();
+            start_cpu_counter(offsetof(Counters, embedding));
+            move_weights(filter_ptr, exact_tile, values_to_preserve, tile_width);
+            stop_cpu_counter();
 #else
-                (void)exact_tile; // silent a compiler warning
+            (void)exact_tile; // silent a compiler warning
 #endif
+            filter_ptr += full_tile_width;
+        }
+        if (sparse) {
+            // The same as the last two values in buffer_a, after a zero row for LEA if needed
+            if (n_rows % 2) {
+                buffer_sparse_a[n_rows] = 0;
                 filter_ptr += full_tile_width;
             }
+            buffer_sparse_a[extended_tile_channels - 2] = -0x8000;
+            buffer_sparse_a[extended_tile_channels - 1] = 0;
+        }
 #if JAPARI
-            start_cpu_counter(offsetof(Counters, embedding));
-            my_fill_q15(0, filter_ptr, 2 * full_tile_width);
-            uint8_t processed_biases = 0, bias_offset = 0;
-            for (uint16_t idx = 0; idx < values_to_preserve; idx++) {
-                if (processed_biases == BATCH_SIZE) {
-                    processed_biases = 0;
-                    filter_ptr[idx] = param_state_bit(model, output, output_offset);
-                } else {
-                    if (tile == 0) {
-                        filter_ptr[idx] = -static_cast<int32_t>(get_q15_param(model, matC, bias_offset + j)) / A->scale;
-                    }
-                    bias_offset++;
-                    processed_biases++;
+        start_cpu_counter(offsetof(Counters, embedding));
+        my_fill_q15(0, filter_ptr, 2 * full_tile_width);
+        uint8_t processed_biases = 0, bias_offset = 0;
+        for (uint16_t idx = 0; idx < values_to_preserve; idx++) {
+            if (processed_biases == BATCH_SIZE) {
+                processed_biases = 0;
+                filter_ptr[idx] = param_state_bit(model, output, output_offset);
+            } else {
+                if (tile == 0) {
+                    filter_ptr[idx] = -static_cast<int32_t>(get_q15_param(model, matC, bias_offset + j)) / A->scale;
                 }
+                bias_offset++;
+                processed_biases++;
             }
-            stop_cpu_counter();
+        }
+        stop_cpu_counter();
 #else
-            if (tile == 0) {
-                for (uint16_t idx = 0; idx < values_to_preserve; idx++) {
-                    filter_ptr[idx] = -static_cast<int32_t>(get_q15_param(model, matC, idx + j)) / A->scale;
-                }
+        if (tile == 0) {
+            for (uint16_t idx = 0; idx < values_to_preserve; idx++) {
+                filter_ptr[idx] = -static_cast<int32_t>(get_q15_param(model, matC, idx + j)) / A->scale;
             }
+        }
 #endif
 
 #if INDIRECT_RECOVERY
-            start_cpu_counter(offsetof(Counters, state_query));
-            check_next_turning_point(offset, output_turning_point_idx, next_output_turning_point, output_slot_info, output_offset);
-            stop_cpu_counter();
+        start_cpu_counter(offsetof(Counters, state_query));
+        check_next_turning_point(tile_params->offset, tile_params->output_turning_point_idx, tile_params->next_output_turning_point, tile_params->output_slot_info, output_offset);
+        stop_cpu_counter();
 #endif
 
 #if STATEFUL
-            start_cpu_counter(offsetof(Counters, embedding));
-            uint16_t tile_width_first = update_states(filter_ptr, tile_width, output_offset, offset, next_output_turning_point, false);
-            stop_cpu_counter();
+        start_cpu_counter(offsetof(Counters, embedding));
+        uint16_t tile_width_first = update_states(filter_ptr, tile_width, output_offset, tile_params->offset, tile_params->next_output_turning_point, false);
+        stop_cpu_counter();
 #endif
 
-            my_printf_debug("Tile for B" NEWLINE);
-            dump_matrix_debug(buffer_b, extended_tile_channels, full_tile_width, ValueInfo(B, model));
+        my_printf_debug("Tile for B" NEWLINE);
+        dump_matrix_debug(buffer_b, extended_tile_channels, full_tile_width, ValueInfo(B, model));
 
 #if STATEFUL
-            my_matrix_mpy_q15(1, extended_tile_channels, extended_tile_channels, full_tile_width, buffer_a, buffer_b, buffer_temp,
-                              output, output_offset, values_to_preserve, offset, tile_width_first);
+        my_matrix_mpy_q15(1, extended_tile_channels, extended_tile_channels, full_tile_width, cur_buffer_a, buffer_b, buffer_temp,
+                          output, output_offset, values_to_preserve, tile_params->offset, tile_width_first);
 #else
-            my_matrix_mpy_q15(1, extended_tile_channels, extended_tile_channels, full_tile_width, buffer_a, buffer_b, buffer_temp,
-                              output, output_offset, values_to_preserve, 0, 0);
+        my_matrix_mpy_q15(1, extended_tile_channels, extended_tile_channels, full_tile_width, cur_buffer_a, buffer_b, buffer_temp,
+                          output, output_offset, values_to_preserve, 0, 0);
 #endif
 
-            my_printf_debug("matrix_mpy_results" NEWLINE);
-            dump_matrix_debug(buffer_temp, full_tile_width, ValueInfo(output, model));
-            my_printf_debug(NEWLINE);
+        my_printf_debug("matrix_mpy_results" NEWLINE);
+        dump_matrix_debug(buffer_temp, full_tile_width, ValueInfo(output, model));
+        my_printf_debug(NEWLINE);
 
-            compare_vm_nvm(buffer_temp, model, output, output_offset, values_to_preserve);
+        compare_vm_nvm(buffer_temp, model, output, output_offset, values_to_preserve);
 
-            my_printf_debug("output_offset=%d" NEWLINE, output_offset);
+        my_printf_debug("output_offset=%d" NEWLINE, output_offset);
 #if HAWAII
-            hawaii_record_footprints(model, values_to_preserve);
+        hawaii_record_footprints(model, values_to_preserve);
+#endif
+        output_offset += values_to_preserve;
+    }
+}
+
+#if PARALLEL_LAYERS
+static void gemm_tile_task(GemmTileParams *tile_params, uint16_t tile) {
+    // Start from the same states as recovering from a power failure at the first job
+    tile_params->model = get_model();
+#if INDIRECT_RECOVERY
+    const ParameterInfo *output = tile_params->output;
+    find_initial_state_bit(&tile_params->offset, &tile_params->output_turning_point_idx, &tile_params->next_output_turning_point, &tile_params->output_slot_info,
+                           tile * output->dims[0] * output->dims[1], tile_params->model, output);
+    tile_params->offset = -tile_params->offset;
+#endif
+    handle_gemm_tile(tile_params, tile, 0, 0);
+}
 #endif
-            output_offset += values_to_preserve;
+
+void handle_gemm(Model *model, const ParameterInfo *input[], ParameterInfo *output, const Node* node) {
+    const ParameterInfo *A = input[0], *B = input[1], *matC = input[2];
+    const NodeFlags* flags = &node->flags;
+
+    my_printf_debug("Gemm! A: (%dx%d), B: (%dx%d)" NEWLINE,
+              A->dims[0], A->dims[1], B->dims[0], B->dims[1]);
+
+    GemmTileParams tile_params;
+    tile_params.model = model;
+    tile_params.A = A;
+    tile_params.B = B;
+    tile_params.matC = matC;
+    tile_params.output = output;
+    tile_params.flags = flags;
+
+    uint16_t i = 0, tile = 0, j = 0, j_with_footprints = 0;
+
+#if INTERMITTENT
+    start_cpu_counter(offsetof(Counters, progress_seeking));
+    uint32_t first_unfinished_value_offset = job_index_to_offset(output, run_recovery(model, output));
+
+#if INDIRECT_RECOVERY
+    start_cpu_counter(offsetof(Counters, state_query));
+    find_initial_state_bit(&tile_params.offset, &tile_params.output_turning_point_idx, &tile_params.next_output_turning_point, &tile_params.output_slot_info,
+                           first_unfinished_value_offset, model, output);
+    tile_params.offset = -tile_params.offset;
+    stop_cpu_counter();
+#endif
+
+    first_unfinished_value_offset = batch_start(first_unfinished_value_offset);
+
+    fix_first_unfinished_value_offset(model, &first_unfinished_value_offset);
+
+    int16_t output_len = output->dims[0] * output->dims[1];
+    tile = first_unfinished_value_offset / output_len;
+    i = tile * flags->extra.gemm.tile_channel;
+    j_with_footprints = first_unfinished_value_offset % output_len;
+
+#if JAPARI
+    start_cpu_counter(offsetof(Counters, embedding));
+    j = j_with_footprints / (BATCH_SIZE + 1) * BATCH_SIZE;
+    stop_cpu_counter();
+#else
+    j = j_with_footprints;
+#endif
+
+    stop_cpu_counter();
+#endif
+
+#if PARALLEL_LAYERS
+    TaskGroup task_group;
+    if (parallel_layers_enabled()) {
+        init_task_group(&task_group);
+    }
+#endif
+
+    for (; i < B->dims[0]; i += flags->extra.gemm.tile_channel, tile++) {
+#if PARALLEL_LAYERS
+        // A tile partially finished before a power failure is handled serially
+        if (parallel_layers_enabled() && j == 0) {
+            submit_task(&task_group, [task_params = tile_params, tile] () mutable {
+                gemm_tile_task(&task_params, tile);
+            });
+        } else
+#endif
+        {
+            handle_gemm_tile(&tile_params, tile, j, j_with_footprints);
         }
         j = j_with_footprints = 0;
     }
 
+#if PARALLEL_LAYERS
+    if (parallel_layers_enabled()) {
+        wait_task_group(&task_group);
+    }
+#endif
+
 #if INDIRECT_RECOVERY
     start_cpu_counter(offsetof(Counters, table_updates));
     flip_state_bit(model, output);
@@ -247,9 +358,9 @@ void handle_gemm(Model *model, const ParameterInfo *input[], ParameterInfo *outp
 }
 
 void alloc_gemmmerge(Model *model, const ParameterInfo *input[], ParameterInfo *output, const Node*) {
-    output->slot = get_next_slot(model, input[0]);
     int16_t output_len = output->dims[0] * output->dims[1];
     output->params_len = output_len * sizeof(int16_t);
+    output->bitwidth = 16;
 }
 
 void handle_gemmmerge(Model *model, const ParameterInfo *input[], ParameterInfo *output, const Node* node) {
@@ -280,7 +391,7 @@ void handle_gemmmerge(Model *model, const ParameterInfo *input[], ParameterInfo
             *buffer_gemm = buffer_temp + output_tile_size;
     make_buffer_aligned(&buffer_gemm);
 
-    int16_t n_tiles = X->params_len / output_len / sizeof(int16_t);
+    int16_t n_tiles = get_values_len(X) / output_len;
     my_printf_debug("n_tiles=%d" NEWLINE, n_tiles);
     MY_ASSERT(n_tiles);
 
@@ -292,9 +403,7 @@ void handle_gemmmerge(Model *model, const ParameterInfo *input[], ParameterInfo
             my_memcpy_from_param(model, buffer_temp, input[0], tile * output_len + merge_offset, cur_tile_size * sizeof(int16_t));
 #if STATEFUL
             start_cpu_counter(offsetof(Counters, stripping));
-            for (uint16_t idx = BATCH_SIZE - 1; idx < cur_tile_size; idx += BATCH_SIZE) {
-                strip_state(buffer_temp + idx);
-            }
+            my_strip_states_q15(buffer_temp, cur_tile_size, 0, BATCH_SIZE, false);
             stop_cpu_counter();
 #endif
             my_add_q15(buffer_gemm, buffer_temp, buffer_gemm, cur_tile_size);
@@ -302,6 +411,12 @@ void handle_gemmmerge(Model *model, const ParameterInfo *input[], ParameterInfo
             dump_matrix_debug(buffer_gemm, cur_tile_size, ValueInfo(output, model));
         }
 
+        if (node->flags.generic & FUSED_RELU) {
+            for (int16_t idx = 0; idx < cur_tile_size; idx++) {
+                buffer_gemm[idx] = MAX_VAL(buffer_gemm[idx], 0);
+            }
+        }
+
 #if INDIRECT_RECOVERY
         start_cpu_counter(offsetof(Counters, embedding));
         OutputChunkHandlerParams params;
@@ -40,9 +40,8 @@ static void check_feature_map_states(Model *model, const ParameterInfo* output,
 #endif
 
 #if STATEFUL
-static uint8_t value_finished(Model* model, const ParameterInfo* output, uint32_t job_index) {
-    uint32_t offset = job_index_to_offset(output, job_index);
-    int16_t val = get_q15_param(model, output, offset);
+// Check val at offset, which is the last value of the job at job_index
+static uint8_t job_value_finished(Model* model, const ParameterInfo* output, uint32_t job_index, uint32_t offset, int16_t val) {
     uint8_t ret = (get_value_state_bit(val) != param_state_bit(model, output, offset));
     my_printf_debug("Value %d at job index %d (offset %" PRIu32 ") indicates %s" NEWLINE, val, job_index, offset, ret ? "finished" : "unfinished");
     return ret;
@@ -60,9 +59,9 @@ void flip_state_bit(Model *model, const ParameterInfo *output) {
     // XXX: better way than copying the array?
 #if JAPARI
     // abandon output features smaller than a batch
-    uint16_t new_turning_point = (output->params_len / 2) / (BATCH_SIZE + 1) * (BATCH_SIZE + 1);
+    uint16_t new_turning_point = get_values_len(output) / (BATCH_SIZE + 1) * (BATCH_SIZE + 1);
 #else
-    uint16_t new_turning_point = (output->params_len / 2) / BATCH_SIZE * BATCH_SIZE;
+    uint16_t new_turning_point = get_values_len(output) / BATCH_SIZE * BATCH_SIZE;
 #endif
     my_printf_debug("New turning point=%d" NEWLINE, new_turning_point);
     uint8_t new_turning_point_inserted = 0;
@@ -96,7 +95,7 @@ void flip_state_bit(Model *model, const ParameterInfo *output) {
     cur_slot_info->state_bit = -cur_slot_info->state_bit;
 
     // Use first_unfinished_job_index = 0 here as all values finished and the initial state bit is flipped above
-    check_feature_map_states(model, output, 0, output->params_len / sizeof(int16_t), __func__);
+    check_feature_map_states(model, output, 0, get_values_len(output), __func__);
 }
 
 int8_t get_state_bit(Model *model, uint8_t slot_id) {
@@ -135,9 +134,7 @@ uint32_t run_recovery(Model* model, ParameterInfo*) {
 #endif
 
 #if JAPARI
-static uint8_t value_finished(Model* model, const ParameterInfo* output, uint32_t job_index) {
-    uint32_t offset = job_index_to_offset(output, job_index);
-    int16_t val = get_q15_param(model, output, offset);
+static uint8_t job_value_finished(Model* model, const ParameterInfo* output, uint32_t job_index, uint32_t offset, int16_t val) {
     int16_t expected_footprint = -param_state_bit(model, output, offset);
     check_footprint(val);
     uint8_t ret = (val == expected_footprint);
@@ -148,19 +145,21 @@ static uint8_t value_finished(Model* model, const ParameterInfo* output, uint32_
 
 uint32_t job_index_to_offset(const ParameterInfo *output, uint16_t job_index) {
 #if STATEFUL
-    if (job_index >= output->params_len / sizeof(int16_t)) {
+    if (job_index >= get_values_len(output)) {
         return job_index;
     }
 #endif
 #if JAPARI
-    if (job_index >= output->params_len / sizeof(int16_t) / (BATCH_SIZE + 1)) {
+    if (job_index >= get_values_len(output) / (BATCH_SIZE + 1)) {
         return job_index * (BATCH_SIZE + 1) + BATCH_SIZE;
     }
 #endif
 
     const Node* node = get_node(output);
 #ifdef OpConv
-    uint8_t is_conv = (node->op_type == OpConv);
+    // Input-stationary and grouped Conv write outputs in the order of offsets like other operators
+    uint8_t is_conv = (node->op_type == OpConv && node->flags.extra.conv.dataflow != CONV_DATAFLOW_INPUT_STATIONARY &&
+                       node->flags.extra.conv.group == 1);
 #else
     uint8_t is_conv = 0;
 #endif
@@ -244,15 +243,140 @@ uint32_t batch_start(uint32_t batch_end_offset) {
 
 #if INDIRECT_RECOVERY
 
-static uint8_t after_recovery = 1;
+static PLAT_THREAD_LOCAL uint8_t after_recovery = 1;
+
+// Number of values in a job, which ends with a value with states (see offset_has_state())
+#if JAPARI
+#define JOB_LEN (BATCH_SIZE + 1)
+#else
+#define JOB_LEN BATCH_SIZE
+#endif
+
+static uint8_t value_finished(Model* model, const ParameterInfo* output, uint32_t job_index) {
+    uint32_t offset = job_index_to_offset(output, job_index);
+    int16_t val = get_q15_param(model, output, offset);
+#if ENABLE_COUNTERS
+    add_counter(offsetof(Counters, recovery_reads), 1);
+    add_counter(offsetof(Counters, recovery_bytes), sizeof(int16_t));
+#endif
+    return job_value_finished(model, output, job_index, offset, val);
+}
+
+#if RECOVERY_BLOCK_LEN
+// Find the first unfinished job in [begin_job_index, end_job_index), or end_job_index if all of them finished,
+// with one NVM read for values of all these jobs. Returns 0 if these values are not within RECOVERY_BLOCK_LEN values.
+static uint8_t find_unfinished_job_in_block(Model* model, const ParameterInfo* output, uint32_t begin_job_index, uint32_t end_job_index, uint32_t* first_unfinished_job_index) {
+    if (begin_job_index == end_job_index) {
+        *first_unfinished_job_index = end_job_index;
+        return 1;
+    }
+    uint32_t block_begin = job_index_to_offset(output, begin_job_index),
+             block_end = job_index_to_offset(output, end_job_index - 1) + 1;
+    if (block_end <= block_begin || block_end - block_begin > RECOVERY_BLOCK_LEN) {
+        return 0;
+    }
+    int16_t block[RECOVERY_BLOCK_LEN];
+    uint16_t block_len = block_end - block_begin;
+    my_memcpy_from_param(model, block, output, block_begin, block_len * sizeof(int16_t));
+#if ENABLE_COUNTERS
+    add_counter(offsetof(Counters, recovery_reads), 1);
+    add_counter(offsetof(Counters, recovery_bytes), block_len * sizeof(int16_t));
+#endif
+    my_printf_debug("Read values of jobs [%" PRId32 ", %" PRId32 ") at once" NEWLINE, begin_job_index, end_job_index);
+    for (uint32_t job_index = begin_job_index; job_index < end_job_index; job_index++) {
+        uint32_t offset = job_index_to_offset(output, job_index);
+        uint8_t finished;
+        if (offset >= block_begin && offset < block_end) {
+            finished = job_value_finished(model, output, job_index, offset, block[offset - block_begin]);
+        } else {
+            // Jobs in different tiles of convolution may not be contiguous
+            finished = value_finished(model, output, job_index);
+        }
+        if (!finished) {
+            *first_unfinished_job_index = job_index;
+            return 1;
+        }
+    }
+    *first_unfinished_job_index = end_job_index;
+    return 1;
+}
+#endif
+
+#if PROGRESS_HINT_INTERVAL
+// Jobs are counted for the output of the layer in which run_recovery() is called last
+static const uint16_t INVALID_PARAMETER_INFO_IDX = 0xffff;
+static PLAT_THREAD_LOCAL uint16_t progress_parameter_info_idx = INVALID_PARAMETER_INFO_IDX;
+static PLAT_THREAD_LOCAL ProgressHint progress_hint_vm;
+
+static void start_counting_jobs(const Model *model, const ParameterInfo *output, uint32_t first_unfinished_job_index) {
+    progress_parameter_info_idx = output->parameter_info_idx;
+    progress_hint_vm.layer_idx = model->layer_idx;
+    progress_hint_vm.n_finished_jobs = first_unfinished_job_index;
+}
+
+void record_job_progress(const ParameterInfo *param, uint16_t offset_in_word, size_t n) {
+    if (param->parameter_info_idx != progress_parameter_info_idx) {
+        return;
+    }
+    uint32_t end_offset = offset_in_word + n / sizeof(int16_t);
+    uint16_t prev_n_finished_jobs = progress_hint_vm.n_finished_jobs;
+    progress_hint_vm.n_finished_jobs += end_offset / JOB_LEN - offset_in_word / JOB_LEN;
+    if (progress_hint_vm.n_finished_jobs / PROGRESS_HINT_INTERVAL == prev_n_finished_jobs / PROGRESS_HINT_INTERVAL) {
+        return;
+    }
+    // After values of jobs are written, so that the hint does not go beyond progress on NVM
+    write_to_nvm(&progress_hint_vm, PROGRESS_HINT_OFFSET, sizeof(ProgressHint));
+#if ENABLE_COUNTERS
+    add_counter(offsetof(Counters, progress_hint_preservation), sizeof(ProgressHint));
+#endif
+    my_printf_debug("Write progress hint %d for layer %d" NEWLINE, progress_hint_vm.n_finished_jobs, progress_hint_vm.layer_idx);
+}
+
+// Narrow down the range of binary search with the progress hint. As value_finished() is checked before
+// using the hint, progress seeking is correct even if the hint is stale or partially written
+static void apply_progress_hint(Model *model, const ParameterInfo *output, uint32_t *cur_begin_job_index, uint32_t *cur_end_job_index) {
+    ProgressHint hint;
+    read_from_nvm(&hint, PROGRESS_HINT_OFFSET, sizeof(ProgressHint));
+    my_printf_debug("Progress hint %d for layer %d" NEWLINE, hint.n_finished_jobs, hint.layer_idx);
+    if (hint.layer_idx != model->layer_idx || hint.n_finished_jobs == 0 || hint.n_finished_jobs >= *cur_end_job_index) {
+        return;
+    }
+    uint32_t last_hinted_job_index = hint.n_finished_jobs - 1;
+    if (!value_finished(model, output, last_hinted_job_index)) {
+        *cur_end_job_index = last_hinted_job_index;
+        return;
+    }
+    *cur_begin_job_index = last_hinted_job_index;
+    // Unless writing the next hint is interrupted, at most PROGRESS_HINT_INTERVAL jobs finished after the hint
+    uint32_t bound_job_index = hint.n_finished_jobs + PROGRESS_HINT_INTERVAL;
+    if (bound_job_index >= *cur_end_job_index) {
+        return;
+    }
+    if (value_finished(model, output, bound_job_index)) {
+        *cur_begin_job_index = bound_job_index;
+    } else {
+        *cur_end_job_index = bound_job_index;
+    }
+}
+#endif
+
+void reset_recovery_state(void) {
+    after_recovery = 1;
+#if PROGRESS_HINT_INTERVAL
+    progress_parameter_info_idx = INVALID_PARAMETER_INFO_IDX;
+#endif
+}
 
 uint32_t run_recovery(Model *model, ParameterInfo *output) {
     if (!after_recovery) {
+#if PROGRESS_HINT_INTERVAL
+        start_counting_jobs(model, output, 0);
+#endif
         return 0;
     }
 
     // recovery from state bits
-    uint32_t end_job_index = output->params_len / 2;
+    uint32_t end_job_index = get_values_len(output);
 #if JAPARI
     end_job_index /= (BATCH_SIZE + 1);
 #endif
@@ -264,7 +388,19 @@ uint32_t run_recovery(Model *model, ParameterInfo *output) {
     my_printf_debug("new_output_state_bit for first value = %d" NEWLINE, -param_state_bit(model, output, 0));
     dump_turning_points_debug(model, output);
 
+#if PROGRESS_HINT_INTERVAL
+    apply_progress_hint(model, output, &cur_begin_job_index, &cur_end_job_index);
+#endif
+
     while (1) {
+#if RECOVERY_BLOCK_LEN
+        // Values of remaining jobs may be read at once if they are contiguous. The job at
+        // cur_end_job_index is known to be unfinished unless it is end_job_index
+        if (cur_end_job_index - cur_begin_job_index <= RECOVERY_BLOCK_LEN / JOB_LEN &&
+            find_unfinished_job_in_block(model, output, cur_begin_job_index, cur_end_job_index, &first_unfinished_job_index)) {
+            break;
+        }
+#endif
         if (cur_end_job_index - cur_begin_job_index <= 1) {
             if (!value_finished(model, output, cur_begin_job_index)) {
                 first_unfinished_job_index = 0;
@@ -299,7 +435,11 @@ uint32_t run_recovery(Model *model, ParameterInfo *output) {
         after_recovery = 0;
     }
 
-    check_feature_map_states(model, output, first_unfinished_job_index, output->params_len / 2, __func__);
+    check_feature_map_states(model, output, first_unfinished_job_index, get_values_len(output), __func__);
+
+#if PROGRESS_HINT_INTERVAL
+    start_counting_jobs(model, output, first_unfinished_job_index);
+#endif
 
     return first_unfinished_job_index;
 }
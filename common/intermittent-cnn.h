@@ -38,6 +38,22 @@ static inline void strip_state(int16_t* val) {
     *val -= (*val & 0x8000) + 0x4000;
 }
 #endif
+
+/* 8-bit intermediate values are the upper 8 bits of q15 values. The arithmetic shift keeps the sign bit, which
+ * is the state bit of Stateful, and footprints of JAPARI are small integers stored as they are */
+static inline int8_t narrow_intermediate_value(int16_t val, uint16_t offset) {
+    if (JAPARI && offset_has_state(offset)) {
+        return static_cast<int8_t>(val);
+    }
+    return static_cast<int8_t>(val >> 8);
+}
+
+static inline int16_t widen_intermediate_value(int8_t val, uint16_t offset) {
+    if (JAPARI && offset_has_state(offset)) {
+        return val;
+    }
+    return static_cast<int16_t>(val * (1 << 8));
+}
 #if JAPARI
 static inline void check_footprint(int16_t val) {
     // -255 and 255 happens when only the first byte of a footprint is written
@@ -57,5 +73,12 @@ int8_t param_state_bit(Model *model, const ParameterInfo *param, uint16_t offset
 
 uint32_t run_recovery(Model *model, ParameterInfo *output);
 #if INDIRECT_RECOVERY
+// Make the next run_recovery() search for progress again, as if the device has just rebooted
+void reset_recovery_state(void);
 void flip_state_bit(Model *model, const ParameterInfo *output);
 #endif
+#if INDIRECT_RECOVERY && PROGRESS_HINT_INTERVAL
+// Count jobs of the current layer finished by writing n bytes at offset_in_word of param, and
+// write a progress hint every PROGRESS_HINT_INTERVAL jobs
+void record_job_progress(const ParameterInfo *param, uint16_t offset_in_word, size_t n);
+#endif
@@ -0,0 +1,108 @@
+#include "data.h"
+
+#if MODEL_BUNDLE
+
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#ifdef __linux__
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+#include "cnn_common.h"
+#include "model_bundle.h"
+#include "my_debug.h"
+#include "platform.h"
+
+const ModelBundleHeader *model_bundle = nullptr;
+
+static uint8_t check_model_bundle(const ModelBundleHeader *header, size_t bundle_len) {
+#define CHECK_BUNDLE(cond, ...) do { if (!(cond)) { my_printf(__VA_ARGS__); my_printf(NEWLINE); return 0; } } while (0)
+    CHECK_BUNDLE(bundle_len >= sizeof(ModelBundleHeader) && !memcmp(header->magic, "SCNNBNDL", sizeof(header->magic)), "Not a model bundle");
+    CHECK_BUNDLE(header->version == MODEL_BUNDLE_VERSION && header->header_len == sizeof(ModelBundleHeader),
+                 "Unsupported model bundle version %d", static_cast<int>(header->version));
+
+    CHECK_BUNDLE(!strncmp(header->method, METHOD, sizeof(header->method)) && header->batch_size == BATCH_SIZE,
+                 "The model bundle is for %.*s with batch size=%d, while the simulator is built for " METHOD " with batch size=%d",
+                 static_cast<int>(sizeof(header->method)), header->method, static_cast<int>(header->batch_size), BATCH_SIZE);
+    CHECK_BUNDLE(header->lea_buffer_size == LEA_BUFFER_SIZE && header->use_arm_cmsis == USE_ARM_CMSIS,
+                 "The model bundle is for another target");
+    CHECK_BUNDLE(header->op_filters == OP_FILTERS,
+                 "The model bundle is for OP_FILTERS=%d, while the simulator is built for OP_FILTERS=%d. Rebuild the simulator after transform.py",
+                 static_cast<int>(header->op_filters), OP_FILTERS);
+
+    for (uint8_t section_id = 0; section_id < MODEL_BUNDLE_SECTIONS_LEN; section_id++) {
+        const ModelBundleSection *section = header->sections + section_id;
+        // Sections are used as arrays of structs in place
+        CHECK_BUNDLE(section->offset % 8 == 0 && section->offset <= bundle_len && section->len <= bundle_len - section->offset,
+                     "Invalid section %d in the model bundle", section_id);
+    }
+
+    CHECK_BUNDLE(header->model_nodes_len <= MAX_MODEL_NODES_LEN && header->num_slots <= MAX_NUM_SLOTS,
+                 "The model is too large for the simulator");
+    // Also checks constants for struct layouts (ex: NODE_NAME_LEN and NUM_INPUTS)
+    const ModelBundleSection *sections = header->sections;
+    CHECK_BUNDLE(sections[MODEL_BUNDLE_MODEL].len == sizeof(Model) &&
+                 sections[MODEL_BUNDLE_NODES].len == header->model_nodes_len * sizeof(Node) &&
+                 sections[MODEL_BUNDLE_MODEL_PARAMETERS_INFO].len == header->n_input * sizeof(ParameterInfo) &&
+                 sections[MODEL_BUNDLE_INTERMEDIATE_PARAMETERS_INFO].len == header->model_nodes_len * sizeof(ParameterInfo),
+                 "Unexpected sizes of the model in the bundle");
+    CHECK_BUNDLE(sections[MODEL_BUNDLE_SAMPLES].len >= sections[MODEL_BUNDLE_LABELS].len * 2 * header->total_sample_size,
+                 "Missing samples in the model bundle");
+#undef CHECK_BUNDLE
+
+    return 1;
+}
+
+uint8_t load_model_bundle(const char *path) {
+    const uint8_t *bundle;
+    size_t bundle_len;
+#ifdef __linux__
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        perror(path);
+        return 0;
+    }
+    struct stat stat_buf;
+    fstat(fd, &stat_buf);
+    bundle_len = stat_buf.st_size;
+    // Read-only, so that accidental writes to model data crash
+    void *mapped = mmap(NULL, bundle_len, PROT_READ, MAP_PRIVATE | MAP_POPULATE, fd, 0);
+    close(fd);
+    if (mapped == MAP_FAILED) {
+        perror("mmap() failed");
+        return 0;
+    }
+    bundle = reinterpret_cast<const uint8_t*>(mapped);
+#else
+    std::ifstream bundle_file(path, std::ios::binary | std::ios::ate);
+    if (!bundle_file.good()) {
+        my_printf("Failed to open %s" NEWLINE, path);
+        return 0;
+    }
+    bundle_len = bundle_file.tellg();
+    uint8_t *buffer = new uint8_t[bundle_len];
+    bundle_file.seekg(0);
+    bundle_file.read(reinterpret_cast<char*>(buffer), bundle_len);
+    bundle = buffer;
+#endif
+
+    const ModelBundleHeader *header = reinterpret_cast<const ModelBundleHeader*>(bundle);
+    if (!check_model_bundle(header, bundle_len)) {
+        return 0;
+    }
+    model_bundle = header;
+
+    if (PROGRESS_HINT_OFFSET <= SAMPLES_OFFSET + SAMPLES_DATA_LEN) {
+        my_printf("Incorrect NVM layout" NEWLINE);
+        model_bundle = nullptr;
+        return 0;
+    }
+
+    my_printf_debug("Loaded model %s from %s" NEWLINE, CONFIG, path);
+    return 1;
+}
+
+#endif
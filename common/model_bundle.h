@@ -0,0 +1,101 @@
+#pragma once
+
+#include <stdint.h>
+
+/**
+ * A model in a versioned binary file (transform.py --bundle), which is mapped into
+ * memory by the simulator on PC. Nodes, parameters and other data are used in place.
+ *
+ * With a bundle, data.h from transform.py depends on the intermittent inference
+ * approach, the batch size, the target and OP_FILTERS only. Other values depending
+ * on the model are defined below with the bundle header, so that one build runs
+ * any model with the same data.h.
+ */
+
+#if defined(__MSP430__) || defined(__MSP432__)
+#error "Model bundles are for PC only"
+#endif
+
+#define MODEL_BUNDLE_VERSION 9
+
+// Should match write_model_bundle() in transform.py
+enum ModelBundleSectionId {
+    MODEL_BUNDLE_PARAMETERS,
+    MODEL_BUNDLE_SAMPLES,
+    MODEL_BUNDLE_MODEL,
+    MODEL_BUNDLE_NODES,
+    MODEL_BUNDLE_MODEL_PARAMETERS_INFO,
+    MODEL_BUNDLE_INTERMEDIATE_PARAMETERS_INFO,
+    MODEL_BUNDLE_LABELS,
+    MODEL_BUNDLE_FIRST_SAMPLE_OUTPUTS,
+    MODEL_BUNDLE_SECTIONS_LEN,
+};
+
+struct ModelBundleSection {
+    uint32_t offset; // from the start of the bundle
+    uint32_t len;
+};
+
+struct ModelBundleHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t header_len;
+    // Checked against data.h, as they are compile-time constants
+    char method[16];
+    uint32_t batch_size;
+    uint32_t lea_buffer_size;
+    uint32_t use_arm_cmsis;
+    // For the model. op_filters is also checked against data.h
+    char config[16];
+    uint32_t model_nodes_len;
+    uint32_t n_input;
+    uint32_t num_slots;
+    uint32_t intermediate_values_size;
+    uint32_t nvm_size;
+    uint32_t n_samples;
+    uint32_t n_all_samples;
+    uint32_t total_sample_size;
+    uint32_t op_filters;
+    float fp32_accuracy;
+    ModelBundleSection sections[MODEL_BUNDLE_SECTIONS_LEN];
+};
+
+static_assert(sizeof(ModelBundleHeader) == 100 + 8 * MODEL_BUNDLE_SECTIONS_LEN, "Unexpected size for ModelBundleHeader");
+
+extern const ModelBundleHeader *model_bundle;
+
+static inline const uint8_t *model_bundle_section(uint8_t section_id) {
+    return reinterpret_cast<const uint8_t*>(model_bundle) + model_bundle->sections[section_id].offset;
+}
+
+// Returns 0 if the bundle cannot be loaded or does not match this build
+uint8_t load_model_bundle(const char *path);
+
+#define CONFIG (model_bundle->config)
+#define MODEL_NODES_LEN static_cast<uint16_t>(model_bundle->model_nodes_len)
+#define N_INPUT static_cast<uint16_t>(model_bundle->n_input)
+#define NUM_SLOTS static_cast<uint8_t>(model_bundle->num_slots)
+#define INTERMEDIATE_VALUES_SIZE static_cast<long>(model_bundle->intermediate_values_size)
+#define NVM_SIZE (model_bundle->nvm_size)
+#define N_SAMPLES (model_bundle->n_samples)
+#define N_ALL_SAMPLES (model_bundle->n_all_samples)
+#define TOTAL_SAMPLE_SIZE (model_bundle->total_sample_size)
+#define FP32_ACCURACY (model_bundle->fp32_accuracy)
+
+#define parameters_data model_bundle_section(MODEL_BUNDLE_PARAMETERS)
+#define PARAMETERS_DATA_LEN (model_bundle->sections[MODEL_BUNDLE_PARAMETERS].len)
+// All samples, as samples.bin without bundles
+#define samples_data model_bundle_section(MODEL_BUNDLE_SAMPLES)
+#define SAMPLES_DATA_LEN (model_bundle->sections[MODEL_BUNDLE_SAMPLES].len)
+#define model_data model_bundle_section(MODEL_BUNDLE_MODEL)
+#define MODEL_DATA_LEN (model_bundle->sections[MODEL_BUNDLE_MODEL].len)
+#define nodes_data model_bundle_section(MODEL_BUNDLE_NODES)
+#define NODES_DATA_LEN (model_bundle->sections[MODEL_BUNDLE_NODES].len)
+#define model_parameters_info_data model_bundle_section(MODEL_BUNDLE_MODEL_PARAMETERS_INFO)
+#define MODEL_PARAMETERS_INFO_DATA_LEN (model_bundle->sections[MODEL_BUNDLE_MODEL_PARAMETERS_INFO].len)
+#define intermediate_parameters_info_data model_bundle_section(MODEL_BUNDLE_INTERMEDIATE_PARAMETERS_INFO)
+#define INTERMEDIATE_PARAMETERS_INFO_DATA_LEN (model_bundle->sections[MODEL_BUNDLE_INTERMEDIATE_PARAMETERS_INFO].len)
+#define labels_data model_bundle_section(MODEL_BUNDLE_LABELS)
+#define LABELS_DATA_LEN (model_bundle->sections[MODEL_BUNDLE_LABELS].len)
+#define first_sample_outputs reinterpret_cast<const float*>(model_bundle_section(MODEL_BUNDLE_FIRST_SAMPLE_OUTPUTS))
+#define FIRST_SAMPLE_OUTPUTS_LEN (model_bundle->sections[MODEL_BUNDLE_FIRST_SAMPLE_OUTPUTS].len / sizeof(float))
@@ -44,7 +44,7 @@ static void print_q15(LayerOutput* layer_out, int16_t val, const ValueInfo& val_
 }
 
 void dump_value(Model *model, const ParameterInfo *cur_param, LayerOutput* layer_out, size_t offset, bool has_state) {
-    if (cur_param->bitwidth == 16) {
+    if (cur_param->bitwidth == 16 || cur_param->bitwidth == 8) {
         print_q15(layer_out, get_q15_param(model, cur_param, offset), ValueInfo(cur_param, model), has_state);
     } else if (cur_param->bitwidth == 64) {
         my_printf("%" PRId64 " ", get_int64_param(cur_param, offset));
@@ -117,7 +117,7 @@ static void extract_dimensions(const ParameterInfo* cur_param, uint16_t* NUM, ui
     }
 
     // find real num
-    uint32_t expected_params_len = sizeof(int16_t);
+    uint32_t expected_params_len = cur_param->bitwidth / 8;
     for (uint8_t idx = 0; idx < 4; idx++) {
         if (cur_param->dims[idx]) {
             expected_params_len *= cur_param->dims[idx];
@@ -245,7 +245,7 @@ void dump_matrix(const int16_t *mat, size_t rows, size_t cols, const ValueInfo&
 }
 
 static const uint16_t BUFFER_TEMP_SIZE = 256;
-static int16_t buffer_temp[BUFFER_TEMP_SIZE];
+static PLAT_THREAD_LOCAL int16_t buffer_temp[BUFFER_TEMP_SIZE];
 
 void compare_vm_nvm_impl(int16_t* vm_data, Model* model, const ParameterInfo* output, uint16_t output_offset, uint16_t blockSize) {
     check_buffer_address(vm_data, blockSize);
@@ -254,7 +254,12 @@ void compare_vm_nvm_impl(int16_t* vm_data, Model* model, const ParameterInfo* ou
     memset(buffer_temp, 0, blockSize * sizeof(int16_t));
     my_memcpy_from_param(model, buffer_temp, output, output_offset, blockSize * sizeof(int16_t));
     for (uint16_t idx = 0; idx < blockSize; idx++) {
-        MY_ASSERT_ALWAYS(vm_data[idx] == buffer_temp[idx]);
+        int16_t expected = vm_data[idx];
+        if (output->bitwidth == 8) {
+            // Only upper 8 bits are kept in NVM
+            expected = widen_intermediate_value(narrow_intermediate_value(expected, output_offset + idx), output_offset + idx);
+        }
+        MY_ASSERT_ALWAYS(expected == buffer_temp[idx]);
     }
 }
 
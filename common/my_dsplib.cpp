@@ -13,6 +13,23 @@
 #include "my_debug.h"
 #include "op_utils.h"
 
+#ifndef USE_NATIVE_DSP
+#define USE_NATIVE_DSP 0
+#endif
+
+/**
+ * The native backend (-DUSE_NATIVE_DSP=ON for PC builds) follows the semantics of
+ * ARM CMSIS. For models converted for TI DSPLib, only functions whose behaviors are
+ * fully defined in this file or the DSPLib patch (wrapping addition, fill, max and min)
+ * use it.
+ */
+#if USE_NATIVE_DSP
+#include "native_dsp.h"
+#define NATIVE_DSP_FOR_CMSIS USE_ARM_CMSIS
+#else
+#define NATIVE_DSP_FOR_CMSIS 0
+#endif
+
 #if !USE_ARM_CMSIS
 #if MY_DEBUG >= MY_DEBUG_NORMAL
 #define my_checkStatus(expr) do { \
@@ -31,7 +48,11 @@ void check_buffer_address(const int16_t* addr, uint32_t blockSize) {
 }
 
 void my_add_q15(const int16_t *pSrcA, const int16_t *pSrcB, int16_t *pDst, uint32_t blockSize) {
-#if !USE_ARM_CMSIS
+#if NATIVE_DSP_FOR_CMSIS
+    native_add_q15_sat(pSrcA, pSrcB, pDst, blockSize);
+#elif USE_NATIVE_DSP
+    native_add_q15(pSrcA, pSrcB, pDst, blockSize);
+#elif !USE_ARM_CMSIS
     // XXX Not using LEA as pSrcA and pSrcB may not be 4-byte aligned (e.g., cifar10 with JAPARI/B=2)
     while (blockSize--) {
         *pDst++ = (*pSrcA++) + (*pSrcB++);
@@ -43,7 +64,9 @@ void my_add_q15(const int16_t *pSrcA, const int16_t *pSrcB, int16_t *pDst, uint3
 
 void my_fill_q15(int16_t value, int16_t *pDst, uint32_t blockSize) {
     check_buffer_address(pDst, blockSize);
-#if !USE_ARM_CMSIS
+#if USE_NATIVE_DSP
+    native_fill_q15(value, pDst, blockSize);
+#elif !USE_ARM_CMSIS
     uint32_t blockSizeForLEA = blockSize / 2 * 2;
     if (blockSizeForLEA) {
         msp_fill_q15_params fill_params;
@@ -60,7 +83,9 @@ void my_fill_q15(int16_t value, int16_t *pDst, uint32_t blockSize) {
 }
 
 void my_offset_q15(const int16_t *pSrc, int16_t offset, int16_t *pDst, uint32_t blockSize) {
-#if !USE_ARM_CMSIS
+#if NATIVE_DSP_FOR_CMSIS
+    native_offset_q15_sat(pSrc, offset, pDst, blockSize);
+#elif !USE_ARM_CMSIS
     // XXX: the alignment adjustment code in this function only supports pSrc == pDst
     MY_ASSERT(pSrc == pDst);
     // if pSrc is not 4-byte aligned...
@@ -89,6 +114,28 @@ void my_offset_q15(const int16_t *pSrc, int16_t offset, int16_t *pDst, uint32_t
 #endif
 }
 
+void my_mpy_q15(const int16_t *pSrcA, const int16_t *pSrcB, int16_t *pDst, uint32_t blockSize) {
+#if NATIVE_DSP_FOR_CMSIS
+    native_mpy_q15_sat(pSrcA, pSrcB, pDst, blockSize);
+#elif !USE_ARM_CMSIS
+    check_buffer_address(pSrcA, blockSize);
+    check_buffer_address(pSrcB, blockSize);
+    check_buffer_address(pDst, blockSize);
+    // LEA does not like zero-sized blocks
+    uint16_t block_size_for_lea = blockSize / 2 * 2;
+    if (block_size_for_lea) {
+        msp_mpy_q15_params mpy_params;
+        mpy_params.length = block_size_for_lea;
+        my_checkStatus(msp_mpy_q15(&mpy_params, pSrcA, pSrcB, pDst));
+    }
+    if (blockSize % 2) {
+        pDst[blockSize - 1] = (static_cast<int32_t>(pSrcA[blockSize - 1]) * pSrcB[blockSize - 1]) >> 15;
+    }
+#else
+    arm_mult_q15(pSrcA, pSrcB, pDst, blockSize);
+#endif
+}
+
 void my_max_q15(const int16_t *pSrc, uint32_t blockSize, int16_t *pResult, uint16_t *pIndex) {
     uint8_t unaligned = 0;
     if ((pSrc - lea_buffer) % 2) {
@@ -97,7 +144,10 @@ void my_max_q15(const int16_t *pSrc, uint32_t blockSize, int16_t *pResult, uint1
         MY_ASSERT(blockSize > 0);
         blockSize--;
     }
-#if !USE_ARM_CMSIS
+#if USE_NATIVE_DSP
+    // Both TI DSPLib (patched) and ARM CMSIS return the first index among equal values
+    native_max_q15(pSrc, blockSize, pResult, pIndex);
+#elif !USE_ARM_CMSIS
     uint32_t blockSizeForLEA = blockSize / 2 * 2;
     if (blockSizeForLEA) {
         msp_max_q15_params max_params;
@@ -134,7 +184,10 @@ void my_min_q15(const int16_t *pSrc, uint32_t blockSize, int16_t *pResult, uint1
         MY_ASSERT(blockSize > 0);
         blockSize--;
     }
-#if !USE_ARM_CMSIS
+#if USE_NATIVE_DSP
+    // Both TI DSPLib (patched) and ARM CMSIS return the first index among equal values
+    native_min_q15(pSrc, blockSize, pResult, pIndex);
+#elif !USE_ARM_CMSIS
     uint32_t blockSizeForLEA = blockSize / 2 * 2;
     if (blockSizeForLEA) {
         msp_min_q15_params min_params;
@@ -163,8 +216,20 @@ void my_min_q15(const int16_t *pSrc, uint32_t blockSize, int16_t *pResult, uint1
     }
 }
 
-#if USE_ARM_CMSIS
-static int16_t pState[ARM_PSTATE_LEN];
+#if NATIVE_DSP_FOR_CMSIS
+#if STATEFUL
+// The same as state_enforcement in the patched arm_mat_mult_fast_q15
+static void enforce_states(int16_t *pDst, uint32_t len, int16_t offset, int16_t n_keep_state_bits) {
+    uint8_t cur_state = (offset < 0);
+    for (uint32_t idx = BATCH_SIZE - 1; idx < len; idx += BATCH_SIZE) {
+        cur_state ^= (!n_keep_state_bits);
+        pDst[idx] = (pDst[idx] & 0x7fff) | (cur_state << 15);
+        n_keep_state_bits -= BATCH_SIZE;
+    }
+}
+#endif
+#elif USE_ARM_CMSIS
+static PLAT_THREAD_LOCAL int16_t pState[ARM_PSTATE_LEN];
 #endif
 
 void my_matrix_mpy_q15(uint16_t A_rows, uint16_t A_cols, uint16_t B_rows, uint16_t B_cols, int16_t *pSrcA, int16_t *pSrcB, int16_t *pDst, ParameterInfo *param, uint16_t offset_in_word, size_t values_to_preserve, uint16_t mask, int16_t n_keep_state_bits) {
@@ -184,6 +249,15 @@ void my_matrix_mpy_q15(uint16_t A_rows, uint16_t A_cols, uint16_t B_rows, uint16
     matrix_mpy_params.srcBRows = B_rows;
     matrix_mpy_params.srcBCols = B_cols;
     my_checkStatus(msp_matrix_mpy_q15(&matrix_mpy_params, pSrcA, pSrcB, pDst, my_memcpy_to_param, param, offset_in_word, values_to_preserve, mask, n_keep_state_bits));
+#elif NATIVE_DSP_FOR_CMSIS
+    native_matrix_mpy_q15(A_rows, A_cols, B_cols, pSrcA, pSrcB, pDst);
+#if STATEFUL
+    enforce_states(pDst, A_rows * B_cols, static_cast<int16_t>(mask), n_keep_state_bits);
+#endif
+    // Like data_preservation_func in patched DSP libraries, preserve results after computation
+    if (param) {
+        my_memcpy_to_param(param, offset_in_word, pDst, values_to_preserve * sizeof(int16_t), 0);
+    }
 #else
     arm_matrix_instance_q15 A, B, C;
     arm_mat_init_q15(&A, A_rows, A_cols, pSrcA);
@@ -201,12 +275,14 @@ void my_matrix_mpy_q15(uint16_t A_rows, uint16_t A_cols, uint16_t B_rows, uint16
 #endif
 #endif
 #if ENABLE_COUNTERS
-    counters()->macs += A_rows * B_cols * A_cols;
+    add_counter(offsetof(Counters, macs), A_rows * B_cols * A_cols);
 #endif
 }
 
 void my_scale_q15(const int16_t *pSrc, int16_t scaleFract, uint8_t shift, int16_t *pDst, uint32_t blockSize) {
-#if !USE_ARM_CMSIS
+#if NATIVE_DSP_FOR_CMSIS
+    native_scale_q15_sat(pSrc, scaleFract, shift, pDst, blockSize);
+#elif !USE_ARM_CMSIS
     uint32_t blockSizeForLEA = blockSize / 2 * 2;
     if (blockSizeForLEA) {
         msp_scale_q15_params scale_params;
@@ -243,6 +319,35 @@ void my_deinterleave_q15(const int16_t *pSrc, uint16_t channel, uint16_t numChan
     }
 }
 
+void my_strip_states_q15(int16_t *pData, uint32_t blockSize, uint16_t phase, uint16_t stride, bool rescale) {
+#if USE_NATIVE_DSP
+    native_strip_states_q15(pData, blockSize, phase, stride, rescale);
+#else
+    for (uint32_t idx = stride - 1 - phase % stride; idx < blockSize; idx += stride) {
+        // The same as strip_state()
+        pData[idx] -= (pData[idx] & 0x8000) + 0x4000;
+    }
+    if (rescale) {
+        for (uint32_t idx = 0; idx < blockSize; idx++) {
+            pData[idx] *= 2;
+        }
+    }
+#endif
+}
+
+void my_update_states_q15(int16_t *pData, uint32_t blockSize, uint16_t phase, uint16_t stride, int16_t offset, bool set_state, uint16_t state_mask) {
+#if USE_NATIVE_DSP
+    native_update_states_q15(pData, blockSize, phase, stride, offset, set_state, state_mask);
+#else
+    for (uint32_t idx = stride - 1 - phase % stride; idx < blockSize; idx += stride) {
+        pData[idx] += offset;
+        if (set_state) {
+            pData[idx] = (pData[idx] & 0x7fff) | state_mask;
+        }
+    }
+#endif
+}
+
 int16_t padding_for_lea(int16_t val) {
     // LEA requires parameters to be even in many places
     return (val + 1) / 2 * 2;
@@ -0,0 +1,456 @@
+#include <algorithm>
+#include <cstring>
+#include "native_dsp.h"
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#define NATIVE_AVX2 1
+#define NATIVE_SSE2 1
+#elif defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#define NATIVE_SSE2 1
+#elif defined(__ARM_NEON)
+#include <arm_neon.h>
+#define NATIVE_NEON 1
+#endif
+
+#ifndef NATIVE_AVX2
+#define NATIVE_AVX2 0
+#endif
+#ifndef NATIVE_SSE2
+#define NATIVE_SSE2 0
+#endif
+#ifndef NATIVE_NEON
+#define NATIVE_NEON 0
+#endif
+
+static inline int16_t saturate_q15(int32_t val) {
+    return static_cast<int16_t>(std::min(std::max(val, static_cast<int32_t>(INT16_MIN)), static_cast<int32_t>(INT16_MAX)));
+}
+
+#if NATIVE_SSE2
+static inline __m128i load_128(const int16_t *addr) {
+    return _mm_loadu_si128(reinterpret_cast<const __m128i*>(addr));
+}
+
+static inline void store_128(int16_t *addr, __m128i val) {
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(addr), val);
+}
+#endif
+
+#if NATIVE_AVX2
+static inline __m256i load_256(const int16_t *addr) {
+    return _mm256_loadu_si256(reinterpret_cast<const __m256i*>(addr));
+}
+
+static inline void store_256(int16_t *addr, __m256i val) {
+    _mm256_storeu_si256(reinterpret_cast<__m256i*>(addr), val);
+}
+#endif
+
+void native_add_q15(const int16_t *pSrcA, const int16_t *pSrcB, int16_t *pDst, uint32_t blockSize) {
+    uint32_t idx = 0;
+#if NATIVE_AVX2
+    for (; idx + 16 <= blockSize; idx += 16) {
+        store_256(pDst + idx, _mm256_add_epi16(load_256(pSrcA + idx), load_256(pSrcB + idx)));
+    }
+#endif
+#if NATIVE_SSE2
+    for (; idx + 8 <= blockSize; idx += 8) {
+        store_128(pDst + idx, _mm_add_epi16(load_128(pSrcA + idx), load_128(pSrcB + idx)));
+    }
+#elif NATIVE_NEON
+    for (; idx + 8 <= blockSize; idx += 8) {
+        vst1q_s16(pDst + idx, vaddq_s16(vld1q_s16(pSrcA + idx), vld1q_s16(pSrcB + idx)));
+    }
+#endif
+    for (; idx < blockSize; idx++) {
+        pDst[idx] = static_cast<int16_t>(pSrcA[idx] + pSrcB[idx]);
+    }
+}
+
+void native_add_q15_sat(const int16_t *pSrcA, const int16_t *pSrcB, int16_t *pDst, uint32_t blockSize) {
+    uint32_t idx = 0;
+#if NATIVE_AVX2
+    for (; idx + 16 <= blockSize; idx += 16) {
+        store_256(pDst + idx, _mm256_adds_epi16(load_256(pSrcA + idx), load_256(pSrcB + idx)));
+    }
+#endif
+#if NATIVE_SSE2
+    for (; idx + 8 <= blockSize; idx += 8) {
+        store_128(pDst + idx, _mm_adds_epi16(load_128(pSrcA + idx), load_128(pSrcB + idx)));
+    }
+#elif NATIVE_NEON
+    for (; idx + 8 <= blockSize; idx += 8) {
+        vst1q_s16(pDst + idx, vqaddq_s16(vld1q_s16(pSrcA + idx), vld1q_s16(pSrcB + idx)));
+    }
+#endif
+    for (; idx < blockSize; idx++) {
+        pDst[idx] = saturate_q15(pSrcA[idx] + pSrcB[idx]);
+    }
+}
+
+void native_offset_q15_sat(const int16_t *pSrc, int16_t offset, int16_t *pDst, uint32_t blockSize) {
+    uint32_t idx = 0;
+#if NATIVE_AVX2
+    __m256i offset_256 = _mm256_set1_epi16(offset);
+    for (; idx + 16 <= blockSize; idx += 16) {
+        store_256(pDst + idx, _mm256_adds_epi16(load_256(pSrc + idx), offset_256));
+    }
+#endif
+#if NATIVE_SSE2
+    __m128i offset_128 = _mm_set1_epi16(offset);
+    for (; idx + 8 <= blockSize; idx += 8) {
+        store_128(pDst + idx, _mm_adds_epi16(load_128(pSrc + idx), offset_128));
+    }
+#elif NATIVE_NEON
+    int16x8_t offset_128 = vdupq_n_s16(offset);
+    for (; idx + 8 <= blockSize; idx += 8) {
+        vst1q_s16(pDst + idx, vqaddq_s16(vld1q_s16(pSrc + idx), offset_128));
+    }
+#endif
+    for (; idx < blockSize; idx++) {
+        pDst[idx] = saturate_q15(pSrc[idx] + offset);
+    }
+}
+
+void native_scale_q15_sat(const int16_t *pSrc, int16_t scaleFract, uint8_t shift, int16_t *pDst, uint32_t blockSize) {
+    // Same as arm_scale_q15: full 32-bit products, arithmetic right shift and then saturation
+    int8_t kShift = 15 - shift;
+    uint32_t idx = 0;
+#if NATIVE_SSE2
+    __m128i scale_128 = _mm_set1_epi16(scaleFract);
+    __m128i shift_128 = _mm_cvtsi32_si128(kShift);
+    for (; idx + 8 <= blockSize; idx += 8) {
+        __m128i src = load_128(pSrc + idx);
+        __m128i product_lo16 = _mm_mullo_epi16(src, scale_128);
+        __m128i product_hi16 = _mm_mulhi_epi16(src, scale_128);
+        __m128i product_0 = _mm_sra_epi32(_mm_unpacklo_epi16(product_lo16, product_hi16), shift_128);
+        __m128i product_1 = _mm_sra_epi32(_mm_unpackhi_epi16(product_lo16, product_hi16), shift_128);
+        store_128(pDst + idx, _mm_packs_epi32(product_0, product_1));
+    }
+#elif NATIVE_NEON
+    int32x4_t shift_128 = vdupq_n_s32(-kShift);
+    for (; idx + 8 <= blockSize; idx += 8) {
+        int16x8_t src = vld1q_s16(pSrc + idx);
+        int32x4_t product_0 = vshlq_s32(vmull_n_s16(vget_low_s16(src), scaleFract), shift_128);
+        int32x4_t product_1 = vshlq_s32(vmull_n_s16(vget_high_s16(src), scaleFract), shift_128);
+        vst1q_s16(pDst + idx, vcombine_s16(vqmovn_s32(product_0), vqmovn_s32(product_1)));
+    }
+#endif
+    for (; idx < blockSize; idx++) {
+        pDst[idx] = saturate_q15((static_cast<int32_t>(pSrc[idx]) * scaleFract) >> kShift);
+    }
+}
+
+void native_mpy_q15_sat(const int16_t *pSrcA, const int16_t *pSrcB, int16_t *pDst, uint32_t blockSize) {
+    // Same as arm_mult_q15: full 32-bit products, arithmetic right shift by 15 and then saturation
+    uint32_t idx = 0;
+#if NATIVE_SSE2
+    for (; idx + 8 <= blockSize; idx += 8) {
+        __m128i a = load_128(pSrcA + idx), b = load_128(pSrcB + idx);
+        __m128i product_lo16 = _mm_mullo_epi16(a, b);
+        __m128i product_hi16 = _mm_mulhi_epi16(a, b);
+        __m128i product_0 = _mm_srai_epi32(_mm_unpacklo_epi16(product_lo16, product_hi16), 15);
+        __m128i product_1 = _mm_srai_epi32(_mm_unpackhi_epi16(product_lo16, product_hi16), 15);
+        store_128(pDst + idx, _mm_packs_epi32(product_0, product_1));
+    }
+#elif NATIVE_NEON
+    for (; idx + 8 <= blockSize; idx += 8) {
+        // (2 * a * b) >> 16 with saturation
+        vst1q_s16(pDst + idx, vqdmulhq_s16(vld1q_s16(pSrcA + idx), vld1q_s16(pSrcB + idx)));
+    }
+#endif
+    for (; idx < blockSize; idx++) {
+        pDst[idx] = saturate_q15((static_cast<int32_t>(pSrcA[idx]) * pSrcB[idx]) >> 15);
+    }
+}
+
+void native_fill_q15(int16_t value, int16_t *pDst, uint32_t blockSize) {
+    // compilers already generate vector stores for this
+    std::fill_n(pDst, blockSize, value);
+}
+
+// Find the extreme value with vector instructions, and then the first index of it
+template<bool find_max>
+static void native_extreme_q15(const int16_t *pSrc, uint32_t blockSize, int16_t *pResult, uint16_t *pIndex) {
+    if (!blockSize) {
+        *pResult = find_max ? INT16_MIN : INT16_MAX;
+        *pIndex = 0;
+        return;
+    }
+    int16_t result = pSrc[0];
+    uint32_t idx = 0;
+#if NATIVE_SSE2
+    if (blockSize >= 8) {
+        __m128i extreme = load_128(pSrc);
+        for (idx = 8; idx + 8 <= blockSize; idx += 8) {
+            __m128i cur = load_128(pSrc + idx);
+            extreme = find_max ? _mm_max_epi16(extreme, cur) : _mm_min_epi16(extreme, cur);
+        }
+        int16_t lanes[8];
+        store_128(lanes, extreme);
+        result = lanes[0];
+        for (uint8_t lane = 1; lane < 8; lane++) {
+            result = find_max ? std::max(result, lanes[lane]) : std::min(result, lanes[lane]);
+        }
+    }
+#elif NATIVE_NEON
+    if (blockSize >= 8) {
+        int16x8_t extreme = vld1q_s16(pSrc);
+        for (idx = 8; idx + 8 <= blockSize; idx += 8) {
+            int16x8_t cur = vld1q_s16(pSrc + idx);
+            extreme = find_max ? vmaxq_s16(extreme, cur) : vminq_s16(extreme, cur);
+        }
+        int16_t lanes[8];
+        vst1q_s16(lanes, extreme);
+        result = lanes[0];
+        for (uint8_t lane = 1; lane < 8; lane++) {
+            result = find_max ? std::max(result, lanes[lane]) : std::min(result, lanes[lane]);
+        }
+    }
+#endif
+    for (; idx < blockSize; idx++) {
+        result = find_max ? std::max(result, pSrc[idx]) : std::min(result, pSrc[idx]);
+    }
+    *pResult = result;
+    *pIndex = static_cast<uint16_t>(std::find(pSrc, pSrc + blockSize, result) - pSrc);
+}
+
+void native_max_q15(const int16_t *pSrc, uint32_t blockSize, int16_t *pResult, uint16_t *pIndex) {
+    native_extreme_q15<true>(pSrc, blockSize, pResult, pIndex);
+}
+
+void native_min_q15(const int16_t *pSrc, uint32_t blockSize, int16_t *pResult, uint16_t *pIndex) {
+    native_extreme_q15<false>(pSrc, blockSize, pResult, pIndex);
+}
+
+/**
+ * Each group of output columns keeps its accumulators in registers while walking
+ * through all rows of B. With SSE2/AVX2, two rows of B are interleaved so that
+ * pmaddwd computes A[k]*B[k][c] + A[k+1]*B[k+1][c] at once. All additions wrap
+ * around in 32 bits as in arm_mat_mult_fast_q15 (the only overflowing case of
+ * pmaddwd, (-32768)*(-32768)*2, also wraps to the same value).
+ */
+void native_matrix_mpy_q15(uint16_t A_rows, uint16_t A_cols, uint16_t B_cols, const int16_t *pSrcA, const int16_t *pSrcB, int16_t *pDst) {
+    for (uint16_t row = 0; row < A_rows; row++) {
+        const int16_t *A_row = pSrcA + row * A_cols;
+        int16_t *C_row = pDst + row * B_cols;
+        uint16_t col = 0;
+#if NATIVE_AVX2
+        for (; col + 16 <= B_cols; col += 16) {
+            __m256i acc_0 = _mm256_setzero_si256(), acc_1 = _mm256_setzero_si256();
+            const int16_t *B_col = pSrcB + col;
+            uint16_t k = 0;
+            for (; k + 2 <= A_cols; k += 2) {
+                int32_t A_pair;
+                memcpy(&A_pair, A_row + k, sizeof(int32_t));
+                __m256i A_pair_256 = _mm256_set1_epi32(A_pair);
+                __m256i B_0 = load_256(B_col + k * B_cols), B_1 = load_256(B_col + (k + 1) * B_cols);
+                acc_0 = _mm256_add_epi32(acc_0, _mm256_madd_epi16(_mm256_unpacklo_epi16(B_0, B_1), A_pair_256));
+                acc_1 = _mm256_add_epi32(acc_1, _mm256_madd_epi16(_mm256_unpackhi_epi16(B_0, B_1), A_pair_256));
+            }
+            if (k < A_cols) {
+                __m256i A_256 = _mm256_set1_epi32(static_cast<uint16_t>(A_row[k]));
+                __m256i B_0 = load_256(B_col + k * B_cols), zeros = _mm256_setzero_si256();
+                acc_0 = _mm256_add_epi32(acc_0, _mm256_madd_epi16(_mm256_unpacklo_epi16(B_0, zeros), A_256));
+                acc_1 = _mm256_add_epi32(acc_1, _mm256_madd_epi16(_mm256_unpackhi_epi16(B_0, zeros), A_256));
+            }
+            // (q15_t)(sum >> 15): keep the lower 16 bits, sign-extended so that packing does not saturate
+            acc_0 = _mm256_srai_epi32(_mm256_slli_epi32(_mm256_srai_epi32(acc_0, 15), 16), 16);
+            acc_1 = _mm256_srai_epi32(_mm256_slli_epi32(_mm256_srai_epi32(acc_1, 15), 16), 16);
+            // unpack and pack both work within 128-bit lanes, so the column order is preserved
+            store_256(C_row + col, _mm256_packs_epi32(acc_0, acc_1));
+        }
+#endif
+#if NATIVE_SSE2
+        for (; col + 8 <= B_cols; col += 8) {
+            __m128i acc_0 = _mm_setzero_si128(), acc_1 = _mm_setzero_si128();
+            const int16_t *B_col = pSrcB + col;
+            uint16_t k = 0;
+            for (; k + 2 <= A_cols; k += 2) {
+                int32_t A_pair;
+                memcpy(&A_pair, A_row + k, sizeof(int32_t));
+                __m128i A_pair_128 = _mm_set1_epi32(A_pair);
+                __m128i B_0 = load_128(B_col + k * B_cols), B_1 = load_128(B_col + (k + 1) * B_cols);
+                acc_0 = _mm_add_epi32(acc_0, _mm_madd_epi16(_mm_unpacklo_epi16(B_0, B_1), A_pair_128));
+                acc_1 = _mm_add_epi32(acc_1, _mm_madd_epi16(_mm_unpackhi_epi16(B_0, B_1), A_pair_128));
+            }
+            if (k < A_cols) {
+                __m128i A_128 = _mm_set1_epi32(static_cast<uint16_t>(A_row[k]));
+                __m128i B_0 = load_128(B_col + k * B_cols), zeros = _mm_setzero_si128();
+                acc_0 = _mm_add_epi32(acc_0, _mm_madd_epi16(_mm_unpacklo_epi16(B_0, zeros), A_128));
+                acc_1 = _mm_add_epi32(acc_1, _mm_madd_epi16(_mm_unpackhi_epi16(B_0, zeros), A_128));
+            }
+            acc_0 = _mm_srai_epi32(_mm_slli_epi32(_mm_srai_epi32(acc_0, 15), 16), 16);
+            acc_1 = _mm_srai_epi32(_mm_slli_epi32(_mm_srai_epi32(acc_1, 15), 16), 16);
+            store_128(C_row + col, _mm_packs_epi32(acc_0, acc_1));
+        }
+#elif NATIVE_NEON
+        for (; col + 8 <= B_cols; col += 8) {
+            int32x4_t acc_0 = vdupq_n_s32(0), acc_1 = vdupq_n_s32(0);
+            const int16_t *B_col = pSrcB + col;
+            for (uint16_t k = 0; k < A_cols; k++) {
+                int16x8_t B_0 = vld1q_s16(B_col + k * B_cols);
+                acc_0 = vmlal_n_s16(acc_0, vget_low_s16(B_0), A_row[k]);
+                acc_1 = vmlal_n_s16(acc_1, vget_high_s16(B_0), A_row[k]);
+            }
+            vst1q_s16(C_row + col, vcombine_s16(vmovn_s32(vshrq_n_s32(acc_0, 15)), vmovn_s32(vshrq_n_s32(acc_1, 15))));
+        }
+#endif
+        for (; col < B_cols; col++) {
+            // unsigned to get well-defined wrapping
+            uint32_t sum = 0;
+            for (uint16_t k = 0; k < A_cols; k++) {
+                sum += static_cast<uint32_t>(static_cast<int32_t>(A_row[k]) * pSrcB[k * B_cols + col]);
+            }
+            C_row[col] = static_cast<int16_t>(static_cast<int32_t>(sum) >> 15);
+        }
+    }
+}
+
+/**
+ * Kernels below process values in a buffer, where values at indices idx with
+ * (phase + idx) % stride == stride - 1 have state bits. Positions of states are
+ * tracked with a vector of per-lane phases, so that states are handled with masks
+ * instead of strided scalar loops.
+ */
+#if NATIVE_SSE2
+struct StatePhases {
+    __m128i phases, step, stride, last;
+
+    StatePhases(uint16_t phase, uint16_t stride_) {
+        int16_t lane_phases[8];
+        for (uint8_t lane = 0; lane < 8; lane++) {
+            lane_phases[lane] = (phase + lane) % stride_;
+        }
+        phases = load_128(lane_phases);
+        step = _mm_set1_epi16(8 % stride_);
+        stride = _mm_set1_epi16(stride_);
+        last = _mm_set1_epi16(stride_ - 1);
+    }
+
+    __m128i has_state() const {
+        return _mm_cmpeq_epi16(phases, last);
+    }
+
+    void advance() {
+        phases = _mm_add_epi16(phases, step);
+        phases = _mm_sub_epi16(phases, _mm_and_si128(_mm_cmpgt_epi16(phases, last), stride));
+    }
+};
+
+static inline __m128i select_128(__m128i mask, __m128i a, __m128i b) {
+    return _mm_or_si128(_mm_and_si128(mask, a), _mm_andnot_si128(mask, b));
+}
+#elif NATIVE_NEON
+struct StatePhases {
+    int16x8_t phases, step, stride, last;
+
+    StatePhases(uint16_t phase, uint16_t stride_) {
+        int16_t lane_phases[8];
+        for (uint8_t lane = 0; lane < 8; lane++) {
+            lane_phases[lane] = (phase + lane) % stride_;
+        }
+        phases = vld1q_s16(lane_phases);
+        step = vdupq_n_s16(8 % stride_);
+        stride = vdupq_n_s16(stride_);
+        last = vdupq_n_s16(stride_ - 1);
+    }
+
+    uint16x8_t has_state() const {
+        return vceqq_s16(phases, last);
+    }
+
+    void advance() {
+        phases = vaddq_s16(phases, step);
+        phases = vsubq_s16(phases, vandq_s16(vreinterpretq_s16_u16(vcgtq_s16(phases, last)), stride));
+    }
+};
+#endif
+
+static inline bool has_state_at(uint32_t idx, uint16_t phase, uint16_t stride) {
+    return (phase + idx) % stride == stride - 1u;
+}
+
+void native_strip_states_q15(int16_t *pData, uint32_t blockSize, uint16_t phase, uint16_t stride, bool rescale) {
+    uint32_t idx = 0;
+#if NATIVE_SSE2
+    StatePhases state_phases(phase, stride);
+    const __m128i sign_bit = _mm_set1_epi16(INT16_MIN), state_offset = _mm_set1_epi16(0x4000);
+    for (; idx + 8 <= blockSize; idx += 8) {
+        __m128i val = load_128(pData + idx);
+        __m128i stripped = _mm_sub_epi16(val, _mm_add_epi16(_mm_and_si128(val, sign_bit), state_offset));
+        val = select_128(state_phases.has_state(), stripped, val);
+        if (rescale) {
+            val = _mm_add_epi16(val, val);
+        }
+        store_128(pData + idx, val);
+        state_phases.advance();
+    }
+#elif NATIVE_NEON
+    StatePhases state_phases(phase, stride);
+    const int16x8_t sign_bit = vdupq_n_s16(INT16_MIN), state_offset = vdupq_n_s16(0x4000);
+    for (; idx + 8 <= blockSize; idx += 8) {
+        int16x8_t val = vld1q_s16(pData + idx);
+        int16x8_t stripped = vsubq_s16(val, vaddq_s16(vandq_s16(val, sign_bit), state_offset));
+        val = vbslq_s16(state_phases.has_state(), stripped, val);
+        if (rescale) {
+            val = vaddq_s16(val, val);
+        }
+        vst1q_s16(pData + idx, val);
+        state_phases.advance();
+    }
+#endif
+    for (; idx < blockSize; idx++) {
+        int16_t val = pData[idx];
+        if (has_state_at(idx, phase, stride)) {
+            val -= (val & 0x8000) + 0x4000;
+        }
+        if (rescale) {
+            val *= 2;
+        }
+        pData[idx] = val;
+    }
+}
+
+void native_update_states_q15(int16_t *pData, uint32_t blockSize, uint16_t phase, uint16_t stride, int16_t offset, bool set_state, uint16_t state_mask) {
+    uint32_t idx = 0;
+#if NATIVE_SSE2
+    StatePhases state_phases(phase, stride);
+    const __m128i offset_128 = _mm_set1_epi16(offset), state_mask_128 = _mm_set1_epi16(static_cast<int16_t>(state_mask)),
+                  value_bits = _mm_set1_epi16(0x7fff);
+    for (; idx + 8 <= blockSize; idx += 8) {
+        __m128i has_state = state_phases.has_state();
+        __m128i val = load_128(pData + idx);
+        val = _mm_add_epi16(val, _mm_and_si128(has_state, offset_128));
+        if (set_state) {
+            val = select_128(has_state, _mm_or_si128(_mm_and_si128(val, value_bits), state_mask_128), val);
+        }
+        store_128(pData + idx, val);
+        state_phases.advance();
+    }
+#elif NATIVE_NEON
+    StatePhases state_phases(phase, stride);
+    const int16x8_t offset_128 = vdupq_n_s16(offset), state_mask_128 = vdupq_n_s16(static_cast<int16_t>(state_mask)),
+                    value_bits = vdupq_n_s16(0x7fff);
+    for (; idx + 8 <= blockSize; idx += 8) {
+        uint16x8_t has_state = state_phases.has_state();
+        int16x8_t val = vld1q_s16(pData + idx);
+        val = vaddq_s16(val, vandq_s16(vreinterpretq_s16_u16(has_state), offset_128));
+        if (set_state) {
+            val = vbslq_s16(has_state, vorrq_s16(vandq_s16(val, value_bits), state_mask_128), val);
+        }
+        vst1q_s16(pData + idx, val);
+        state_phases.advance();
+    }
+#endif
+    for (; idx < blockSize; idx++) {
+        if (has_state_at(idx, phase, stride)) {
+            pData[idx] += offset;
+            if (set_state) {
+                pData[idx] = (pData[idx] & 0x7fff) | state_mask;
+            }
+        }
+    }
+}
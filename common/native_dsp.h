@@ -0,0 +1,25 @@
+#pragma once
+
+#include <cstdint>
+
+/**
+ * Vectorized Q15 kernels for host builds (SSE2/AVX2 on x86, NEON on ARM, plain C otherwise).
+ * Results are bit-exact with the C reference codes of ARM CMSIS:
+ * - *_sat functions saturate like __SSAT(x, 16)
+ * - max/min return the first index among equal values
+ * - matrix multiplication accumulates in 32 bits (wrapping) and truncates with (q15_t)(sum >> 15)
+ */
+
+void native_add_q15(const int16_t *pSrcA, const int16_t *pSrcB, int16_t *pDst, uint32_t blockSize);
+void native_add_q15_sat(const int16_t *pSrcA, const int16_t *pSrcB, int16_t *pDst, uint32_t blockSize);
+void native_offset_q15_sat(const int16_t *pSrc, int16_t offset, int16_t *pDst, uint32_t blockSize);
+void native_scale_q15_sat(const int16_t *pSrc, int16_t scaleFract, uint8_t shift, int16_t *pDst, uint32_t blockSize);
+void native_mpy_q15_sat(const int16_t *pSrcA, const int16_t *pSrcB, int16_t *pDst, uint32_t blockSize);
+void native_fill_q15(int16_t value, int16_t *pDst, uint32_t blockSize);
+void native_max_q15(const int16_t *pSrc, uint32_t blockSize, int16_t *pResult, uint16_t *pIndex);
+void native_min_q15(const int16_t *pSrc, uint32_t blockSize, int16_t *pResult, uint16_t *pIndex);
+// pDst (A_rows x B_cols) = pSrcA (A_rows x A_cols) * pSrcB (A_cols x B_cols)
+void native_matrix_mpy_q15(uint16_t A_rows, uint16_t A_cols, uint16_t B_cols, const int16_t *pSrcA, const int16_t *pSrcB, int16_t *pDst);
+// Values at indices idx with (phase + idx) % stride == stride - 1 have state bits
+void native_strip_states_q15(int16_t *pData, uint32_t blockSize, uint16_t phase, uint16_t stride, bool rescale);
+void native_update_states_q15(int16_t *pData, uint32_t blockSize, uint16_t phase, uint16_t stride, int16_t offset, bool set_state, uint16_t state_mask);
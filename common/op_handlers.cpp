@@ -14,9 +14,7 @@
 const uint8_t RELU_TILE_SIZE = 16;
 static_assert(RELU_TILE_SIZE % BATCH_SIZE == 0, "Incorrect tile size for ReLU");
 
-void alloc_relu(Model *model, const ParameterInfo *input[], ParameterInfo *output, const Node*) {
-    const ParameterInfo *data = input[0];
-    output->slot = get_next_slot(model, data);
+void alloc_relu(Model *, const ParameterInfo *[], ParameterInfo*, const Node*) {
 }
 
 void handle_relu(Model *model, const ParameterInfo *input[], ParameterInfo *output, const Node* node) {
@@ -25,7 +23,7 @@ void handle_relu(Model *model, const ParameterInfo *input[], ParameterInfo *outp
     const ParameterInfo *X = input[0];
 
     uint16_t bitwidth = X->bitwidth;
-    MY_ASSERT(bitwidth == 16);
+    MY_ASSERT(bitwidth == 16 || bitwidth == 8);
     int16_t data_len = X->params_len / (bitwidth / 8);
 
     uint16_t output_offset = 0;
@@ -61,17 +59,12 @@ void handle_relu(Model *model, const ParameterInfo *input[], ParameterInfo *outp
         uint8_t cur_tile_size = MIN_VAL(real_relu_tile_size, data_len - i);
         my_memcpy_from_param(model, vals, X, output_offset, cur_tile_size*sizeof(int16_t));
 #if JAPARI && ENABLE_COUNTERS
-        counters()->data_loading += (cur_tile_size/2)*(4*8);
+        add_counter(offsetof(Counters, data_loading), (cur_tile_size/2)*(4*8));
 #endif
 
 #if STATEFUL
         start_cpu_counter(offsetof(Counters, stripping));
-        for (uint8_t j = 0; j < cur_tile_size; j++) {
-            if (offset_has_state(output_offset+j)) {
-                strip_state(&vals[j]);
-            }
-            vals[j] *= 2;
-        }
+        my_strip_states_q15(vals, cur_tile_size, output_offset % BATCH_SIZE, BATCH_SIZE, true);
         stop_cpu_counter();
 #endif
 
@@ -157,7 +150,7 @@ void handle_reshape(Model *model, const ParameterInfo *input[], ParameterInfo *o
     for (uint8_t i = shape->dims[0]; i < 4; i++) {
         output->dims[i] = 0;
     }
-    uint16_t inferred_dim = output->params_len / sizeof(int16_t);
+    uint16_t inferred_dim = get_values_len(output);
     int8_t auto_idx = -1;
 #if JAPARI
     start_cpu_counter(offsetof(Counters, embedding));
@@ -251,10 +244,9 @@ void handle_concat(Model *model, const ParameterInfo *input[], ParameterInfo *ou
     // The one with smaller `scale` (with larger values) is scaled down
     output->scale = MAX_VAL(A->scale, B->scale);
 
-    // saving slots here as it might be changed during the downscaling loop above
+    // Values are read from A and B, which are planned to be kept until the output is no longer needed
     output->extra_info[0] = A->parameter_info_idx;
     output->extra_info[1] = B->parameter_info_idx;
-    output->slot = A->slot;
 
     dump_params_nhwc_debug(model, A);
     dump_params_nhwc_debug(model, B);
@@ -276,8 +268,7 @@ void handle_transpose(Model*, const ParameterInfo *input[], ParameterInfo *outpu
     output->dims[3] = X->dims[2];
 }
 
-void alloc_add(Model *model, const ParameterInfo *input[], ParameterInfo *output, const Node *node) {
-    output->slot = get_next_slot(model, input[0]);
+void alloc_add(Model *, const ParameterInfo *[], ParameterInfo*, const Node*) {
 }
 
 void handle_add(Model *model, const ParameterInfo *input[], ParameterInfo *output, const Node *node) {
@@ -1,4 +1,5 @@
 #include <cstdint>
+#include <cstring>
 #include "my_debug.h"
 #include "op_utils.h"
 #include "data.h"
@@ -12,10 +13,10 @@
 #ifdef __MSP430__
 #pragma DATA_SECTION(".leaRAM")
 #endif
-int16_t lea_buffer[LEA_BUFFER_SIZE];
+PLAT_THREAD_LOCAL int16_t lea_buffer[LEA_BUFFER_SIZE];
 
 #if HAWAII
-static int16_t non_recorded_jobs = 0;
+static PLAT_THREAD_LOCAL int16_t non_recorded_jobs = 0;
 void hawaii_record_footprints(Model* model, uint16_t vector_len) {
     non_recorded_jobs += vector_len;
     for (; non_recorded_jobs >= BATCH_SIZE; non_recorded_jobs -= BATCH_SIZE) {
@@ -25,7 +26,72 @@ void hawaii_record_footprints(Model* model, uint16_t vector_len) {
 #endif
 
 #if JAPARI
-int16_t input_buffer_with_footprints[INPUT_BUFFER_WITH_FOOTPRINTS_LEN];
+PLAT_THREAD_LOCAL int16_t input_buffer_with_footprints[INPUT_BUFFER_WITH_FOOTPRINTS_LEN];
+#endif
+
+#if JAPARI
+#define OUTPUT_JOB_LEN (BATCH_SIZE + 1)
+#else
+#define OUTPUT_JOB_LEN BATCH_SIZE
+#endif
+static_assert(OUTPUT_JOB_LEN <= OUTPUT_COMBINING_LEN, "A job does not fit in the output combining buffer");
+
+struct CombinedOutputs {
+    ParameterInfo *output;
+    // Offset of values[0]
+    uint16_t offset;
+    uint8_t len;
+    int16_t values[OUTPUT_COMBINING_LEN / OUTPUT_JOB_LEN * OUTPUT_JOB_LEN];
+};
+static PLAT_THREAD_LOCAL CombinedOutputs combined_outputs;
+
+// offset should be the start of a job
+void start_combining_outputs(ParameterInfo *output, uint16_t offset) {
+    combined_outputs.output = output;
+    combined_outputs.offset = offset;
+    combined_outputs.len = 0;
+}
+
+void put_combined_output(Model *model, int16_t val) {
+    CombinedOutputs *outputs = &combined_outputs;
+    outputs->values[outputs->len] = val;
+    outputs->len++;
+    const uint8_t max_len = sizeof(outputs->values) / sizeof(int16_t);
+    // Write values if a job is finished and there is no space for the next job
+    if ((outputs->offset + outputs->len) % OUTPUT_JOB_LEN == 0 && outputs->len + OUTPUT_JOB_LEN > max_len) {
+        flush_combined_outputs(model);
+    }
+}
+
+void flush_combined_outputs(Model *model) {
+    CombinedOutputs *outputs = &combined_outputs;
+    if (!outputs->len) {
+        return;
+    }
+    my_memcpy_to_param(outputs->output, outputs->offset, outputs->values, outputs->len * sizeof(int16_t), 0);
+#if HAWAII
+    // A single footprint for all finished jobs
+    uint16_t n_finished_values = outputs->len / BATCH_SIZE * BATCH_SIZE;
+    if (n_finished_values) {
+        write_hawaii_layer_footprint(model->layer_idx, n_finished_values);
+    }
+#endif
+    outputs->offset += outputs->len;
+    outputs->len = 0;
+}
+
+void reset_op_states(void) {
+    memset(lea_buffer, 0, sizeof(lea_buffer));
+    memset(&combined_outputs, 0, sizeof(combined_outputs));
+#if HAWAII
+    non_recorded_jobs = 0;
+#endif
+#if JAPARI
+    memset(input_buffer_with_footprints, 0, sizeof(input_buffer_with_footprints));
+#endif
+}
+
+#if JAPARI
 
 int16_t extend_for_footprints(int16_t val, uint8_t force_aligned) {
     if (force_aligned) {
@@ -70,7 +136,7 @@ void float_to_scale_params(int16_t *scaleFract, uint8_t *shift, float scale) {
 void iterate_chunks(Model *model, const ParameterInfo *param, uint16_t start_offset, uint16_t len, const ChunkHandler& chunk_handler, void* params) {
     uint16_t params_len;
     if (!len) {
-        params_len = param->params_len / sizeof(int16_t);
+        params_len = get_values_len(param);
     } else {
         params_len = start_offset + len;
     }
@@ -213,27 +279,17 @@ float q15_to_float(int16_t val, const ValueInfo& val_info, uint8_t* p_use_prefix
 
 void my_offset_q15_batched(const int16_t *pSrc, int16_t offset, int16_t *pDst, uint32_t blockSize, bool enforce_states) {
     MY_ASSERT(pSrc == pDst);
+#if !STATEFUL
+    enforce_states = false;
+#endif
+    uint16_t mask = offset - 0x4000;
     if (BATCH_SIZE == 1) {
         my_offset_q15(pSrc, offset, pDst, blockSize);
-#if STATEFUL
         if (enforce_states) {
-            uint16_t mask = offset - 0x4000;
-            int16_t* end = pDst + blockSize;
-            for (int16_t* ptr = pDst; ptr < end; ptr++) {
-                *ptr = (*ptr & 0x7fff) | mask;
-            }
+            my_update_states_q15(pDst, blockSize, 0, 1, 0, true, mask);
         }
-#endif
     } else {
-        for (uint32_t val_idx = BATCH_SIZE - 1; val_idx < blockSize; val_idx += BATCH_SIZE) {
-            pDst[val_idx] += offset;
-#if STATEFUL
-            if (enforce_states) {
-                uint16_t mask = offset - 0x4000;
-                pDst[val_idx] = (pDst[val_idx] & 0x7fff) | mask;
-            }
-#endif
-        }
+        my_update_states_q15(pDst, blockSize, 0, BATCH_SIZE, offset, enforce_states, mask);
     }
 }
 
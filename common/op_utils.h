@@ -11,20 +11,31 @@ struct ValueInfo;
 
 typedef void (*ChunkHandler)(uint32_t output_offset, uint16_t output_chunk_len, int8_t old_output_state_bit, void* params);
 
-extern int16_t lea_buffer[LEA_BUFFER_SIZE];
+extern PLAT_THREAD_LOCAL int16_t lea_buffer[LEA_BUFFER_SIZE];
 int16_t upper_gauss(int16_t a, int16_t b);
 void float_to_scale_params(int16_t *scaleFract, uint8_t *shift, float scale);
 void iterate_chunks(Model *model, const ParameterInfo *param, uint16_t start_offset, uint16_t len, const ChunkHandler& callback, void* params);
 void determine_tile_c(ParameterInfo *param, const ParameterInfo* input, const ParameterInfo *filter = nullptr);
+// Clear volatile states of operators, as when the program starts (see reset_volatile_states())
+void reset_op_states(void);
+void reset_conv_states(void);
+void reset_maxpool_states(void);
 
 #if HAWAII
 void hawaii_record_footprints(Model* model, uint16_t vector_len);
 #endif
 
+/* Outputs computed value by value are combined into fewer NVM writes. Combined values are written
+ * at job boundaries, so that each write consists of whole jobs except the last one of a layer. */
+#define OUTPUT_COMBINING_LEN 32
+void start_combining_outputs(ParameterInfo *output, uint16_t offset);
+void put_combined_output(Model *model, int16_t val);
+void flush_combined_outputs(Model *model);
+
 #if JAPARI
 #define INPUT_BUFFER_WITH_FOOTPRINTS_LEN 256
 
-extern int16_t input_buffer_with_footprints[INPUT_BUFFER_WITH_FOOTPRINTS_LEN];
+extern PLAT_THREAD_LOCAL int16_t input_buffer_with_footprints[INPUT_BUFFER_WITH_FOOTPRINTS_LEN];
 int16_t extend_for_footprints(int16_t val, uint8_t force_aligned = 0);
 uint8_t has_footprints(const ParameterInfo* cur_param);
 #endif
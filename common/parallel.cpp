@@ -0,0 +1,173 @@
+#include "parallel.h"
+
+#if PARALLEL_LAYERS
+
+#include <deque>
+#include <memory>
+#include <thread>
+#include <vector>
+#include "counters.h"
+#include "my_debug.h"
+
+struct Task {
+    TaskGroup *group;
+    std::function<void(void)> func;
+};
+
+struct TaskQueue {
+    std::mutex mutex;
+    std::deque<Task> tasks;
+};
+
+/**
+ * A work-stealing pool: each worker takes tasks from the back of its own queue
+ * and steals from the front of other queues when its own queue is empty.
+ * The pool is never destroyed, so that exit() from any thread is safe.
+ */
+struct ThreadPool {
+    std::vector<std::unique_ptr<TaskQueue>> queues;
+    std::atomic<uint32_t> n_queued_tasks{0};
+    std::atomic<uint32_t> next_queue_idx{0};
+    std::mutex wake_mutex;
+    std::condition_variable wake;
+};
+
+static ThreadPool *pool = nullptr;
+
+static uint8_t take_task(uint16_t queue_idx, const TaskGroup *group, Task *task) {
+    std::lock_guard<std::mutex> lock(pool->queues[queue_idx]->mutex);
+    std::deque<Task>& tasks = pool->queues[queue_idx]->tasks;
+    for (auto it = tasks.begin(); it != tasks.end(); it++) {
+        if (!group || it->group == group) {
+            *task = std::move(*it);
+            tasks.erase(it);
+            pool->n_queued_tasks--;
+            return 1;
+        }
+    }
+    return 0;
+}
+
+// group = nullptr to take tasks from any group
+static uint8_t find_task(uint16_t worker_idx, const TaskGroup *group, Task *task) {
+    uint16_t n_queues = pool->queues.size();
+    if (!group) {
+        std::lock_guard<std::mutex> lock(pool->queues[worker_idx]->mutex);
+        std::deque<Task>& tasks = pool->queues[worker_idx]->tasks;
+        if (!tasks.empty()) {
+            *task = std::move(tasks.back());
+            tasks.pop_back();
+            pool->n_queued_tasks--;
+            return 1;
+        }
+    }
+    for (uint16_t offset = 0; offset < n_queues; offset++) {
+        if (take_task((worker_idx + offset) % n_queues, group, task)) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+static void run_task(Task *task, uint8_t on_submitting_thread) {
+    TaskGroup *group = task->group;
+    if (!on_submitting_thread) {
+        set_engine_context(&group->context);
+    }
+    auto task_start = std::chrono::steady_clock::now();
+    task->func();
+    // Outputs of the task may be read by other threads after the group is finished
+    wait_nvm_writes();
+    group->task_time_ns += std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - task_start).count();
+
+    // Update the group with the lock held, so that the group is not destroyed before the lock is released
+    std::lock_guard<std::mutex> lock(group->mutex);
+#if ENABLE_COUNTERS
+    if (!on_submitting_thread && group->counters) {
+        // Counters on pool threads are only for collecting values for the submitting thread
+        merge_counters(group->counters.get());
+        reset_counters();
+    }
+#endif
+    if (--group->n_unfinished_tasks == 0) {
+        group->all_finished.notify_all();
+    }
+}
+
+static void worker_main(uint16_t worker_idx) {
+    while (1) {
+        Task task;
+        if (find_task(worker_idx, nullptr, &task)) {
+            run_task(&task, 0);
+            continue;
+        }
+        std::unique_lock<std::mutex> lock(pool->wake_mutex);
+        pool->wake.wait(lock, [] { return pool->n_queued_tasks > 0; });
+    }
+}
+
+void init_parallel_layers(uint16_t n_threads) {
+    if (!n_threads) {
+        n_threads = MAX_VAL(std::thread::hardware_concurrency(), 1u);
+    }
+    my_printf_debug("Running Conv and Gemm with %d threads" NEWLINE, n_threads);
+    pool = new ThreadPool;
+    for (uint16_t worker_idx = 0; worker_idx < n_threads; worker_idx++) {
+        pool->queues.emplace_back(new TaskQueue);
+    }
+    for (uint16_t worker_idx = 0; worker_idx < n_threads; worker_idx++) {
+        std::thread(worker_main, worker_idx).detach();
+    }
+}
+
+uint8_t parallel_layers_enabled(void) {
+    return pool != nullptr;
+}
+
+void init_task_group(TaskGroup *group) {
+    // Tasks on pool threads may read NVM data written by the submitting thread
+    wait_nvm_writes();
+    get_engine_context(&group->context);
+#if ENABLE_COUNTERS
+    if (counters_enabled()) {
+        group->counters.reset(new Counters[COUNTERS_LEN]());
+    }
+#endif
+    group->n_unfinished_tasks = 0;
+    group->task_time_ns = 0;
+    group->start_time = std::chrono::steady_clock::now();
+}
+
+void submit_task(TaskGroup *group, std::function<void(void)> task) {
+    group->n_unfinished_tasks++;
+    TaskQueue *queue = pool->queues[pool->next_queue_idx++ % pool->queues.size()].get();
+    {
+        std::lock_guard<std::mutex> lock(queue->mutex);
+        queue->tasks.push_back(Task{group, std::move(task)});
+        pool->n_queued_tasks++;
+    }
+    std::lock_guard<std::mutex> lock(pool->wake_mutex);
+    pool->wake.notify_one();
+}
+
+void wait_task_group(TaskGroup *group) {
+    Task task;
+    while (find_task(0, group, &task)) {
+        run_task(&task, 1);
+    }
+    // remaining tasks are running on pool threads
+    std::unique_lock<std::mutex> lock(group->mutex);
+    group->all_finished.wait(lock, [group] { return group->n_unfinished_tasks == 0; });
+#if ENABLE_COUNTERS
+    if (!group->counters) {
+        return;
+    }
+    add_counters(counters_data[counters_cur_copy_id], group->counters.get());
+    group->counters.reset();
+    uint64_t wall_time_ns = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - group->start_time).count();
+    add_counter(offsetof(Counters, parallel_task_time), group->task_time_ns / 1000);
+    add_counter(offsetof(Counters, parallel_wall_time), wall_time_ns / 1000);
+#endif
+}
+
+#endif
@@ -0,0 +1,60 @@
+#pragma once
+
+#include "data.h"
+#include "platform.h"
+
+/**
+ * Intra-layer parallelism for Conv and Gemm, available on PC only. Jobs are
+ * split into tasks writing disjoint parts of the output, and each task starts
+ * in the same way as recovering from a power failure at its first job.
+ *
+ * Not used for HAWAII, as layer footprints there assume jobs finish in order.
+ */
+#define PARALLEL_LAYERS (PLAT_HAS_THREADS && !HAWAII)
+
+#if PARALLEL_LAYERS
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include "cnn_common.h"
+#include "counters.h"
+
+// Per-thread engine states needed by tasks, copied from the submitting thread
+struct EngineContext {
+    uint8_t *nvm;
+    uint16_t sample_idx;
+    Model model;
+};
+
+struct TaskGroup {
+    EngineContext context;
+#if ENABLE_COUNTERS
+    // counters from tasks running on pool threads, merged in wait_task_group
+    std::unique_ptr<Counters[]> counters;
+#endif
+    std::atomic<uint32_t> n_unfinished_tasks;
+    std::atomic<uint64_t> task_time_ns;
+    std::chrono::steady_clock::time_point start_time;
+    std::mutex mutex;
+    std::condition_variable all_finished;
+};
+
+// n_threads = 0 for all cores
+void init_parallel_layers(uint16_t n_threads);
+uint8_t parallel_layers_enabled(void);
+
+void init_task_group(TaskGroup *group);
+void submit_task(TaskGroup *group, std::function<void(void)> task);
+// Also runs unstarted tasks in the group on the calling thread
+void wait_task_group(TaskGroup *group);
+
+// defined in plat-pc.cpp, where NVM is managed
+void get_engine_context(EngineContext *context);
+void set_engine_context(const EngineContext *context);
+
+#endif
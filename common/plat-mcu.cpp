@@ -25,7 +25,7 @@
 #endif
 
 #if ENABLE_COUNTERS
-DATA_SECTION_NVM Counters counters_data[2][COUNTERS_LEN];
+DATA_SECTION_NVM Counters counters_data[2][MAX_COUNTERS_LEN];
 DATA_SECTION_NVM uint8_t counters_cur_copy_id = 0;
 DATA_SECTION_NVM uint32_t total_jobs = 0;
 #endif
@@ -104,6 +104,10 @@ void write_to_nvm(const void* vm_buffer, uint32_t nvm_offset, size_t n, uint16_t
     }
 }
 
+void wait_nvm_writes(void) {
+    SPI_WAIT_DMA();
+}
+
 void my_erase() {
     eraseFRAM2(0x00);
 }
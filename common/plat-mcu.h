@@ -6,6 +6,10 @@
 
 #define PLAT_LABELS_DATA_LEN 1
 
+#define PLAT_THREAD_LOCAL
+#define PLAT_HAS_THREADS 0
+#define PLAT_RUNTIME_COUNTERS 0
+
 #ifdef __MSP430__
 #include <DSPLib.h>
 static inline void plat_start_cpu_counter(void) {
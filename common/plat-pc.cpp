@@ -8,6 +8,23 @@
  *
  * After transforming the model with `transform.py`, the simulator can be built with `cmake -B build -S .` and `make -C build`.
  * The built program can be run with `./build/intermittent-cnn`.
+ * With `-j N`, samples are evaluated by N threads, each with a private copy of NVM (N=0 for all cores).
+ * With `-p N`, jobs in Conv and Gemm layers are run on a pool of N threads (N=0 for all cores).
+ * With `-w`, NVM is written byte by byte, so that asynchronous power failures (SIGINT) are more likely to interrupt writes.
+ * With `-C`, counters are collected and printed after inference (see counters.h). CPU counters are in cycles
+ * if perf_event_open() is permitted (kernel.perf_event_paranoid <= 2), or in nanoseconds otherwise.
+ * With `-E`, instructions and cache misses are also counted in regions of CPU counters.
+ * With `-m FILE`, the model is loaded from FILE if transform.py is run with `--bundle` (default: build/model.bundle).
+ * With `-o PREFIX`, counters are also written to PREFIX.csv, and a Chrome trace to PREFIX.json (see profiler.h).
+ * With `-R SCHEDULE`, power failures do not exit the program. Instead, volatile states are cleared and the inference is
+ * resumed from NVM in the same process. SCHEDULE is `bytes:N` (every N bytes written to NVM, as -c), `random:N[:SEED]`
+ * (after a random number of bytes, N on average) or `timer:MS` (at the first NVM write after MS milliseconds).
+ * With `-S K` and/or `-L N`, the first sample is run with a power failure at every K-th NVM write and/or at N writes
+ * of each layer, each in a forked process with fresh NVM, and -j sets the number of parallel processes (see power_sweep.h).
+ * With `-a`, NVM writes are queued and done by a writer thread while the inference continues, as DMA transfers to
+ * external FRAM without SPI_WAIT_DMA(). Time for NVM writes while the inference is not waiting for them is reported as hidden.
+ *
+ * With BENCH_BUILD, main() is provided by bench/bench.cpp instead (see `make -C build bench`).
  */
 
 #ifdef PC_BUILD
@@ -16,54 +33,394 @@
 #include "cnn_common.h"
 #include "counters.h"
 #include "my_debug.h"
+#include "parallel.h"
 #include "platform.h"
+#include "power_sweep.h"
 #include "data.h"
+#include <cinttypes>
 #include <cstdint>
 #include <cstdlib>
 #include <cstring>
 #ifdef __linux__
 #include <fcntl.h>
 #include <getopt.h>
+#include <pthread.h>
 #include <unistd.h>
 #include <signal.h>
 #include <errno.h>
+#include <setjmp.h>
+#include <sys/time.h>
 #include <sys/types.h>
 #include <sys/stat.h>
 #include <sys/mman.h>
 #include <sys/ptrace.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
 #endif
+#include <chrono>
+#include <atomic>
+#include <condition_variable>
 #include <fstream>
 #include <memory>
+#include <mutex>
+#include <random>
+#include <thread>
+#include <vector>
 #ifdef USE_PROTOBUF
 #include "model_output.pb.h"
 #endif
 
-/* data on NVM, made persistent via mmap() with a file */
-uint8_t *nvm;
+/* data on NVM, made persistent via mmap() with a file. Each worker thread of -j has a private copy */
+static PLAT_THREAD_LOCAL uint8_t *nvm;
+// Number of bytes to write to NVM before a simulated power failure. UINT32_MAX if not armed
 static uint32_t shutdown_counter = UINT32_MAX;
+static uint8_t bytewise_nvm_writes = 0;
+static void (*nvm_write_hook)(size_t n) = nullptr;
+
+#ifdef __linux__
+/* Power failures simulated without restarting the program (-R), which jump to reboot_point */
+enum PowerFailureSchedule : uint8_t {
+    POWER_FAILURE_NONE,
+    POWER_FAILURE_BYTES,
+    POWER_FAILURE_RANDOM,
+    POWER_FAILURE_TIMER,
+};
+static uint8_t power_failure_schedule = POWER_FAILURE_NONE;
+static sigjmp_buf reboot_point;
+// Set by the timer, and power fails at the next NVM write
+static volatile sig_atomic_t power_failure_pending = 0;
+#endif
 static std::ofstream out_file;
+static PLAT_THREAD_LOCAL uint64_t nvm_bytes_read = 0, nvm_bytes_written = 0;
+static uint8_t async_nvm_writes = 0;
+// Over all threads for -a
+static std::atomic<uint64_t> async_nvm_writes_count(0), async_nvm_writes_ns(0), async_nvm_writes_hidden_ns(0), async_nvm_writes_waiting_ns(0);
 
 #if ENABLE_COUNTERS
-Counters counters_data[2][COUNTERS_LEN];
-uint8_t counters_cur_copy_id = 0;
+PLAT_THREAD_LOCAL Counters counters_data[2][MAX_COUNTERS_LEN];
+PLAT_THREAD_LOCAL uint8_t counters_cur_copy_id = 0;
 uint32_t total_jobs = 0;
 #endif
 
+/* CPU counters. start_cpu_counter() stops the outer counter before starting an inner one,
+ * so that there is at most one running CPU counter on each thread */
+enum CpuCounterEvent {
+    CPU_CYCLES,
+    CPU_INSTRUCTIONS,
+    CPU_CACHE_MISSES,
+    CPU_COUNTER_EVENTS_LEN,
+};
+
+// 0 for thread CPU time
+static uint8_t cpu_counter_n_events = 0;
+
+struct CpuCounters {
+    int fds[CPU_COUNTER_EVENTS_LEN];
+    uint8_t n_fds = 0;
+    uint64_t start_values[CPU_COUNTER_EVENTS_LEN];
+
+    void close_events() {
+#ifdef __linux__
+        for (uint8_t idx = 0; idx < n_fds; idx++) {
+            close(fds[idx]);
+        }
+#endif
+        n_fds = 0;
+    }
+
+    ~CpuCounters() {
+        close_events();
+    }
+};
+
+static PLAT_THREAD_LOCAL CpuCounters cpu_counters;
+
+#ifdef __linux__
+// Events are opened for each thread, as counting the calling thread on any CPU
+static uint8_t open_perf_events(CpuCounters *cur_counters, uint8_t n_events) {
+    static const uint64_t configs[] = {
+        PERF_COUNT_HW_CPU_CYCLES,
+        PERF_COUNT_HW_INSTRUCTIONS,
+        PERF_COUNT_HW_CACHE_MISSES,
+    };
+    for (uint8_t idx = 0; idx < n_events; idx++) {
+        perf_event_attr attr;
+        memset(&attr, 0, sizeof(attr));
+        attr.size = sizeof(attr);
+        attr.type = PERF_TYPE_HARDWARE;
+        attr.config = configs[idx];
+        // All events are read at once via the group leader (cycles)
+        attr.read_format = PERF_FORMAT_GROUP;
+        // Allowed with kernel.perf_event_paranoid <= 2
+        attr.exclude_kernel = 1;
+        attr.exclude_hv = 1;
+        int group_fd = idx ? cur_counters->fds[0] : -1;
+        int fd = static_cast<int>(syscall(SYS_perf_event_open, &attr, 0, -1, group_fd, 0));
+        if (fd < 0) {
+            cur_counters->close_events();
+            return 0;
+        }
+        cur_counters->fds[cur_counters->n_fds++] = fd;
+    }
+    return 1;
+}
+#endif
+
+static void read_cpu_counters(uint64_t *values) {
+#ifdef __linux__
+    if (cpu_counter_n_events) {
+        if (!cpu_counters.n_fds && !open_perf_events(&cpu_counters, cpu_counter_n_events)) {
+            // Should not happen, as it succeeded in init_cpu_counters()
+            perror("perf_event_open() failed");
+            ERROR_OCCURRED();
+        }
+        struct {
+            uint64_t nr;
+            uint64_t values[CPU_COUNTER_EVENTS_LEN];
+        } group_values;
+        if (read(cpu_counters.fds[0], &group_values, sizeof(group_values)) < 0) {
+            perror("Reading perf events failed");
+            ERROR_OCCURRED();
+        }
+        memcpy(values, group_values.values, cpu_counter_n_events * sizeof(uint64_t));
+        return;
+    }
+    timespec ts;
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+    values[CPU_CYCLES] = ts.tv_sec * 1000000000ull + ts.tv_nsec;
+#else
+    values[CPU_CYCLES] = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+#endif
+}
+
+void init_cpu_counters(uint8_t extra_events) {
+#ifdef __linux__
+    uint8_t n_events = extra_events ? CPU_COUNTER_EVENTS_LEN : 1;
+    if (open_perf_events(&cpu_counters, n_events)) {
+        cpu_counter_n_events = n_events;
+        my_printf("CPU counters are in cycles" NEWLINE);
+        return;
+    }
+    perror("perf_event_open() failed");
+#endif
+    if (extra_events) {
+        my_printf("Instructions and cache misses are not available" NEWLINE);
+    }
+    my_printf("CPU counters are in nanoseconds" NEWLINE);
+}
+
+void plat_start_cpu_counter(void) {
+    read_cpu_counters(cpu_counters.start_values);
+}
+
+uint64_t plat_stop_cpu_counter(void) {
+    uint64_t values[CPU_COUNTER_EVENTS_LEN];
+    read_cpu_counters(values);
+    if (cpu_counter_n_events > CPU_INSTRUCTIONS) {
+        add_counter(offsetof(Counters, cpu_instructions), values[CPU_INSTRUCTIONS] - cpu_counters.start_values[CPU_INSTRUCTIONS]);
+        add_counter(offsetof(Counters, cache_misses), values[CPU_CACHE_MISSES] - cpu_counters.start_values[CPU_CACHE_MISSES]);
+    }
+    return values[CPU_CYCLES] - cpu_counters.start_values[CPU_CYCLES];
+}
+
 #ifdef USE_PROTOBUF
 static void save_model_output_data() {
     model_output_data->SerializeToOstream(&out_file);
 }
 #endif
 
+#if PARALLEL_LAYERS
+void get_engine_context(EngineContext *context) {
+    context->nvm = nvm;
+    context->sample_idx = sample_idx;
+    context->model = model_vm;
+}
+
+void set_engine_context(const EngineContext *context) {
+    nvm = context->nvm;
+    sample_idx = context->sample_idx;
+    model_vm = context->model;
+}
+#endif
+
+#ifndef BENCH_BUILD
+static uint8_t run_cnn_tests_parallel(uint16_t n_samples, uint16_t n_threads) {
+    n_samples = get_n_test_samples(n_samples);
+    if (!n_threads) {
+        n_threads = MAX_VAL(std::thread::hardware_concurrency(), 1u);
+    }
+    n_threads = MIN_VAL(n_threads, MAX_VAL(n_samples, 1));
+    my_printf_debug("Running %d samples with %d threads" NEWLINE, n_samples, n_threads);
+
+    const uint8_t *nvm_image = nvm;
+    std::atomic<uint32_t> next_sample_idx(0);
+    std::vector<TestResults> thread_results(n_threads, TestResults{0, 0});
+    std::mutex counters_mutex;
+#if ENABLE_COUNTERS
+    Counters *main_counters = counters_data[counters_cur_copy_id];
+#endif
+
+    std::vector<std::thread> workers;
+    for (uint16_t thread_idx = 0; thread_idx < n_threads; thread_idx++) {
+        workers.emplace_back([&, thread_idx] () {
+            // Each thread starts from the NVM image prepared by the main thread, and
+            // intermediate values of other threads are never visible.
+            std::unique_ptr<uint8_t[]> private_nvm(new uint8_t[NVM_SIZE]);
+            memcpy(private_nvm.get(), nvm_image, NVM_SIZE);
+            nvm = private_nvm.get();
+
+            Model *model = load_model_from_nvm();
+            // Don't resume a sample left by a previous run, as samples are redistributed among threads
+            model->running = 0;
+
+            while (1) {
+                uint32_t cur_sample_idx = next_sample_idx++;
+                if (cur_sample_idx >= n_samples) {
+                    break;
+                }
+                run_cnn_test_sample(cur_sample_idx, &thread_results[thread_idx]);
+            }
+
+            if (counters_enabled()) {
+                std::lock_guard<std::mutex> lock(counters_mutex);
+                merge_counters(main_counters);
+            }
+            // Queued writes are to the private NVM
+            wait_nvm_writes();
+            nvm = nullptr;
+        });
+    }
+    for (std::thread& worker : workers) {
+        worker.join();
+    }
+
+    TestResults results = {0, 0};
+    for (const TestResults& cur_results : thread_results) {
+        results.correct += cur_results.correct;
+        results.total += cur_results.total;
+    }
+    return report_cnn_test_results(&results);
+}
+
+#ifdef __linux__
+// Bytes or milliseconds
+static uint32_t power_failure_interval;
+static std::mt19937 power_failure_rng;
+static uint32_t power_cycles = 0;
+// For detecting programs not making progress, as with exp/run-intermittently.py
+#define MAX_POWER_CYCLES_PER_LAYER 1000000
+static uint32_t power_cycles_in_layer;
+static uint16_t last_failed_layer_idx;
+
+static uint8_t parse_power_failure_schedule(const char *spec) {
+    unsigned interval = 0, seed;
+    if (sscanf(spec, "bytes:%u", &interval) == 1) {
+        power_failure_schedule = POWER_FAILURE_BYTES;
+    } else if (sscanf(spec, "timer:%u", &interval) == 1) {
+        power_failure_schedule = POWER_FAILURE_TIMER;
+    } else {
+        int n_fields = sscanf(spec, "random:%u:%u", &interval, &seed);
+        if (n_fields < 1) {
+            return 0;
+        }
+        if (n_fields == 1) {
+            seed = std::random_device()();
+        }
+        // For reproducing failures
+        my_printf("Random power failures with seed %u" NEWLINE, seed);
+        power_failure_rng.seed(seed);
+        power_failure_schedule = POWER_FAILURE_RANDOM;
+    }
+    power_failure_interval = interval;
+    return interval > 0;
+}
+
+static void on_power_failure_timer(int) {
+    power_failure_pending = 1;
+}
+
+static void arm_next_power_failure(void) {
+    power_failure_pending = 0;
+    if (power_failure_schedule == POWER_FAILURE_BYTES) {
+        shutdown_counter = power_failure_interval;
+    } else if (power_failure_schedule == POWER_FAILURE_RANDOM) {
+        shutdown_counter = std::uniform_int_distribution<uint32_t>(1, 2 * power_failure_interval - 1)(power_failure_rng);
+    } else if (power_failure_schedule == POWER_FAILURE_TIMER) {
+        itimerval timer = {};
+        timer.it_value.tv_sec = power_failure_interval / 1000;
+        timer.it_value.tv_usec = power_failure_interval % 1000 * 1000;
+        setitimer(ITIMER_REAL, &timer, nullptr);
+    }
+}
+
+static void disarm_power_failures(void) {
+    shutdown_counter = UINT32_MAX;
+    itimerval timer = {};
+    setitimer(ITIMER_REAL, &timer, nullptr);
+    power_failure_pending = 0;
+}
+
+// The same as restarting the program, while NVM is kept mapped
+static void reboot(void) {
+    power_cycles++;
+    my_printf_debug("Power failure %" PRIu32 ", rebooting..." NEWLINE, power_cycles);
+    reset_volatile_states();
+    profiler_reset_spans();
+    Model *model = load_model_from_nvm();
+
+    if (model->layer_idx != last_failed_layer_idx) {
+        last_failed_layer_idx = model->layer_idx;
+        power_cycles_in_layer = 0;
+    }
+    power_cycles_in_layer++;
+    if (power_cycles_in_layer > MAX_POWER_CYCLES_PER_LAYER) {
+        my_printf("The program does not run intermittently" NEWLINE);
+        ERROR_OCCURRED();
+    }
+}
+
+static uint8_t run_cnn_tests_with_reboots(uint16_t n_samples) {
+    n_samples = get_n_test_samples(n_samples);
+    TestResults results = {0, 0};
+
+    struct sigaction action = {};
+    action.sa_handler = on_power_failure_timer;
+    action.sa_flags = SA_RESTART;
+    sigaction(SIGALRM, &action, nullptr);
+
+    arm_next_power_failure();
+    for (uint16_t idx = 0; idx < n_samples; idx++) {
+        last_failed_layer_idx = UINT16_MAX;
+        // Power failures in the sample jump back here, and the sample is resumed after rebooting
+        if (sigsetjmp(reboot_point, 0)) {
+            reboot();
+            arm_next_power_failure();
+        }
+        run_cnn_test_sample(idx, &results);
+    }
+    disarm_power_failures();
+
+    my_printf("Power cycles: %" PRIu32 NEWLINE, power_cycles);
+    return report_cnn_test_results(&results);
+}
+#endif
+
 int main(int argc, char* argv[]) {
-    int ret = 0, opt_ch, button_pushed = 0, read_only = 0, n_samples = 0;
+    int ret = 0, opt_ch, button_pushed = 0, read_only = 0, cpu_counter_extra_events = 0, n_samples = 0, n_threads = -1, n_layer_threads = -1;
     Model *model;
+    PowerSweepOptions sweep_options = {0, 0, 0};
+#if MODEL_BUNDLE
+    const char *model_bundle_path = "build/model.bundle";
+#endif
 
 #ifdef __linux__
     int nvm_fd = -1;
 
-    while((opt_ch = getopt(argc, argv, "bfrc:s:")) != -1) {
+    while((opt_ch = getopt(argc, argv, "abfrwCEc:j:m:o:p:s:L:R:S:")) != -1) {
         switch (opt_ch) {
+            case 'a':
+                async_nvm_writes = 1;
+                break;
             case 'b':
                 button_pushed = 1;
                 break;
@@ -73,9 +430,52 @@ int main(int argc, char* argv[]) {
             case 'f':
                 dump_integer = 0;
                 break;
+            case 'w':
+                bytewise_nvm_writes = 1;
+                break;
             case 'c':
                 shutdown_counter = atol(optarg);
                 break;
+            case 'C':
+                enable_profiler(nullptr);
+                break;
+            case 'o':
+                enable_profiler(optarg);
+                break;
+            case 'E':
+                cpu_counter_extra_events = 1;
+                break;
+            case 'j':
+                n_threads = atoi(optarg);
+                break;
+            case 'L':
+                sweep_options.points_per_layer = atoi(optarg);
+                break;
+            case 'R':
+                if (!parse_power_failure_schedule(optarg)) {
+                    my_printf("Invalid power failure schedule %s" NEWLINE, optarg);
+                    return 1;
+                }
+                break;
+            case 'S':
+                sweep_options.write_step = atol(optarg);
+                break;
+            case 'm':
+#if MODEL_BUNDLE
+                model_bundle_path = optarg;
+                break;
+#else
+                my_printf("The model is compiled into the simulator. Run transform.py with --bundle for model bundles." NEWLINE);
+                return 1;
+#endif
+            case 'p':
+#if PARALLEL_LAYERS
+                n_layer_threads = atoi(optarg);
+                break;
+#else
+                my_printf("Parallel layers are not supported for " METHOD "." NEWLINE);
+                return 1;
+#endif
             case 's':
 #ifdef USE_PROTOBUF
                 out_file.open(optarg);
@@ -85,13 +485,45 @@ int main(int argc, char* argv[]) {
                 return 1;
 #endif
             default:
-                my_printf("Usage: %s [-r] [n_samples]" NEWLINE, argv[0]);
+                my_printf("Usage: %s [-a] [-r] [-w] [-C] [-E] [-m model_bundle] [-o profiler_prefix] [-j n_threads] [-p n_layer_threads] [-R schedule] [-S write_step] [-L points_per_layer] [n_samples]" NEWLINE, argv[0]);
                 return 1;
         }
     }
+    if ((n_threads >= 0 || n_layer_threads >= 0) && (shutdown_counter != UINT32_MAX || out_file.is_open())) {
+        // Power failures and saved outputs are defined for a single sequence of NVM writes
+        my_printf("-j and -p cannot be used with -c or -s" NEWLINE);
+        return 1;
+    }
+    if (power_failure_schedule != POWER_FAILURE_NONE &&
+        (shutdown_counter != UINT32_MAX || out_file.is_open() || n_threads >= 0 || n_layer_threads >= 0 || sweep_options.write_step || sweep_options.points_per_layer)) {
+        my_printf("-R cannot be used with -c, -s, -j, -p, -S or -L" NEWLINE);
+        return 1;
+    }
+    if (sweep_options.write_step || sweep_options.points_per_layer) {
+        if (shutdown_counter != UINT32_MAX || out_file.is_open() || n_layer_threads >= 0) {
+            my_printf("-S and -L cannot be used with -c, -s or -p" NEWLINE);
+            return 1;
+        }
+        // Always start from a fresh NVM, and keep nvm.bin unchanged
+        button_pushed = 1;
+        read_only = 1;
+    }
     if (argv[optind]) {
         n_samples = atoi(argv[optind]);
     }
+#endif
+
+#if MODEL_BUNDLE
+    // Sizes for NVM depend on the model
+    if (!load_model_bundle(model_bundle_path)) {
+        return 1;
+    }
+#endif
+
+#ifdef __linux__
+    if (counters_enabled()) {
+        init_cpu_counters(cpu_counter_extra_events);
+    }
 
     struct stat stat_buf;
     if (stat("nvm.bin", &stat_buf) != 0) {
@@ -103,15 +535,22 @@ int main(int argc, char* argv[]) {
         ftruncate(nvm_fd, NVM_SIZE);
     } else {
         nvm_fd = open("nvm.bin", O_RDWR);
+#if MODEL_BUNDLE
+        // nvm.bin may be from a model with a smaller NVM
+        if (stat_buf.st_size < NVM_SIZE) {
+            ftruncate(nvm_fd, NVM_SIZE);
+        }
+#endif
     }
-    nvm = reinterpret_cast<uint8_t*>(mmap(NULL, NVM_SIZE, PROT_READ|PROT_WRITE, read_only ? MAP_PRIVATE : MAP_SHARED, nvm_fd, 0));
+    // Pre-fault all pages, which is faster than faulting pages one by one during inference
+    nvm = reinterpret_cast<uint8_t*>(mmap(NULL, NVM_SIZE, PROT_READ|PROT_WRITE, (read_only ? MAP_PRIVATE : MAP_SHARED) | MAP_POPULATE, nvm_fd, 0));
     if (nvm == MAP_FAILED) {
         perror("mmap() failed");
         goto exit;
     }
 #else
     (void)read_only; // no simulated NVM other than Linux - silent a compiler warning
-    nvm = new uint8_t[NVM_SIZE]();
+    init_volatile_nvm();
 #endif
 
 #if USE_ARM_CMSIS
@@ -139,9 +578,36 @@ int main(int argc, char* argv[]) {
         first_run();
     }
 
-    ret = run_cnn_tests(n_samples);
+#if PARALLEL_LAYERS
+    if (n_layer_threads >= 0) {
+        init_parallel_layers(n_layer_threads);
+    }
+#endif
 
-    print_all_counters();
+#ifdef __linux__
+    if (sweep_options.write_step || sweep_options.points_per_layer) {
+        sweep_options.n_workers = MAX_VAL(n_threads, 0);
+        ret = run_power_failure_sweep(&sweep_options);
+    } else if (power_failure_schedule != POWER_FAILURE_NONE) {
+        ret = run_cnn_tests_with_reboots(n_samples);
+    } else
+#endif
+    if (n_threads >= 0) {
+        ret = run_cnn_tests_parallel(n_samples, n_threads);
+    } else {
+        ret = run_cnn_tests(n_samples);
+    }
+
+    wait_nvm_writes();
+    if (async_nvm_writes_count) {
+        my_printf("Asynchronous NVM writes: %" PRIu64 ", %.3f ms for writing, %.3f ms hidden, %.3f ms waiting" NEWLINE,
+                  async_nvm_writes_count.load(), async_nvm_writes_ns / 1e6, async_nvm_writes_hidden_ns / 1e6, async_nvm_writes_waiting_ns / 1e6);
+    }
+
+    if (counters_enabled()) {
+        print_all_counters();
+        write_profiler_outputs();
+    }
 
 #ifdef __linux__
 exit:
@@ -151,6 +617,16 @@ exit:
 #endif
     return ret;
 }
+#endif // BENCH_BUILD
+
+void init_volatile_nvm(void) {
+    nvm = new uint8_t[NVM_SIZE]();
+}
+
+void get_nvm_traffic(uint64_t *bytes_read, uint64_t *bytes_written) {
+    *bytes_read = nvm_bytes_read;
+    *bytes_written = nvm_bytes_written;
+}
 
 [[ noreturn ]] static void exit_with_status(uint8_t exit_code) {
 #ifdef __linux__
@@ -163,24 +639,55 @@ exit:
     exit(exit_code);
 }
 
+[[ noreturn ]] static void simulate_power_failure(void) {
+#ifdef __linux__
+    if (power_failure_schedule != POWER_FAILURE_NONE) {
+        siglongjmp(reboot_point, 1);
+    }
+#endif
+    exit_with_status(2);
+}
+
 void my_memcpy_ex(void* dest, const void* src, size_t n, uint8_t write_to_nvm) {
 #if ENABLE_COUNTERS
-    counters()->dma_invocations++;
-    counters()->dma_bytes += n;
-#endif
-    // Not using memcpy here so that it is more likely that power fails during
-    // memcpy, which is the case for external FRAM
-    uint8_t *dest_u = reinterpret_cast<uint8_t*>(dest);
-    const uint8_t *src_u = reinterpret_cast<const uint8_t*>(src);
-    for (size_t idx = 0; idx < n; idx++) {
-        dest_u[idx] = src_u[idx];
-        if (write_to_nvm) {
-            shutdown_counter--;
-            if (!shutdown_counter) {
-                exit_with_status(2);
+    add_counter(offsetof(Counters, dma_invocations), 1);
+    add_counter(offsetof(Counters, dma_bytes), n);
+#endif
+    if (write_to_nvm && bytewise_nvm_writes) {
+        // Not using memcpy here so that it is more likely that power fails during
+        // memcpy, which is the case for external FRAM
+        uint8_t *dest_u = reinterpret_cast<uint8_t*>(dest);
+        const uint8_t *src_u = reinterpret_cast<const uint8_t*>(src);
+        for (size_t idx = 0; idx < n; idx++) {
+#ifdef __linux__
+            if (power_failure_pending) {
+                simulate_power_failure();
             }
+#endif
+            dest_u[idx] = src_u[idx];
+            if (shutdown_counter != UINT32_MAX) {
+                shutdown_counter--;
+                if (!shutdown_counter) {
+                    simulate_power_failure();
+                }
+            }
+        }
+        return;
+    }
+#ifdef __linux__
+    if (write_to_nvm && power_failure_pending) {
+        simulate_power_failure();
+    }
+#endif
+    if (write_to_nvm && shutdown_counter != UINT32_MAX) {
+        if (n >= shutdown_counter) {
+            // Power fails in this write - only bytes before the failure point reach NVM
+            memcpy(dest, src, shutdown_counter);
+            simulate_power_failure();
         }
+        shutdown_counter -= n;
     }
+    memcpy(dest, src, n);
 }
 
 void my_memcpy(void* dest, const void* src, size_t n) {
@@ -192,22 +699,227 @@ void my_memcpy_from_parameters(void *dest, const ParameterInfo *param, uint32_t
     my_memcpy(dest, parameters_data + param->params_offset + offset_in_bytes, n);
 }
 
+/* Asynchronous NVM writes (-a). Each thread has a queue of writes, which are done in order by a writer thread.
+ * Unlike DMA, data are copied into the queue, so that callers can reuse their buffers right away.
+ * Whether power fails in a write is decided when the write is issued, and all queued writes are finished
+ * before that write, so that NVM is the same as with synchronous writes at each power failure. */
+#define NVM_WRITE_QUEUE_LEN 64
+
+struct PendingNvmWrite {
+    uint8_t *dest;
+    size_t n;
+    uint8_t data[1024];
+};
+
+struct NvmWriteQueue {
+    std::mutex mutex;
+    // For both new writes and finished writes
+    std::condition_variable changed;
+    std::unique_ptr<PendingNvmWrite[]> writes;
+    // The write at head is being written by the writer thread
+    uint16_t head = 0, n_pending = 0;
+    // If the issuing thread is blocked on the queue
+    uint8_t waiting = 0;
+    uint8_t stopping = 0;
+    std::thread writer;
+
+    NvmWriteQueue();
+    ~NvmWriteQueue();
+};
+
+// Created at the first asynchronous write of each thread
+static PLAT_THREAD_LOCAL std::unique_ptr<NvmWriteQueue> nvm_write_queue;
+
+static void nvm_writer_main(NvmWriteQueue *queue) {
+#ifdef __linux__
+    // Signals for power failures (-R timer) are handled by threads running the inference
+    sigset_t all_signals;
+    sigfillset(&all_signals);
+    pthread_sigmask(SIG_BLOCK, &all_signals, nullptr);
+#endif
+    std::unique_lock<std::mutex> lock(queue->mutex);
+    while (1) {
+        queue->changed.wait(lock, [queue] { return queue->n_pending || queue->stopping; });
+        if (!queue->n_pending) {
+            return;
+        }
+        const PendingNvmWrite *write = &queue->writes[queue->head];
+        uint8_t waited = queue->waiting;
+        lock.unlock();
+
+        auto write_start = std::chrono::steady_clock::now();
+        if (bytewise_nvm_writes) {
+            for (size_t idx = 0; idx < write->n; idx++) {
+                write->dest[idx] = write->data[idx];
+            }
+        } else {
+            memcpy(write->dest, write->data, write->n);
+        }
+        uint64_t write_ns = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - write_start).count();
+
+        lock.lock();
+        async_nvm_writes_ns += write_ns;
+        // Overlapped with computation if the issuing thread is not blocked during the write
+        if (!waited && !queue->waiting) {
+            async_nvm_writes_hidden_ns += write_ns;
+        }
+        queue->head = (queue->head + 1) % NVM_WRITE_QUEUE_LEN;
+        queue->n_pending--;
+        queue->changed.notify_all();
+    }
+}
+
+NvmWriteQueue::NvmWriteQueue() : writes(new PendingNvmWrite[NVM_WRITE_QUEUE_LEN]), writer(nvm_writer_main, this) {}
+
+NvmWriteQueue::~NvmWriteQueue() {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = 1;
+        changed.notify_all();
+    }
+    // The writer thread finishes remaining writes before stopping
+    writer.join();
+}
+
+template<typename Pred>
+static void wait_nvm_write_queue(NvmWriteQueue *queue, std::unique_lock<std::mutex> *lock, Pred pred) {
+    if (pred()) {
+        return;
+    }
+    auto wait_start = std::chrono::steady_clock::now();
+    queue->waiting = 1;
+    queue->changed.wait(*lock, pred);
+    queue->waiting = 0;
+    async_nvm_writes_waiting_ns += std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - wait_start).count();
+}
+
+void wait_nvm_writes(void) {
+    NvmWriteQueue *queue = nvm_write_queue.get();
+    if (!queue) {
+        return;
+    }
+    std::unique_lock<std::mutex> lock(queue->mutex);
+    wait_nvm_write_queue(queue, &lock, [queue] { return !queue->n_pending; });
+}
+
+#ifdef __linux__
+// Only the forking thread exists in a forked process (e.g., power failure sweeps). Its queue is empty
+// after wait_nvm_writes() in the parent, and is dropped without stopping the writer, which is not forked.
+static void drop_nvm_write_queue(void) {
+    nvm_write_queue.release();
+}
+#endif
+
+// Wait for queued writes overlapping with [begin, begin + n), so that reads see data written before
+static void wait_overlapping_nvm_writes(const uint8_t *begin, size_t n) {
+    NvmWriteQueue *queue = nvm_write_queue.get();
+    if (!queue) {
+        return;
+    }
+    std::unique_lock<std::mutex> lock(queue->mutex);
+    for (uint16_t idx = 0; idx < queue->n_pending; idx++) {
+        const PendingNvmWrite *write = &queue->writes[(queue->head + idx) % NVM_WRITE_QUEUE_LEN];
+        if (write->dest < begin + n && begin < write->dest + write->n) {
+            wait_nvm_write_queue(queue, &lock, [queue] { return !queue->n_pending; });
+            return;
+        }
+    }
+}
+
+static uint8_t power_fails_in_write(size_t n) {
+#ifdef __linux__
+    if (power_failure_pending) {
+        return 1;
+    }
+#endif
+    return shutdown_counter != UINT32_MAX && n >= shutdown_counter;
+}
+
+static void queue_nvm_write(uint8_t *dest, const void *src, size_t n) {
+#if ENABLE_COUNTERS
+    add_counter(offsetof(Counters, dma_invocations), 1);
+    add_counter(offsetof(Counters, dma_bytes), n);
+#endif
+    if (shutdown_counter != UINT32_MAX) {
+        shutdown_counter -= n;
+    }
+    async_nvm_writes_count++;
+
+    if (!nvm_write_queue) {
+#ifdef __linux__
+        static std::once_flag fork_handlers_registered;
+        std::call_once(fork_handlers_registered, [] { pthread_atfork(wait_nvm_writes, nullptr, drop_nvm_write_queue); });
+#endif
+        nvm_write_queue.reset(new NvmWriteQueue);
+    }
+    NvmWriteQueue *queue = nvm_write_queue.get();
+    std::unique_lock<std::mutex> lock(queue->mutex);
+    wait_nvm_write_queue(queue, &lock, [queue] { return queue->n_pending < NVM_WRITE_QUEUE_LEN; });
+    PendingNvmWrite *write = &queue->writes[(queue->head + queue->n_pending) % NVM_WRITE_QUEUE_LEN];
+    write->dest = dest;
+    write->n = n;
+    memcpy(write->data, src, n);
+    queue->n_pending++;
+    queue->changed.notify_all();
+}
+
 void read_from_nvm(void *vm_buffer, uint32_t nvm_offset, size_t n) {
     MY_ASSERT(n <= 1024);
+    nvm_bytes_read += n;
+    if (async_nvm_writes) {
+        wait_overlapping_nvm_writes(nvm + nvm_offset, n);
+    }
     my_memcpy_ex(vm_buffer, nvm + nvm_offset, n, 0);
 }
 
+// Writes are never delayed with timer_delay, and are asynchronous with -a regardless of timer_delay
 void write_to_nvm(const void *vm_buffer, uint32_t nvm_offset, size_t n, uint16_t timer_delay) {
     MY_ASSERT(n <= 1024);
     check_nvm_write_address(nvm_offset, n);
+    nvm_bytes_written += n;
+    if (nvm_write_hook) {
+        nvm_write_hook(n);
+    }
+    if (async_nvm_writes) {
+        if (!power_fails_in_write(n)) {
+            queue_nvm_write(nvm + nvm_offset, vm_buffer, n);
+            return;
+        }
+        wait_nvm_writes();
+    }
     my_memcpy_ex(nvm + nvm_offset, vm_buffer, n, 1);
 }
 
+void arm_power_failure(uint32_t n_bytes) {
+    shutdown_counter = n_bytes;
+}
+
+void set_nvm_write_hook(void (*hook)(size_t n)) {
+    nvm_write_hook = hook;
+}
+
+uint8_t *replace_nvm(uint8_t *new_nvm) {
+    wait_nvm_writes();
+    uint8_t *old_nvm = nvm;
+    nvm = new_nvm;
+    return old_nvm;
+}
+
 void my_erase() {
+    wait_nvm_writes();
     memset(nvm, 0, NVM_SIZE);
 }
 
 void copy_samples_data(void) {
+#ifdef BENCH_BUILD
+    // No samples.bin for the synthetic model
+    write_to_nvm_segmented(samples_data, SAMPLES_OFFSET, SAMPLES_DATA_LEN);
+#elif MODEL_BUNDLE
+    // All samples are in the bundle
+    for (uint32_t offset = 0; offset < SAMPLES_DATA_LEN; offset += 1024) {
+        write_to_nvm(samples_data + offset, SAMPLES_OFFSET + offset, MIN_VAL(SAMPLES_DATA_LEN - offset, 1024u));
+    }
+#else
     std::ifstream samples_file("samples.bin", std::ios::binary);
     MY_ASSERT(samples_file.good(), "Failed to open samples.bin");
     const uint16_t samples_buflen = 1024;
@@ -220,6 +932,7 @@ void copy_samples_data(void) {
         samples_offset += read_len;
         my_printf_debug("Copied %d bytes of samples data" NEWLINE, read_len);
     }
+#endif
 }
 
 void notify_model_finished(void) {}
@@ -4,5 +4,27 @@
 
 #define PLAT_LABELS_DATA_LEN LABELS_DATA_LEN
 
-#define plat_start_cpu_counter()
-#define plat_stop_cpu_counter() 1
+// Engine states are per-thread on PC so that samples can be evaluated in parallel
+#define PLAT_THREAD_LOCAL thread_local
+#define PLAT_HAS_THREADS 1
+// Counters can be enabled with command line options (see profiler.h)
+#define PLAT_RUNTIME_COUNTERS 1
+
+// CPU cycles via perf_event_open() on Linux if available, or nanoseconds of thread CPU time otherwise
+void plat_start_cpu_counter(void);
+uint64_t plat_stop_cpu_counter(void);
+// Select the backend for CPU counters. Instructions and cache misses are also counted with extra_events
+void init_cpu_counters(uint8_t extra_events);
+
+// Allocate NVM in memory, which is lost after the program exits
+void init_volatile_nvm(void);
+// Bytes read from and written to NVM by the current thread
+void get_nvm_traffic(uint64_t *bytes_read, uint64_t *bytes_written);
+
+// For power failure sweeps (see power_sweep.h)
+// Simulate a power failure after n_bytes more bytes are written to NVM, as with -c
+void arm_power_failure(uint32_t n_bytes);
+// The hook is called with the size of each NVM write of the current process before the write
+void set_nvm_write_hook(void (*hook)(size_t n));
+// Use new_nvm as NVM of the current thread, and return the previous one
+uint8_t *replace_nvm(uint8_t *new_nvm);
@@ -8,11 +8,15 @@
 #include "cnn_common.h"
 #include "my_debug.h"
 #include "intermittent-cnn.h" // for sample_idx
+#include "op_utils.h"
 
 // put offset checks here as extra headers are used
-static_assert(NODES_OFFSET > SAMPLES_OFFSET + SAMPLES_DATA_LEN, "Incorrect NVM layout");
+#if !MODEL_BUNDLE
+// Checked in load_model_bundle() otherwise
+static_assert(PROGRESS_HINT_OFFSET > SAMPLES_OFFSET + SAMPLES_DATA_LEN, "Incorrect NVM layout");
+#endif
 
-Model model_vm;
+PLAT_THREAD_LOCAL Model model_vm;
 
 template<typename T>
 static uint32_t nvm_addr(uint8_t, uint16_t);
@@ -24,8 +28,8 @@ T* vm_addr(uint16_t data_idx);
 template<typename T>
 const char* datatype_name(void);
 
-static uint32_t intermediate_values_offset(uint8_t slot_id) {
-    return INTERMEDIATE_VALUES_OFFSET + slot_id * INTERMEDIATE_VALUES_SIZE;
+static uint32_t intermediate_values_offset(const ParameterInfo *param) {
+    return INTERMEDIATE_VALUES_OFFSET + param->params_offset;
 }
 
 static uint32_t intermediate_parameters_info_addr(uint8_t i) {
@@ -47,25 +51,60 @@ const char* datatype_name<Model>(void) {
     return "model";
 }
 
+// Narrow q15 values in src to 8-bit values in chunks, and write them from offset_in_word
+static void write_8bit_intermediate_values(const ParameterInfo *param, uint16_t offset_in_word, const int16_t *src, uint16_t len, uint16_t timer_delay) {
+    const uint8_t CHUNK_LEN = 64;
+    int8_t chunk[CHUNK_LEN];
+    for (uint16_t chunk_offset = 0; chunk_offset < len; chunk_offset += CHUNK_LEN) {
+        uint16_t cur_chunk_len = MIN_VAL(CHUNK_LEN, len - chunk_offset);
+        for (uint16_t idx = 0; idx < cur_chunk_len; idx++) {
+            chunk[idx] = narrow_intermediate_value(src[chunk_offset + idx], offset_in_word + chunk_offset + idx);
+        }
+        write_to_nvm(chunk, intermediate_values_offset(param) + offset_in_word + chunk_offset, cur_chunk_len, timer_delay);
+    }
+}
+
+/* n is the size of q15 values in src. Intermediate values with bitwidth 8 are narrowed while writing,
+ * so that only n / 2 bytes are written to NVM */
 void my_memcpy_to_param(ParameterInfo *param, uint16_t offset_in_word, const void *src, size_t n, uint16_t timer_delay) {
-    MY_ASSERT(param->bitwidth == 16);
+    MY_ASSERT(param->bitwidth == 16 || param->bitwidth == 8);
     MY_ASSERT(param->slot < NUM_SLOTS);
-    uint32_t total_offset = param->params_offset + offset_in_word * sizeof(int16_t);
-    MY_ASSERT(total_offset + n <= param->params_len);
-    write_to_nvm(src, intermediate_values_offset(param->slot) + total_offset, n, timer_delay);
+    const uint8_t value_size = param->bitwidth / 8;
+    uint32_t total_offset = offset_in_word * value_size;
+    size_t nvm_len = n / sizeof(int16_t) * value_size;
+    MY_ASSERT(total_offset + nvm_len <= param->params_len);
+    if (param->bitwidth == 8) {
+        write_8bit_intermediate_values(param, offset_in_word, reinterpret_cast<const int16_t*>(src), n / sizeof(int16_t), timer_delay);
+    } else {
+        write_to_nvm(src, intermediate_values_offset(param) + total_offset, n, timer_delay);
+    }
 #if ENABLE_COUNTERS
 #if JAPARI
-    uint16_t n_footprints = n / (BATCH_SIZE + 1);
-    counters()->job_preservation += n - n_footprints;
-    counters()->footprint_preservation += n_footprints;
+    uint16_t n_footprints = nvm_len / (BATCH_SIZE + 1);
+    add_counter(offsetof(Counters, job_preservation), nvm_len - n_footprints);
+    add_counter(offsetof(Counters, footprint_preservation), n_footprints);
 #else
-    counters()->job_preservation += n;
+    add_counter(offsetof(Counters, job_preservation), nvm_len);
+#endif
 #endif
+#if INDIRECT_RECOVERY && PROGRESS_HINT_INTERVAL
+    record_job_progress(param, offset_in_word, n);
 #endif
 }
 
 void my_memcpy_from_intermediate_values(void *dest, const ParameterInfo *param, uint16_t offset_in_word, size_t n) {
-    read_from_nvm(dest, intermediate_values_offset(param->slot) + offset_in_word * sizeof(int16_t), n);
+    if (param->bitwidth == 8) {
+        // Like read_q7_parameters(), 8-bit values are read into the upper half of dest, and widened in place from the beginning
+        uint16_t len = n / sizeof(int16_t);
+        int16_t *dest_q15 = reinterpret_cast<int16_t*>(dest);
+        int8_t *values = reinterpret_cast<int8_t*>(dest) + len;
+        read_from_nvm(values, intermediate_values_offset(param) + offset_in_word, len);
+        for (uint16_t idx = 0; idx < len; idx++) {
+            dest_q15[idx] = widen_intermediate_value(values[idx], offset_in_word + idx);
+        }
+        return;
+    }
+    read_from_nvm(dest, intermediate_values_offset(param) + offset_in_word * sizeof(int16_t), n);
 }
 
 void read_from_samples(void *dest, uint16_t offset_in_word, size_t n) {
@@ -163,7 +202,7 @@ void commit_model(void) {
     commit_versioned_data<Model>(0);
     // send finish signals only after the whole network has really finished
 #if ENABLE_COUNTERS
-    counters()->power_counters++;
+    add_counter(offsetof(Counters, power_counters), 1);
 #endif
     if (!model_vm.running) {
         notify_model_finished();
@@ -185,7 +224,7 @@ void first_run(void) {
     load_model_from_nvm(); // refresh model_vm
     commit_model();
 
-    my_printf_debug("Init for " CONFIG "/" METHOD " with batch size=%d" NEWLINE, BATCH_SIZE);
+    my_printf_debug("Init for %s/" METHOD " with batch size=%d" NEWLINE, CONFIG, BATCH_SIZE);
 }
 
 void write_to_nvm_segmented(const uint8_t* vm_buffer, uint32_t nvm_offset, uint16_t total_len, uint16_t segment_size) {
@@ -196,12 +235,12 @@ void write_to_nvm_segmented(const uint8_t* vm_buffer, uint32_t nvm_offset, uint1
 
 void record_overflow_handling_overhead(uint32_t cycles) {
 #if ENABLE_COUNTERS
-    counters()->overflow_handling += cycles;
+    add_counter(offsetof(Counters, overflow_handling), cycles);
 #endif
 }
 
 #if HAWAII
-Node::Footprint footprints_vm[MODEL_NODES_LEN];
+PLAT_THREAD_LOCAL Node::Footprint footprints_vm[MAX_MODEL_NODES_LEN];
 
 template<>
 uint32_t nvm_addr<Node::Footprint>(uint8_t i, uint16_t layer_idx) {
@@ -242,3 +281,21 @@ void reset_hawaii_layer_footprint(uint16_t layer_idx) {
     my_printf_debug("Reset HAWAII layer footprint for layer %d" NEWLINE, layer_idx);
 }
 #endif
+
+void reset_volatile_states(void) {
+    memset(&model_vm, 0, sizeof(model_vm));
+    memset(intermediate_parameters_info_vm, 0, sizeof(intermediate_parameters_info_vm));
+#if HAWAII
+    memset(footprints_vm, 0, sizeof(footprints_vm));
+#endif
+    sample_idx = 0;
+    reset_op_states();
+    reset_conv_states();
+    reset_maxpool_states();
+#if INDIRECT_RECOVERY
+    reset_recovery_state();
+#endif
+    // Counters are on NVM for MCUs, and only the running CPU counter is lost
+    current_counter = prev_counter = INVALID_POINTER;
+    // Scratch buffers (ex: pState for ARM CMSIS) are always written before read and not cleared
+}
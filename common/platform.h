@@ -13,22 +13,27 @@
 
 // growing up (like heap). Not starting from zero as first few 16 bytes are for testing (see testSPI() function)
 #define INTERMEDIATE_VALUES_OFFSET 256
-#define SAMPLES_OFFSET (INTERMEDIATE_VALUES_OFFSET + NUM_SLOTS * INTERMEDIATE_VALUES_SIZE)
+// INTERMEDIATE_VALUES_SIZE bytes for intermediate values, with offsets planned by transform.py
+#define SAMPLES_OFFSET (INTERMEDIATE_VALUES_OFFSET + INTERMEDIATE_VALUES_SIZE)
 
 // growing down (like stack)
 #define FIRST_RUN_OFFSET (NVM_SIZE - 2)
 #define MODEL_OFFSET (FIRST_RUN_OFFSET - 2 * MODEL_DATA_LEN)
 #define INTERMEDIATE_PARAMETERS_INFO_OFFSET (MODEL_OFFSET - INTERMEDIATE_PARAMETERS_INFO_DATA_LEN)
 #define NODES_OFFSET (INTERMEDIATE_PARAMETERS_INFO_OFFSET - NODES_DATA_LEN)
+#define PROGRESS_HINT_DATA_LEN 4
+#define PROGRESS_HINT_OFFSET (NODES_OFFSET - PROGRESS_HINT_DATA_LEN)
 
 struct ParameterInfo;
 struct Model;
 struct Counters;
-extern Model model_vm;
+extern PLAT_THREAD_LOCAL Model model_vm;
 
 [[ noreturn ]] void ERROR_OCCURRED(void);
 void read_from_nvm(void* vm_buffer, uint32_t nvm_offset, size_t n);
 void write_to_nvm(const void* vm_buffer, uint32_t nvm_offset, size_t n, uint16_t timer_delay = 0);
+// Wait until all NVM writes issued by the current thread are finished, like SPI_WAIT_DMA()
+void wait_nvm_writes(void);
 // DMA controller on MSP432 can handle at most 1024 words at a time
 void write_to_nvm_segmented(const uint8_t* vm_buffer, uint32_t nvm_offset, uint16_t total_len, uint16_t segment_size = 1024);
 void my_erase(void);
@@ -45,6 +50,8 @@ Model* get_model(void);
 Model* load_model_from_nvm(void);
 void commit_model(void);
 void first_run(void);
+// Clear volatile memory as when the program starts, for power failures simulated without restarting the program
+void reset_volatile_states(void);
 void notify_model_finished(void);
 #if HAWAII
 void write_hawaii_layer_footprint(uint16_t layer_idx, int16_t n_jobs);
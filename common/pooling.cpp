@@ -1,5 +1,6 @@
 #include <cstddef>
 #include <cstdint>
+#include <cstring>
 #include "data.h"
 #include "cnn_common.h"
 #include "counters.h"
@@ -16,6 +17,7 @@ struct MaxPoolParams {
     uint16_t n_channels;
     uint8_t need_nhwc2nchw;
     uint8_t ceil_mode;
+    uint8_t fused_relu;
     uint8_t stride_h;
     uint8_t stride_w;
     uint16_t H;
@@ -27,7 +29,11 @@ struct MaxPoolParams {
     const ParameterInfo *output;
     Model *model;
 };
-static MaxPoolParams maxpool_params_obj;
+static PLAT_THREAD_LOCAL MaxPoolParams maxpool_params_obj;
+
+void reset_maxpool_states(void) {
+    memset(&maxpool_params_obj, 0, sizeof(maxpool_params_obj));
+}
 
 enum {
     KERNEL_SHAPE_H = 0,
@@ -58,6 +64,7 @@ void alloc_maxpool(Model *model, const ParameterInfo *input[], ParameterInfo *ou
         maxpool_params->new_W = (maxpool_params->W + maxpool_params->stride_w - 1) / maxpool_params->stride_w;
     }
     maxpool_params->need_nhwc2nchw = (node->flags.generic & NHWC2NCHW);
+    maxpool_params->fused_relu = (node->flags.generic & FUSED_RELU);
 
 #if JAPARI
     start_cpu_counter(offsetof(Counters, embedding));
@@ -69,7 +76,7 @@ void alloc_maxpool(Model *model, const ParameterInfo *input[], ParameterInfo *ou
 #endif
 
     output->params_len = maxpool_params->new_H * maxpool_params->new_W * CHANNEL * sizeof(int16_t);
-    output->slot = get_next_slot(model, data);
+    output->bitwidth = 16;
     output->dims[0] = 1;
     output->dims[1] = CHANNEL;
     output->dims[2] = maxpool_params->new_H;
@@ -92,7 +99,8 @@ static uint16_t maxpool_patch(MaxPoolParams *maxpool_params) {
 
     int16_t* const input_buffer = lea_buffer + maxpool_params->n_channels;
     int16_t* const output_buffer = lea_buffer;
-    my_fill_q15(INT16_MIN, output_buffer, maxpool_params->n_channels);
+    // ReLU is the same as max pooling with an additional zero in each window
+    my_fill_q15(maxpool_params->fused_relu ? 0 : INT16_MIN, output_buffer, maxpool_params->n_channels);
 
     // explicitly initialize this as -Wmaybe-uninitialized may be triggered with -O3
     // https://gcc.gnu.org/bugzilla/show_bug.cgi?id=60165
@@ -107,6 +115,11 @@ static uint16_t maxpool_patch(MaxPoolParams *maxpool_params) {
             }
             uint16_t val_offset = input_h * offset_h + input_w * offset_w + maxpool_params->start_channel;
             my_memcpy_from_param(maxpool_params->model, input_buffer, maxpool_params->data, val_offset, maxpool_params->n_channels * sizeof(int16_t));
+#if STATEFUL
+            start_cpu_counter(offsetof(Counters, stripping));
+            my_strip_states_q15(input_buffer, maxpool_params->n_channels, maxpool_params->start_channel % BATCH_SIZE, BATCH_SIZE, true);
+            stop_cpu_counter();
+#endif
             output_channel_offset = 0;
             for (uint16_t input_channel_offset = 0; input_channel_offset < maxpool_params->n_channels; input_channel_offset++) {
 #if JAPARI
@@ -123,14 +136,6 @@ static uint16_t maxpool_patch(MaxPoolParams *maxpool_params) {
                 }
 #endif
                 int16_t val = input_buffer[input_channel_offset];
-#if STATEFUL
-                start_cpu_counter(offsetof(Counters, stripping));
-                if (offset_has_state(maxpool_params->start_channel + input_channel_offset)) {
-                    strip_state(&val);
-                }
-                val *= 2;
-                stop_cpu_counter();
-#endif
                 // dump_value_debug(model, maxpool_params->data, val_offset);
                 my_printf_debug("% 6d ", val);
                 if (val > output_buffer[output_channel_offset]) {
@@ -188,7 +193,7 @@ void handle_maxpool(Model *model, const ParameterInfo *input[], ParameterInfo *o
 #if INTERMITTENT
     start_cpu_counter(offsetof(Counters, progress_seeking));
     uint32_t first_unfinished_value_offset = batch_start(job_index_to_offset(output, run_recovery(model, output)));
-    if (first_unfinished_value_offset * sizeof(int16_t) == output->params_len) {
+    if (first_unfinished_value_offset == get_values_len(output)) {
         // give up early, or initial_real_tile_c may be zero and results in SIGFPE
         stop_cpu_counter();
         goto finished;
@@ -288,6 +293,8 @@ void handle_maxpool(Model *model, const ParameterInfo *input[], ParameterInfo *o
             stop_cpu_counter();
 #endif
 
+            // Values are written one by one in NCHW
+            start_combining_outputs(output, output_offset);
             uint8_t channel_stride = 1;
             for (; c < CHANNEL; c += channel_stride) {
 #if JAPARI
@@ -315,7 +322,7 @@ void handle_maxpool(Model *model, const ParameterInfo *input[], ParameterInfo *o
                             start_cpu_counter(offsetof(Counters, state_query));
                             check_next_turning_point(offset, output_turning_point_idx, next_output_turning_point, output_slot_info, output_offset);
                             stop_cpu_counter();
-                            put_q15_param(output, output_offset, (offset == 0x4000 ? 1 : -1));
+                            put_combined_output(model, (offset == 0x4000 ? 1 : -1));
                             output_offset++;
                         }
                         stop_cpu_counter();
@@ -345,12 +352,7 @@ void handle_maxpool(Model *model, const ParameterInfo *input[], ParameterInfo *o
                         stop_cpu_counter();
 #endif
                         my_printf_debug("max=% 6d " NEWLINE, lea_buffer[0]);
-                        put_q15_param(output, output_offset, lea_buffer[0]);
-#if HAWAII
-                        if (offset_has_state(output_offset)) {
-                            write_hawaii_layer_footprint(model->layer_idx, BATCH_SIZE);
-                        }
-#endif
+                        put_combined_output(model, lea_buffer[0]);
                         output_offset++;
                         maxpool_params->output_w++;
                     }
@@ -359,12 +361,13 @@ void handle_maxpool(Model *model, const ParameterInfo *input[], ParameterInfo *o
                 output_h = 0;
             }
             c = 0;
+            flush_combined_outputs(model);
             report_progress();
         }
     }
 
-    MY_ASSERT(output_offset == output->params_len / sizeof(int16_t),
-              "Expect output offset %d, got %d" NEWLINE, output->params_len / sizeof(int16_t), output_offset);
+    MY_ASSERT(output_offset == get_values_len(output),
+              "Expect output offset %d, got %d" NEWLINE, get_values_len(output), output_offset);
 
 #if INTERMITTENT
 finished:
@@ -394,7 +397,6 @@ void alloc_globalaveragepool(Model *model, const ParameterInfo *input[], Paramet
     output->dims[1] = output_len;
     output->params_len = output_len * sizeof(int16_t);
     output->bitwidth = 16;
-    output->slot = get_next_slot(model, data);
 }
 
 void handle_globalaveragepool(Model *model, const ParameterInfo *input[], ParameterInfo *output, const Node* node) {
@@ -402,49 +404,71 @@ void handle_globalaveragepool(Model *model, const ParameterInfo *input[], Parame
 
     const ParameterInfo *data = input[0];
 
-#if STATEFUL
-    start_cpu_counter(offsetof(Counters, state_query));
-    int16_t offset;
-    uint16_t next_output_turning_point;
-    uint8_t output_turning_point_idx;
-    SlotInfo *output_slot_info;
-    find_initial_state_bit(&offset, &output_turning_point_idx, &next_output_turning_point, &output_slot_info, 0 /*TODO: first_unfinished_value_offset*/, model, output);
-    offset = -offset;
+    uint16_t CHANNEL = data->dims[1], H = data->dims[2], W = data->dims[3];
+    uint16_t len = H * W;
+    uint16_t first_channel = 0;
+
+#if INTERMITTENT
+    start_cpu_counter(offsetof(Counters, progress_seeking));
+    uint32_t first_unfinished_value_offset = batch_start(job_index_to_offset(output, run_recovery(model, output)));
     stop_cpu_counter();
+    if (first_unfinished_value_offset >= get_values_len(output)) {
+        first_unfinished_value_offset = CHANNEL;
+    }
+    first_channel = first_unfinished_value_offset;
+    my_printf_debug("first_channel = %d" NEWLINE, first_channel);
 #endif
 
-    uint16_t CHANNEL = data->dims[1], H = data->dims[2], W = data->dims[3];
-    uint16_t len = H * W;
-    uint16_t output_channel = 0;
-    for (uint16_t input_channel = 0; input_channel < CHANNEL; input_channel++) {
-        int16_t output_val;
-#if JAPARI
-        start_cpu_counter(offsetof(Counters, embedding));
-        bool need_embedding = offset_has_state(input_channel);
-        if (need_embedding) {
-            output_val = -param_state_bit(model, output, output_channel);
-        }
+    if (first_channel < CHANNEL) {
+#if STATEFUL
+        start_cpu_counter(offsetof(Counters, state_query));
+        int16_t offset;
+        uint16_t next_output_turning_point;
+        uint8_t output_turning_point_idx;
+        SlotInfo *output_slot_info;
+        find_initial_state_bit(&offset, &output_turning_point_idx, &next_output_turning_point, &output_slot_info, first_channel, model, output);
+        offset = -offset;
         stop_cpu_counter();
-        if (!need_embedding)
 #endif
-        {
-            uint32_t total = 0;
-            for (uint16_t h = 0; h < H; h++) {
-                for (uint16_t w = 0; w < W; w++) {
-                    // Input is from Conv, which uses NHWC
-                    int16_t val = get_q15_param(model, data, h * W * CHANNEL + w * CHANNEL + input_channel);
+        // Sums of all unfinished channels are accumulated in a pass over the input, and
+        // the remaining part of lea_buffer is for reading the input
+        uint16_t n_channels = CHANNEL - first_channel;
+        int32_t *totals = reinterpret_cast<int32_t*>(lea_buffer);
+        int16_t *buffer = lea_buffer + 2 * n_channels;
+        uint16_t buffer_len = LIMIT_DMA_SIZE(LEA_BUFFER_SIZE - 2 * n_channels);
+        MY_ASSERT(buffer_len >= n_channels);
+        memset(totals, 0, n_channels * sizeof(int32_t));
+
+        // Input is from Conv, which uses NHWC. Values of all channels of consecutive pixels are
+        // contiguous, while only some channels of each pixel are needed after recovery.
+        uint16_t pixels_per_read = first_channel ? 1 : (buffer_len / CHANNEL);
+        for (uint16_t pixel = 0; pixel < len; pixel += pixels_per_read) {
+            uint16_t cur_pixels = MIN_VAL(pixels_per_read, len - pixel);
+            my_memcpy_from_param(model, buffer, data, pixel * CHANNEL + first_channel, cur_pixels * n_channels * sizeof(int16_t));
+            for (uint16_t pixel_offset = 0; pixel_offset < cur_pixels; pixel_offset++) {
+                int16_t *vals = buffer + pixel_offset * n_channels;
 #if STATEFUL
-                    start_cpu_counter(offsetof(Counters, stripping));
-                    if (offset_has_state(input_channel)) {
-                        strip_state(&val);
-                    }
-                    val *= 2;
-                    stop_cpu_counter();
+                start_cpu_counter(offsetof(Counters, stripping));
+                my_strip_states_q15(vals, n_channels, first_channel, BATCH_SIZE, true);
+                stop_cpu_counter();
 #endif
-                    total += val;
+                for (uint16_t channel_offset = 0; channel_offset < n_channels; channel_offset++) {
+                    totals[channel_offset] += vals[channel_offset];
                 }
             }
-            output_val = total / len;
+        }
+
+        int16_t *output_vals = buffer;
+        for (uint16_t output_channel = first_channel; output_channel < CHANNEL; output_channel++) {
+            uint16_t channel_offset = output_channel - first_channel;
+            int16_t output_val = totals[channel_offset] / len;
+#if JAPARI
+            start_cpu_counter(offsetof(Counters, embedding));
+            if (offset_has_state(output_channel)) {
+                output_val = -param_state_bit(model, output, output_channel);
+            }
+            stop_cpu_counter();
+#endif
 #if STATEFUL
             start_cpu_counter(offsetof(Counters, embedding));
             output_val /= 2;
@@ -456,9 +480,12 @@ void handle_globalaveragepool(Model *model, const ParameterInfo *input[], Parame
             }
             stop_cpu_counter();
 #endif
+            output_vals[channel_offset] = output_val;
         }
-        put_q15_param(output, output_channel, output_val);
-        output_channel++;
+        my_memcpy_to_param(output, first_channel, output_vals, n_channels * sizeof(int16_t), 0);
+#if HAWAII
+        write_hawaii_layer_footprint(model->layer_idx, n_channels / BATCH_SIZE * BATCH_SIZE);
+#endif
     }
 
 #if INDIRECT_RECOVERY
@@ -0,0 +1,403 @@
+#include "platform.h"
+
+#if defined(PC_BUILD) && defined(__linux__)
+
+#include <algorithm>
+#include <chrono>
+#include <cinttypes>
+#include <cstdio>
+#include <cstring>
+#include <map>
+#include <thread>
+#include <vector>
+#include <signal.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+#include "cnn_common.h"
+#include "data.h"
+#include "intermittent-cnn.h"
+#include "my_debug.h"
+#include "my_dsplib.h"
+#include "power_sweep.h"
+
+enum SweepStatus : uint8_t {
+    SWEEP_PENDING,
+    SWEEP_PASSED,
+    SWEEP_WRONG_OUTPUTS,
+    // The inference finishes before the failure point, as NVM writes are not deterministic
+    SWEEP_NOT_FAILED,
+    SWEEP_CRASHED,
+    SWEEP_TIMED_OUT,
+};
+
+static const char * const sweep_status_names[] = {
+    "pending", "passed", "wrong outputs", "not failed", "crashed", "timed out",
+};
+
+struct NvmWrite {
+    uint32_t n;
+    uint16_t layer_idx;
+};
+
+// Shared with processes of failure points
+struct SweepPoint {
+    uint32_t write_idx;
+    // NVM bytes written in the sample before the power failure, including bytes of the interrupted write
+    uint32_t failure_bytes;
+    uint16_t layer_idx;
+    uint8_t status;
+    int wait_status;
+    // NVM bytes written in addition to the run without power failures
+    int64_t extra_bytes;
+};
+
+// Only the first sample is run
+#define SWEEP_SAMPLE_IDX 0
+// Timeouts of failure points, relative to the run without power failures
+#define SWEEP_TIMEOUT_FACTOR 10
+#define SWEEP_MIN_TIMEOUT_SECONDS 10
+#define SWEEP_FAILED_POINTS_TO_SHOW 10
+
+static std::vector<NvmWrite> *recorded_writes;
+
+static void record_nvm_write(size_t n) {
+    if (n) {
+        recorded_writes->push_back(NvmWrite{static_cast<uint32_t>(n), get_model()->layer_idx});
+    }
+}
+
+static void write_all(int fd, const void *buf, size_t n) {
+    const uint8_t *ptr = reinterpret_cast<const uint8_t*>(buf);
+    while (n) {
+        ssize_t written = write(fd, ptr, n);
+        if (written <= 0) {
+            perror("Writing to the pipe failed");
+            ERROR_OCCURRED();
+        }
+        ptr += written;
+        n -= written;
+    }
+}
+
+static uint8_t read_all(int fd, void *buf, size_t n) {
+    uint8_t *ptr = reinterpret_cast<uint8_t*>(buf);
+    while (n) {
+        ssize_t n_read = read(fd, ptr, n);
+        if (n_read <= 0) {
+            return 0;
+        }
+        ptr += n_read;
+        n -= n_read;
+    }
+    return 1;
+}
+
+// Values of the last layer without states, which may differ after recovery
+static void read_model_outputs(std::vector<int16_t> *outputs) {
+    const ParameterInfo *output_node = get_parameter_info(MODEL_NODES_LEN + N_INPUT - 1);
+    uint32_t outputs_len = get_values_len(output_node);
+    outputs->resize(outputs_len);
+    // NVM reads are at most 1024 bytes
+    const uint32_t max_read_len = 1024 / sizeof(int16_t);
+    for (uint32_t offset = 0; offset < outputs_len; offset += max_read_len) {
+        uint32_t cur_len = MIN_VAL(outputs_len - offset, max_read_len);
+        my_memcpy_from_param(get_model(), outputs->data() + offset, output_node, offset, cur_len * sizeof(int16_t));
+    }
+#if STATEFUL
+    my_strip_states_q15(outputs->data(), outputs_len, 0, BATCH_SIZE, false);
+#elif JAPARI
+    for (uint32_t offset = 0; offset < outputs_len; offset++) {
+        if (offset_has_state(offset)) {
+            (*outputs)[offset] = 0;
+        }
+    }
+#endif
+}
+
+static uint64_t get_nvm_bytes_written(void) {
+    uint64_t bytes_read, bytes_written;
+    get_nvm_traffic(&bytes_read, &bytes_written);
+    return bytes_written;
+}
+
+static uint8_t run_reference(std::vector<NvmWrite> *writes, std::vector<int16_t> *outputs) {
+    int fds[2];
+    if (pipe(fds) != 0) {
+        perror("pipe() failed");
+        return 0;
+    }
+    fflush(stdout);
+    pid_t pid = fork();
+    if (!pid) {
+        close(fds[0]);
+        recorded_writes = writes;
+        set_nvm_write_hook(record_nvm_write);
+        TestResults results = {0, 0};
+        run_cnn_test_sample(SWEEP_SAMPLE_IDX, &results);
+        set_nvm_write_hook(nullptr);
+        read_model_outputs(outputs);
+
+        uint32_t n_writes = writes->size(), outputs_len = outputs->size();
+        write_all(fds[1], &n_writes, sizeof(n_writes));
+        write_all(fds[1], writes->data(), n_writes * sizeof(NvmWrite));
+        write_all(fds[1], &outputs_len, sizeof(outputs_len));
+        write_all(fds[1], outputs->data(), outputs_len * sizeof(int16_t));
+        close(fds[1]);
+        fflush(stdout);
+        _exit(0);
+    }
+    close(fds[1]);
+    uint32_t n_writes = 0, outputs_len = 0;
+    uint8_t ret = read_all(fds[0], &n_writes, sizeof(n_writes));
+    if (ret) {
+        writes->resize(n_writes);
+        ret = read_all(fds[0], writes->data(), n_writes * sizeof(NvmWrite)) && read_all(fds[0], &outputs_len, sizeof(outputs_len));
+    }
+    if (ret) {
+        outputs->resize(outputs_len);
+        ret = read_all(fds[0], outputs->data(), outputs_len * sizeof(int16_t));
+    }
+    close(fds[0]);
+    int wait_status;
+    waitpid(pid, &wait_status, 0);
+    if (!ret || !WIFEXITED(wait_status) || WEXITSTATUS(wait_status) != 0) {
+        my_printf("The run without power failures failed" NEWLINE);
+        return 0;
+    }
+    return 1;
+}
+
+static std::vector<uint32_t> select_failure_points(const std::vector<NvmWrite>& writes, const PowerSweepOptions *options) {
+    std::vector<uint32_t> write_indices;
+    uint32_t n_writes = writes.size();
+    if (options->write_step) {
+        for (uint32_t write_idx = 0; write_idx < n_writes; write_idx += options->write_step) {
+            write_indices.push_back(write_idx);
+        }
+    }
+    if (options->points_per_layer) {
+        // Writes of a layer are consecutive, as layers are run in order
+        for (uint32_t layer_start = 0, layer_end; layer_start < n_writes; layer_start = layer_end) {
+            for (layer_end = layer_start; layer_end < n_writes && writes[layer_end].layer_idx == writes[layer_start].layer_idx; layer_end++);
+            uint32_t layer_writes = layer_end - layer_start;
+            // Centers of equally-sized strata
+            for (uint32_t point_idx = 0; point_idx < options->points_per_layer; point_idx++) {
+                write_indices.push_back(layer_start + (2 * point_idx + 1) * layer_writes / (2 * options->points_per_layer));
+            }
+        }
+    }
+    std::sort(write_indices.begin(), write_indices.end());
+    write_indices.erase(std::unique(write_indices.begin(), write_indices.end()), write_indices.end());
+    return write_indices;
+}
+
+static SweepStatus status_from_wait_status(int wait_status) {
+    if (WIFSIGNALED(wait_status) && WTERMSIG(wait_status) == SIGALRM) {
+        return SWEEP_TIMED_OUT;
+    }
+    return SWEEP_CRASHED;
+}
+
+// Run in a process forked from the state after booting
+static void run_failure_point(SweepPoint *point, const std::vector<int16_t>& expected_outputs, uint64_t reference_bytes, unsigned timeout) {
+    // NVM shared with the process before the power failure
+    uint8_t *failure_nvm = reinterpret_cast<uint8_t*>(mmap(NULL, NVM_SIZE, PROT_READ|PROT_WRITE, MAP_SHARED|MAP_ANONYMOUS, -1, 0));
+    if (failure_nvm == MAP_FAILED) {
+        perror("mmap() failed");
+        ERROR_OCCURRED();
+    }
+    // NVM after booting, which is not changed by the parent process during the sweep
+    const uint8_t *nvm_image = replace_nvm(failure_nvm);
+    memcpy(failure_nvm, nvm_image, NVM_SIZE);
+
+    uint64_t boot_bytes = get_nvm_bytes_written();
+    pid_t pid = fork();
+    if (!pid) {
+        alarm(timeout);
+        arm_power_failure(point->failure_bytes);
+        TestResults results = {0, 0};
+        run_cnn_test_sample(SWEEP_SAMPLE_IDX, &results);
+        fflush(stdout);
+        _exit(0);
+    }
+    int wait_status;
+    waitpid(pid, &wait_status, 0);
+    if (!WIFEXITED(wait_status) || WEXITSTATUS(wait_status) != 2) {
+        point->status = (WIFEXITED(wait_status) && !WEXITSTATUS(wait_status)) ? SWEEP_NOT_FAILED : status_from_wait_status(wait_status);
+        point->wait_status = wait_status;
+        return;
+    }
+
+    // Reboot. Volatile states are as right after booting, as this process is not used before the power failure
+    alarm(timeout);
+    load_model_from_nvm();
+    TestResults results = {0, 0};
+    run_cnn_test_sample(SWEEP_SAMPLE_IDX, &results);
+    alarm(0);
+
+    std::vector<int16_t> outputs;
+    read_model_outputs(&outputs);
+    point->extra_bytes = static_cast<int64_t>(point->failure_bytes + get_nvm_bytes_written() - boot_bytes) - static_cast<int64_t>(reference_bytes);
+    point->status = (outputs == expected_outputs) ? SWEEP_PASSED : SWEEP_WRONG_OUTPUTS;
+}
+
+static void print_wait_status(int wait_status) {
+    if (WIFEXITED(wait_status)) {
+        my_printf("exit code %d", WEXITSTATUS(wait_status));
+    } else if (WIFSIGNALED(wait_status)) {
+        my_printf("signal %s", strsignal(WTERMSIG(wait_status)));
+    }
+}
+
+static uint8_t report_sweep(const SweepPoint *points, uint32_t n_points, uint64_t boot_bytes) {
+    uint32_t status_counts[sizeof(sweep_status_names) / sizeof(sweep_status_names[0])] = {0};
+    for (uint32_t point_idx = 0; point_idx < n_points; point_idx++) {
+        status_counts[points[point_idx].status]++;
+    }
+    for (uint8_t status = SWEEP_PASSED; status < sizeof(status_counts) / sizeof(status_counts[0]); status++) {
+        my_printf("%s%s=%" PRIu32, (status == SWEEP_PASSED) ? "" : " ", sweep_status_names[status], status_counts[status]);
+    }
+    my_printf(NEWLINE);
+
+    // Writes after all layers are done are counted as layer MODEL_NODES_LEN
+    my_printf("%5s %-30s %-18s %8s %8s %16s %16s" NEWLINE, "layer", "name", "op", "points", "failed", "avg_extra_bytes", "max_extra_bytes");
+    for (uint16_t layer_idx = 0; layer_idx <= MODEL_NODES_LEN; layer_idx++) {
+        uint32_t layer_points = 0, layer_failed = 0, layer_passed = 0;
+        int64_t total_extra_bytes = 0, max_extra_bytes = 0;
+        for (uint32_t point_idx = 0; point_idx < n_points; point_idx++) {
+            const SweepPoint *point = points + point_idx;
+            if (point->layer_idx != layer_idx) {
+                continue;
+            }
+            layer_points++;
+            if (point->status != SWEEP_PASSED) {
+                layer_failed++;
+                continue;
+            }
+            layer_passed++;
+            total_extra_bytes += point->extra_bytes;
+            max_extra_bytes = MAX_VAL(max_extra_bytes, point->extra_bytes);
+        }
+        if (!layer_points) {
+            continue;
+        }
+        const Node *node = (layer_idx < MODEL_NODES_LEN) ? get_node(layer_idx) : nullptr;
+        my_printf("%5d %-30.*s %-18s %8" PRIu32 " %8" PRIu32 " %16.1f %16" PRId64 NEWLINE, layer_idx,
+                  NODE_NAME_LEN, node ? node->name : "(finished)", node ? op_names[node->op_type] : "",
+                  layer_points, layer_failed, layer_passed ? static_cast<double>(total_extra_bytes) / layer_passed : 0.0, max_extra_bytes);
+    }
+
+    uint32_t n_failed = n_points - status_counts[SWEEP_PASSED], shown = 0;
+    for (uint32_t point_idx = 0; point_idx < n_points && shown < SWEEP_FAILED_POINTS_TO_SHOW; point_idx++) {
+        const SweepPoint *point = points + point_idx;
+        if (point->status == SWEEP_PASSED) {
+            continue;
+        }
+        my_printf("Write %" PRIu32 " in layer %d: %s", point->write_idx, point->layer_idx, sweep_status_names[point->status]);
+        if (point->status == SWEEP_CRASHED || point->status == SWEEP_TIMED_OUT) {
+            my_printf(" (");
+            print_wait_status(point->wait_status);
+            my_printf(")");
+        }
+        // -c counts writes since first_run(), which is done with -b
+        my_printf(", reproduce with -b -c %" PRIu64 " 1" NEWLINE, boot_bytes + point->failure_bytes);
+        shown++;
+    }
+    if (n_failed > shown) {
+        my_printf("... and %" PRIu32 " more failed points" NEWLINE, n_failed - shown);
+    }
+    return n_failed ? 1 : 0;
+}
+
+uint8_t run_power_failure_sweep(const PowerSweepOptions *options) {
+    // Bytes written by first_run()
+    uint64_t boot_bytes = get_nvm_bytes_written();
+
+    std::vector<NvmWrite> writes;
+    std::vector<int16_t> expected_outputs;
+    auto reference_start = std::chrono::steady_clock::now();
+    if (!run_reference(&writes, &expected_outputs)) {
+        return 1;
+    }
+    double reference_seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - reference_start).count();
+    unsigned timeout = MAX_VAL(static_cast<unsigned>(reference_seconds * SWEEP_TIMEOUT_FACTOR), SWEEP_MIN_TIMEOUT_SECONDS);
+
+    uint64_t reference_bytes = 0;
+    std::vector<uint64_t> write_starts(writes.size());
+    for (uint32_t write_idx = 0; write_idx < writes.size(); write_idx++) {
+        write_starts[write_idx] = reference_bytes;
+        reference_bytes += writes[write_idx].n;
+    }
+    MY_ASSERT(reference_bytes < UINT32_MAX);
+
+    std::vector<uint32_t> write_indices = select_failure_points(writes, options);
+    uint32_t n_points = write_indices.size();
+    if (!n_points) {
+        my_printf("No NVM writes to interrupt" NEWLINE);
+        return 1;
+    }
+    SweepPoint *points = reinterpret_cast<SweepPoint*>(mmap(NULL, n_points * sizeof(SweepPoint), PROT_READ|PROT_WRITE, MAP_SHARED|MAP_ANONYMOUS, -1, 0));
+    if (points == MAP_FAILED) {
+        perror("mmap() failed");
+        return 1;
+    }
+    for (uint32_t point_idx = 0; point_idx < n_points; point_idx++) {
+        uint32_t write_idx = write_indices[point_idx];
+        const NvmWrite& write = writes[write_idx];
+        // Power fails in the middle of the write, with at least one byte written
+        points[point_idx] = SweepPoint{write_idx, static_cast<uint32_t>(write_starts[write_idx] + (write.n + 1) / 2), write.layer_idx, SWEEP_PENDING, 0, 0};
+    }
+
+    uint16_t n_workers = options->n_workers;
+    if (!n_workers) {
+        n_workers = MAX_VAL(std::thread::hardware_concurrency(), 1u);
+    }
+    my_printf("Sweeping %" PRIu32 " power failure points over %zu NVM writes (%" PRIu64 " bytes) with %d workers" NEWLINE,
+              n_points, writes.size(), reference_bytes, n_workers);
+
+    std::map<pid_t, uint32_t> running_points;
+    uint32_t next_point_idx = 0, finished = 0;
+    while (finished < n_points) {
+        if (next_point_idx < n_points && running_points.size() < n_workers) {
+            fflush(stdout);
+            pid_t pid = fork();
+            if (pid < 0) {
+                perror("fork() failed");
+                return 1;
+            }
+            if (!pid) {
+                run_failure_point(points + next_point_idx, expected_outputs, reference_bytes, timeout);
+                fflush(stdout);
+                _exit(0);
+            }
+            running_points[pid] = next_point_idx;
+            next_point_idx++;
+            continue;
+        }
+        int wait_status;
+        pid_t pid = waitpid(-1, &wait_status, 0);
+        auto it = running_points.find(pid);
+        if (it == running_points.end()) {
+            continue;
+        }
+        SweepPoint *point = points + it->second;
+        if (point->status == SWEEP_PENDING) {
+            // Crashed after rebooting
+            point->status = status_from_wait_status(wait_status);
+            point->wait_status = wait_status;
+        }
+        running_points.erase(it);
+        finished++;
+        if (finished % 100 == 0) {
+            my_printf("%" PRIu32 "/%" PRIu32 " failure points finished" NEWLINE, finished, n_points);
+            my_flush();
+        }
+    }
+
+    uint8_t ret = report_sweep(points, n_points, boot_bytes);
+    munmap(points, n_points * sizeof(SweepPoint));
+    return ret;
+}
+
+#endif
@@ -0,0 +1,28 @@
+#pragma once
+
+#include <cstdint>
+
+/**
+ * A deterministic power failure sweep on PC (-S and -L of intermittent-cnn).
+ *
+ * The first sample is run once from a fresh NVM to record all NVM writes. After that,
+ * for each chosen write, a forked process runs the sample with a power failure in the
+ * middle of that write, reboots and resumes the inference to completion, and compares
+ * outputs with the run without power failures. Processes are forked from the state
+ * right after booting, so that each failure point starts from the same NVM and
+ * volatile states, and up to n_workers of them are run in parallel.
+ *
+ * Failure points are every write_step-th NVM write, and/or points_per_layer points
+ * evenly spread over NVM writes of each layer. A summary with re-execution costs
+ * (NVM bytes written in addition to the run without power failures) is printed.
+ */
+
+struct PowerSweepOptions {
+    uint32_t write_step;
+    uint16_t points_per_layer;
+    // 0 for all cores
+    uint16_t n_workers;
+};
+
+// Returns 1 if outputs are wrong or the inference crashes for any failure point
+uint8_t run_power_failure_sweep(const PowerSweepOptions *options);
@@ -0,0 +1,300 @@
+#include "platform.h"
+
+#if PLAT_RUNTIME_COUNTERS
+
+#include <chrono>
+#include <cinttypes>
+#include <cstdio>
+#include <cstring>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+#include "cnn_common.h"
+#include "counters.h"
+#include "data.h"
+#include "my_debug.h"
+#include "profiler.h"
+
+enum TraceEventType : uint8_t {
+    TRACE_NODE,
+    TRACE_COUNTER,
+};
+
+struct TraceEvent {
+    uint64_t start_ns;
+    uint64_t duration_ns;
+    uint16_t id;        // node index or counter pointer
+    uint8_t type;
+    uint16_t layer_idx;
+};
+
+// Events are dropped after this limit, so that long runs do not exhaust memory
+#define MAX_TRACE_EVENTS_PER_THREAD (1 << 22)
+// Nodes and at most two nested counters
+#define MAX_SPAN_DEPTH 4
+
+struct TraceThread {
+    uint32_t tid;
+    std::vector<TraceEvent> events;
+    uint64_t dropped;
+    uint64_t span_starts[MAX_SPAN_DEPTH];
+    uint8_t depth;
+};
+
+uint8_t profiler_tracing_enabled = 0;
+static std::string output_prefix;
+static std::chrono::steady_clock::time_point profiler_start_time;
+
+// Threads are registered on their first span, and buffers are kept after threads exit
+static std::mutex trace_threads_mutex;
+static std::vector<std::unique_ptr<TraceThread>> trace_threads;
+static PLAT_THREAD_LOCAL TraceThread *cur_trace_thread = nullptr;
+static PLAT_THREAD_LOCAL uint64_t node_start_ns;
+
+static const struct {
+    const char *name;
+    uint8_t counter;
+} counter_fields[] = {
+#define COUNTER_FIELD(field) { #field, offsetof(Counters, field) }
+    COUNTER_FIELD(power_counters),
+    COUNTER_FIELD(dma_invocations),
+    COUNTER_FIELD(dma_bytes),
+    COUNTER_FIELD(macs),
+    COUNTER_FIELD(embedding),
+    COUNTER_FIELD(stripping),
+    COUNTER_FIELD(overflow_handling),
+    COUNTER_FIELD(state_query),
+    COUNTER_FIELD(table_updates),
+    COUNTER_FIELD(table_preservation),
+    COUNTER_FIELD(table_loading),
+    COUNTER_FIELD(progress_seeking),
+    COUNTER_FIELD(memory_layout),
+    COUNTER_FIELD(data_loading),
+    COUNTER_FIELD(job_preservation),
+    COUNTER_FIELD(footprint_preservation),
+    COUNTER_FIELD(progress_hint_preservation),
+    COUNTER_FIELD(recovery_reads),
+    COUNTER_FIELD(recovery_bytes),
+    COUNTER_FIELD(parallel_task_time),
+    COUNTER_FIELD(parallel_wall_time),
+    COUNTER_FIELD(node_time),
+    COUNTER_FIELD(cpu_instructions),
+    COUNTER_FIELD(cache_misses),
+#undef COUNTER_FIELD
+};
+
+static_assert(sizeof(counter_fields) / sizeof(counter_fields[0]) == sizeof(Counters) / sizeof(counter_t), "Missing fields in counter_fields");
+
+static uint64_t now_ns(void) {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - profiler_start_time).count();
+}
+
+static TraceThread *get_trace_thread(void) {
+    if (!cur_trace_thread) {
+        std::lock_guard<std::mutex> lock(trace_threads_mutex);
+        TraceThread *trace_thread = new TraceThread();
+        trace_thread->tid = trace_threads.size();
+        trace_threads.emplace_back(trace_thread);
+        cur_trace_thread = trace_thread;
+    }
+    return cur_trace_thread;
+}
+
+void enable_profiler(const char *prefix) {
+    profiler_start_time = std::chrono::steady_clock::now();
+    runtime_counters_enabled = 1;
+    if (prefix) {
+        output_prefix = prefix;
+        profiler_tracing_enabled = 1;
+    }
+}
+
+void profiler_push_span(void) {
+    TraceThread *trace_thread = get_trace_thread();
+    MY_ASSERT(trace_thread->depth < MAX_SPAN_DEPTH);
+    trace_thread->span_starts[trace_thread->depth] = now_ns();
+    trace_thread->depth++;
+}
+
+static uint64_t pop_span(uint8_t type, uint16_t id) {
+    uint64_t end_ns = now_ns();
+    TraceThread *trace_thread = get_trace_thread();
+    MY_ASSERT(trace_thread->depth > 0);
+    trace_thread->depth--;
+    uint64_t start_ns = trace_thread->span_starts[trace_thread->depth];
+    if (trace_thread->events.size() < MAX_TRACE_EVENTS_PER_THREAD) {
+        trace_thread->events.push_back(TraceEvent{start_ns, end_ns - start_ns, id, type, model_vm.layer_idx});
+    } else {
+        trace_thread->dropped++;
+    }
+    return end_ns - start_ns;
+}
+
+void profiler_pop_counter_span(uint8_t counter) {
+    pop_span(TRACE_COUNTER, counter);
+}
+
+void profiler_reset_spans(void) {
+    if (cur_trace_thread) {
+        cur_trace_thread->depth = 0;
+    }
+}
+
+void profiler_node_begin(uint16_t) {
+    if (!runtime_counters_enabled) {
+        return;
+    }
+    if (profiler_tracing_enabled) {
+        profiler_push_span();
+    } else {
+        node_start_ns = now_ns();
+    }
+}
+
+void profiler_node_end(uint16_t node_idx) {
+    if (!runtime_counters_enabled) {
+        return;
+    }
+    uint64_t duration_ns;
+    if (profiler_tracing_enabled) {
+        duration_ns = pop_span(TRACE_NODE, node_idx);
+    } else {
+        duration_ns = now_ns() - node_start_ns;
+    }
+    add_counter(offsetof(Counters, node_time), duration_ns / 1000);
+}
+
+static const char *counter_name(uint8_t counter) {
+    for (const auto& field : counter_fields) {
+        if (field.counter == counter) {
+            return field.name;
+        }
+    }
+    return "unknown";
+}
+
+// Node names come from ONNX models and may contain any characters
+static void write_json_string(FILE *f, const char *str, size_t max_len) {
+    fputc('"', f);
+    for (size_t idx = 0; idx < max_len && str[idx]; idx++) {
+        unsigned char c = str[idx];
+        if (c == '"' || c == '\\') {
+            fprintf(f, "\\%c", c);
+        } else if (c < 0x20) {
+            fprintf(f, "\\u%04x", c);
+        } else {
+            fputc(c, f);
+        }
+    }
+    fputc('"', f);
+}
+
+static void write_trace(FILE *f) {
+    fprintf(f, "{\"traceEvents\":[\n");
+    bool first = true;
+    std::lock_guard<std::mutex> lock(trace_threads_mutex);
+    for (const auto& trace_thread : trace_threads) {
+        fprintf(f, "%s{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":0,\"tid\":%" PRIu32 ",\"args\":{\"name\":\"thread %" PRIu32 "\"}}",
+                first ? "" : ",\n", trace_thread->tid, trace_thread->tid);
+        first = false;
+        for (const TraceEvent& event : trace_thread->events) {
+            fprintf(f, ",\n{\"name\":");
+            if (event.type == TRACE_NODE) {
+                write_json_string(f, get_node(event.id)->name, NODE_NAME_LEN);
+            } else {
+                write_json_string(f, counter_name(event.id), SIZE_MAX);
+            }
+            fprintf(f, ",\"cat\":\"%s\",\"ph\":\"X\",\"ts\":%.3f,\"dur\":%.3f,\"pid\":0,\"tid\":%" PRIu32 ",\"args\":{\"layer\":%d",
+                    event.type == TRACE_NODE ? "node" : "counter", event.start_ns / 1000.0, event.duration_ns / 1000.0,
+                    trace_thread->tid, event.layer_idx);
+            if (event.layer_idx < MODEL_NODES_LEN) {
+                fprintf(f, ",\"op\":\"%s\"", op_names[get_node(event.layer_idx)->op_type]);
+            }
+            fprintf(f, "}}");
+        }
+        if (trace_thread->dropped) {
+            my_printf("Dropped %" PRIu64 " trace events for thread %" PRIu32 NEWLINE, trace_thread->dropped, trace_thread->tid);
+        }
+    }
+    fprintf(f, "\n]}\n");
+}
+
+// add_counters() is for all layers
+static void add_layer_counters(Counters *dest, const Counters *src) {
+    for (const auto& field : counter_fields) {
+        *reinterpret_cast<counter_t*>(reinterpret_cast<uint8_t*>(dest) + field.counter) +=
+            *reinterpret_cast<const counter_t*>(reinterpret_cast<const uint8_t*>(src) + field.counter);
+    }
+}
+
+static void write_counters_row(FILE *f, const char *scope, int32_t layer_idx, const char *name, size_t name_len, const char *op_name, const Counters *row) {
+    fprintf(f, "%s,%" PRId32 ",%.*s,%s", scope, layer_idx, static_cast<int>(strnlen(name, name_len)), name, op_name);
+    for (const auto& field : counter_fields) {
+        fprintf(f, ",%" PRIcounter, *reinterpret_cast<const counter_t*>(reinterpret_cast<const uint8_t*>(row) + field.counter));
+    }
+    fprintf(f, ",%.4f\n", row->dma_bytes ? static_cast<double>(row->macs) / row->dma_bytes : 0.0);
+}
+
+static void write_counters_csv(FILE *f) {
+    const Counters *layer_counters = counters_data[counters_cur_copy_id];
+
+    fprintf(f, "scope,layer,name,op");
+    for (const auto& field : counter_fields) {
+        fprintf(f, ",%s", field.name);
+    }
+    fprintf(f, ",arithmetic_intensity\n");
+
+    // Names may contain commas, which are rare in ONNX models and not escaped
+    for (uint16_t layer_idx = 0; layer_idx < MODEL_NODES_LEN; layer_idx++) {
+        const Node *node = get_node(layer_idx);
+        write_counters_row(f, "layer", layer_idx, node->name, NODE_NAME_LEN, op_names[node->op_type], layer_counters + layer_idx);
+    }
+
+    uint16_t n_ops = 0;
+    for (uint16_t layer_idx = 0; layer_idx < MODEL_NODES_LEN; layer_idx++) {
+        n_ops = MAX_VAL(n_ops, get_node(layer_idx)->op_type + 1);
+    }
+    for (uint16_t op_type = 0; op_type < n_ops; op_type++) {
+        Counters op_counters = {};
+        bool used = false;
+        for (uint16_t layer_idx = 0; layer_idx < MODEL_NODES_LEN; layer_idx++) {
+            if (get_node(layer_idx)->op_type == op_type) {
+                add_layer_counters(&op_counters, layer_counters + layer_idx);
+                used = true;
+            }
+        }
+        if (used) {
+            write_counters_row(f, "op", -1, op_names[op_type], SIZE_MAX, op_names[op_type], &op_counters);
+        }
+    }
+
+    // Including counters after all layers are finished (layer_idx == MODEL_NODES_LEN)
+    Counters total_counters = {};
+    for (uint16_t idx = 0; idx < COUNTERS_LEN; idx++) {
+        add_layer_counters(&total_counters, layer_counters + idx);
+    }
+    write_counters_row(f, "total", -1, "total", SIZE_MAX, "", &total_counters);
+}
+
+static void write_output(const char *suffix, void (*writer)(FILE*)) {
+    std::string path = output_prefix + suffix;
+    FILE *f = fopen(path.c_str(), "w");
+    if (!f) {
+        perror(("Opening " + path + " failed").c_str());
+        return;
+    }
+    writer(f);
+    fclose(f);
+    my_printf("Profiler outputs written to %s" NEWLINE, path.c_str());
+}
+
+void write_profiler_outputs(void) {
+    if (!profiler_tracing_enabled) {
+        return;
+    }
+    write_output(".json", write_trace);
+    write_output(".csv", write_counters_csv);
+}
+
+#endif
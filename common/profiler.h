@@ -0,0 +1,41 @@
+#pragma once
+
+#include <cstdint>
+
+/**
+ * A profiler for PC builds, which have counters compiled in (PLAT_RUNTIME_COUNTERS)
+ * but disabled until enable_profiler() is called. Counters are collected per layer,
+ * and with an output prefix, the following files are also written:
+ *
+ * <prefix>.json: Chrome trace events (chrome://tracing or https://ui.perfetto.dev),
+ *                with a span for each handle_node() call and each start_cpu_counter() region
+ * <prefix>.csv:  counters per layer, per operator type and in total, with arithmetic
+ *                intensity (MACs per DMA byte)
+ */
+
+extern uint8_t profiler_tracing_enabled;
+
+// output_prefix = nullptr for counters only
+void enable_profiler(const char *output_prefix);
+void write_profiler_outputs(void);
+
+void profiler_node_begin(uint16_t node_idx);
+void profiler_node_end(uint16_t node_idx);
+
+// For start_cpu_counter() and stop_cpu_counter(). Regions may be nested like counters
+void profiler_push_span(void);
+void profiler_pop_counter_span(uint8_t counter);
+// Drop unfinished spans of the current thread, which are interrupted by simulated power failures
+void profiler_reset_spans(void);
+
+static inline void profiler_region_begin(void) {
+    if (profiler_tracing_enabled) {
+        profiler_push_span();
+    }
+}
+
+static inline void profiler_region_end(uint8_t counter) {
+    if (profiler_tracing_enabled) {
+        profiler_pop_counter_span(counter);
+    }
+}
@@ -4,7 +4,8 @@ from utils import (
     load_har,
 )
 
-# intermediate_values_size should < 65536, or TI's compiler gets confused
+# intermediate_values_size limits the output size of a layer, and should < 65536, or TI's compiler gets confused.
+# num_slots limits the number of regions of intermediate values planned by transform.py
 configs = {
     'cifar10': {
         'onnx_model': 'dnn-models/squeezenet_cifar10.onnx',
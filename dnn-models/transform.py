@@ -3,6 +3,7 @@ import ctypes
 import dataclasses
 import io
 import itertools
+import json
 import logging
 import math
 import os.path
@@ -53,6 +54,10 @@ class Constants:
 
     DEFAULT_TILE_H = 8
     BATCH_SIZE = 1
+    # Jobs between writes of progress hints for indirect recovery. 0 to disable progress hints
+    PROGRESS_HINT_INTERVAL = 0
+    # Values read at once in progress seeking of indirect recovery. 0 for binary search with a read per step
+    RECOVERY_BLOCK_LEN = 0
     STATEFUL = 0
     HAWAII = 0
     JAPARI = 0
@@ -61,6 +66,30 @@ class Constants:
     METHOD = "Baseline"
     FIRST_SAMPLE_OUTPUTS = []
 
+    # Sizes of static arrays, which are larger than needed for model bundles
+    MAX_MODEL_NODES_LEN = 0
+    MAX_NUM_SLOTS = 0
+    MODEL_BUNDLE = 0
+
+# Values from the header of a model bundle (see common/model_bundle.h), which are not in data.h
+bundle_runtime_constants = [
+    'CONFIG', 'FIRST_SAMPLE_OUTPUTS', 'INPUTS_DATA_LEN', 'MODEL_NODES_LEN', 'N_INPUT', 'NVM_SIZE', 'N_SAMPLES',
+]
+# Model configs still in data.h with model bundles, as they are used as template arguments
+bundle_compile_time_configs = ['op_filters']
+# Limits for model bundles, so that the simulator can run any model within them
+BUNDLE_MAX_MODEL_NODES_LEN = 256
+BUNDLE_MAX_NUM_SLOTS = 3
+BUNDLE_NUM_INPUTS = 3
+MODEL_BUNDLE_VERSION = 9
+
+# Operators implemented in common/. With model bundles, all of them are compiled
+# so that op_type in nodes is the same for any model.
+all_ops = [
+    'Add', 'Concat', 'Conv', 'ConvMerge', 'Gemm', 'GemmMerge', 'GlobalAveragePool', 'MaxPool',
+    'Relu', 'Reshape', 'Softmax', 'Squeeze', 'Transpose', 'Unsqueeze',
+]
+
 # XXX: Transpose does nothing as we happens to need NHWC
 inplace_update_ops = ['Reshape', 'Softmax', 'Squeeze', 'Transpose', 'Unsqueeze']
 
@@ -68,10 +97,14 @@ other_flags = [
     # node flags
     'NHWC2NCHW',
     'MAXPOOL_CEIL',
+    'FUSED_RELU',  # ReLU is applied on outputs of ConvMerge, GemmMerge or MaxPool
+    'FUSED_MAXPOOL',  # ConvMerge outputs are max-pooled with MaxPool flags in extra
+    'NHWC_OUTPUTS',  # Conv writes final outputs in NHWC instead of NWHC, as ConvMerge is removed
 
     # parameter flags
     'CHANNEL_FIRST',
     'SEPARATE_TILING',  # Tiles in different channels are actually in different slots
+    'SPARSE',  # Non-zero blocks of values followed by block-CSR indices
 ]
 
 def op_flag(flag):
@@ -96,12 +129,66 @@ def _Q15(arr, name):
 
     return (arr * 2 ** 15).astype(int)
 
+# Weights are 8-bit in --weight-precision mixed if the quantization noise is at least this many dB below the weights
+MIN_Q7_SQNR = 30
+
+def _Q7_with_shifts(q15_arr, n_slices):
+    """Transform _q15 values to q7 values with a left shift for each slice, so that
+    a slice with small values keeps more precision. Each q7 value shifted left is
+    an approximation of the _q15 value (see read_q7_parameters() in common/cnn_common.cpp).
+    Returns q7 values, shifts and the SQNR in dB"""
+
+    slices = np.reshape(q15_arr, (n_slices, -1))
+    shifts = np.zeros(n_slices, dtype=int)
+    q7_slices = np.zeros_like(slices)
+    for idx, cur_slice in enumerate(slices):
+        shift = 0
+        # Find the smallest shift that q7 values of the slice do not overflow
+        while shift < 8 and np.any(np.abs(np.round(cur_slice / 2 ** shift)) > 127):
+            shift += 1
+        shifts[idx] = shift
+        q7_slices[idx] = np.clip(np.round(cur_slice / 2 ** shift), -128, 127).astype(int)
+    noise = slices - q7_slices * 2 ** shifts[:, np.newaxis]
+    noise_power = np.sum(noise.astype(float) ** 2)
+    sqnr = np.inf if noise_power == 0 else 10 * np.log10(np.sum(slices.astype(float) ** 2) / noise_power)
+    return q7_slices.flatten(), shifts, sqnr
+
+# With --sparse-weights, buffers for sparse kernels are reserved for weights with at least this ratio of zeros,
+# and weights are stored in block-CSR if at least SPARSE_MIN_ZERO_BLOCK_RATIO of blocks are zeros
+SPARSE_MIN_ZERO_RATIO = 0.5
+SPARSE_MIN_ZERO_BLOCK_RATIO = 0.25
+# CONV_MAX_SPARSE_BLOCKS in common/conv.cpp
+CONV_MAX_SPARSE_BLOCKS = 32
+# CONV_MAX_RESIDENT_FILTER_TILES in common/conv.cpp
+CONV_MAX_RESIDENT_FILTER_TILES = 8
+
+def to_block_csr(rows):
+    """Keep non-zero blocks and build block-CSR indices (see load_sparse_row() in common/cnn_common.cpp).
+    Each row is a list of (column index, block values). Returns values, indices and the ratio of zero blocks"""
+
+    values = []
+    row_ptrs = [0]
+    col_indices = []
+    n_blocks = 0
+    for row in rows:
+        for col, block in row:
+            n_blocks += 1
+            if np.any(block):
+                values.extend(block.flatten())
+                col_indices.append(col)
+        row_ptrs.append(len(col_indices))
+    zero_block_ratio = 1 - len(col_indices) / n_blocks if n_blocks else 0
+    return np.array(values, dtype=int), row_ptrs + col_indices, zero_block_ratio
+
 # https://stackoverflow.com/a/11481471/3786245
 class ConvNodeFlags(ctypes.Structure):
     _fields_ = [
         ("input_tile_c", ctypes.c_uint16),
         ("output_tile_c", ctypes.c_uint16),
         ("pads", ctypes.c_uint8 * 4),
+        ("dataflow", ctypes.c_uint8),
+        ("tile_h", ctypes.c_uint8),
+        ("group", ctypes.c_uint16),
     ]
 
 class MaxPoolFlags(ctypes.Structure):
@@ -113,6 +200,7 @@ class MaxPoolFlags(ctypes.Structure):
 class GemmNodeFlags(ctypes.Structure):
     _fields_ = [
         ("tile_channel", ctypes.c_uint16, 16),
+        ("op_filters", ctypes.c_uint16, 16),
     ]
 
 class GemmMergeNodeFlags(ctypes.Structure):
@@ -145,7 +233,7 @@ class NodeFlags_bits(ctypes.LittleEndianStructure):
 class NodeFlags(ctypes.Union):
     _fields_ = [
         ("b", NodeFlags_bits),
-        ("as_bytes", ctypes.c_uint8 * 10),
+        ("as_bytes", ctypes.c_uint8 * 14),
     ]
 
     def __repr__(self):
@@ -175,14 +263,41 @@ lea_buffer_size = {
     'msp432': 18000,
 }
 
+# Values read at once in progress seeking (see run_recovery() in common/intermittent-cnn.cpp).
+# Reading more values costs less than another SPI transaction for external FRAM.
+recovery_block_len = {
+    'msp430': 32,
+    'msp432': 64,
+}
+
 parser = argparse.ArgumentParser()
 parser.add_argument('config', choices=configs.keys())
 parser.add_argument('--all-samples', action='store_true')
 parser.add_argument('--write-images', action='store_true')
 parser.add_argument('--batch-size', type=int, default=1)
+parser.add_argument('--progress-hint-interval', type=int, default=0, metavar='K',
+                    help='With --stateful or --japari, persist a progress hint every K jobs to narrow down progress seeking after power failures')
+parser.add_argument('--autotune-tiles', action='store_true',
+                    help='Choose tile sizes of Conv and Gemm with the least cost estimated from NVM traffic, instead of the largest tiles that fit')
+parser.add_argument('--tile-overrides', metavar='FILE',
+                    help='Tile sizes for some Conv and Gemm nodes in a JSON file, in the format of DIR/tiles.json')
+parser.add_argument('--no-fuse-operators', dest='fuse_operators', action='store_false',
+                    help='Keep ReLU and MaxPool after Conv and Gemm as separate layers')
+parser.add_argument('--keep-merge-nodes', action='store_true',
+                    help='Keep ConvMerge and GemmMerge after Conv and Gemm layers that already write final outputs')
+parser.add_argument('--weight-precision', choices=('16', '8', 'mixed'), default='16',
+                    help='Store filters of Conv and weights of Gemm as _q15 (16), q7 with per-channel shifts (8), '
+                         'or q7 only for layers with small quantization noise (mixed)')
+parser.add_argument('--activation-precision', choices=('16', '8'), default='16',
+                    help='Store intermediate values as q15 (16) or the upper 8 bits of q15 values (8). Partial sums '
+                         'merged by ConvMerge and GemmMerge and model outputs are always q15')
+parser.add_argument('--sparse-weights', action='store_true',
+                    help='Store filters of Conv and weights of Gemm with many zeros as non-zero blocks, which are skipped by kernels')
 parser.add_argument('--target', choices=('msp430', 'msp432'), required=True)
 parser.add_argument('--debug', action='store_true')
 parser.add_argument('--data-output-dir', metavar='DIR', default='build')
+parser.add_argument('--bundle', action='store_true',
+                    help='Write the model to DIR/model.bundle for the simulator on PC, and data.h/data.cpp not depending on the model')
 intermittent_methodology = parser.add_mutually_exclusive_group(required=True)
 intermittent_methodology.add_argument('--ideal', action='store_true')
 intermittent_methodology.add_argument('--hawaii', action='store_true')
@@ -217,9 +332,19 @@ if args.japari:
     config['intermediate_values_size'] *= 2
 Constants.INTERMITTENT = Constants.STATEFUL | Constants.HAWAII | Constants.JAPARI
 Constants.INDIRECT_RECOVERY = Constants.STATEFUL | Constants.JAPARI
+if Constants.INDIRECT_RECOVERY:
+    Constants.PROGRESS_HINT_INTERVAL = args.progress_hint_interval
 if args.target == 'msp432':
     Constants.USE_ARM_CMSIS = 1
 Constants.LEA_BUFFER_SIZE = lea_buffer_size[args.target]
+Constants.RECOVERY_BLOCK_LEN = recovery_block_len[args.target]
+if args.bundle:
+    Constants.MODEL_BUNDLE = 1
+    Constants.MAX_NUM_SLOTS = BUNDLE_MAX_NUM_SLOTS
+    Constants.NUM_INPUTS = BUNDLE_NUM_INPUTS
+else:
+    Constants.MAX_NUM_SLOTS = config['num_slots']
+assert config['num_slots'] <= Constants.MAX_NUM_SLOTS
 
 onnx_model = load_model(config, for_deployment=True)
 
@@ -296,6 +421,8 @@ for n in new_nodes:
 nodes = [ONNXNodeWrapper(n) for n in new_nodes]
 
 conv_param_names = set()
+# Parameters that may be stored as q7 values with --weight-precision
+weight_param_names = set()
 
 for idx, inp in enumerate(onnx_model.graph.input):
     names[inp.name] = idx
@@ -326,14 +453,12 @@ def infer_auto_pad(node):
         if conv_flags.pads[0]*2+1 != kernel_shape[0] or conv_flags.pads[1]*2+1 != kernel_shape[1]:
             raise NotImplementedError
 
-for idx, n in enumerate(nodes):
-    if n.op_type == 'Dropout':
-        output = n.output[:1]  # we don't care the second output `mask`
-    else:
-        output = n.output
+for n in nodes:
     if n.op_type == 'Conv':
         conv_param_names.add(n.input[1])
+        weight_param_names.add(n.input[1])
         infer_auto_pad(n)
+        n.flags.b.extra.conv.group = get_attr(n, 'group') or 1
     if n.op_type == 'MaxPool':
         kernel_shape = get_attr(n, 'kernel_shape')  # this field is required
         assert len(kernel_shape) == 2
@@ -364,12 +489,25 @@ for idx, n in enumerate(nodes):
         node_flags.axes = 0
         for axis in axes:
             node_flags.axes |= (1 << axis)
+    if n.op_type == 'Gemm':
+        weight_param_names.add(n.input[1])
     if n.op_type == 'GemmMerge':
         n.flags.b.extra.gemmmerge.tile_length = config['gemm_tile_length']
-    for output_ in output:
-        names[output_] = idx + Constants.N_INPUT
 
-pprint.pprint(names)
+# Weights that may be stored in block-CSR with --sparse-weights. Whether they are stored so is
+# decided after tile sizes are known, as blocks follow tiles
+sparse_weight_nodes = {}
+if args.sparse_weights:
+    for n in nodes:
+        if n.op_type not in ('Conv', 'Gemm'):
+            continue
+        weights = find_initializer(onnx_model, n.input[1])
+        if n.op_type == 'Conv' and (n.flags.b.extra.conv.group > 1 or weights.dims[2] * weights.dims[3] > CONV_MAX_SPARSE_BLOCKS):
+            continue
+        zero_ratio = np.mean(extract_data(weights) == 0)
+        logger.info('Ratio of zeros in weights of %s node %s: %.2f', n.op_type, n.name, zero_ratio)
+        if zero_ratio >= SPARSE_MIN_ZERO_RATIO:
+            sparse_weight_nodes[n.input[1]] = n
 
 @dataclasses.dataclass
 class Node:
@@ -378,17 +516,33 @@ class Node:
     inputs: List[int]
     op_type: str
     flags: NodeFlags
-    max_output_id: int
 
 def extend_for_footprints(n):
     return n + n // Constants.BATCH_SIZE
 
-def determine_conv_tile_c(n):
-    logger.debug('Determine tile size for Conv node %s', n.name)
-
+@dataclasses.dataclass
+class ConvGeometry:
+    OUTPUT_CHANNEL: int
+    OUTPUT_H: int
+    OUTPUT_W: int
+    N_FILTERS: int
+    # Input channels in a group, which are all input channels if group == 1
+    CHANNEL: int
+    kH: int
+    kW: int
+    stride: int
+    pads: List[int]
+    H: int
+    W: int
+    # Input channels in a slot, which are half of CHANNEL with separate tiling
+    max_continuous_channels: int
+    group: int
+    # Filters may be sparse, and inputs are gathered for non-zero blocks
+    sparse: bool
+
+def get_conv_geometry(n):
     output_value_info = find_tensor_value_info(onnx_model, n.output[0])
     filter_info = find_initializer(onnx_model, n.input[1])
-    node_flags = n.flags.b.extra.conv
 
     is_separate_tiling = False
     if not find_initializer(onnx_model, n.input[0]):
@@ -397,36 +551,58 @@ def determine_conv_tile_c(n):
             is_separate_tiling = True
 
     shape = output_value_info.type.tensor_type.shape
-    OUTPUT_CHANNEL = shape.dim[1].dim_value
     OUTPUT_H = shape.dim[2].dim_value
     OUTPUT_W = shape.dim[3].dim_value
-    CHANNEL = filter_info.dims[1]
-    kH = filter_info.dims[2]
-    kW = filter_info.dims[3]
+    N_FILTERS, CHANNEL, kH, kW = filter_info.dims
+    stride = n.flags.b.stride
+    pads = list(n.flags.b.extra.conv.pads)
+    group = n.flags.b.extra.conv.group
+    if group > 1 and is_separate_tiling:
+        raise NotImplementedError(f'Grouped Conv node {n.name} after Concat')
+    return ConvGeometry(OUTPUT_CHANNEL=shape.dim[1].dim_value, OUTPUT_H=OUTPUT_H, OUTPUT_W=OUTPUT_W,
+                        N_FILTERS=N_FILTERS, CHANNEL=CHANNEL, kH=kH, kW=kW, stride=stride, pads=pads,
+                        H=(OUTPUT_H - 1) * stride + kH - pads[0] - pads[2],
+                        W=(OUTPUT_W - 1) * stride + kW - pads[1] - pads[3],
+                        max_continuous_channels=CHANNEL // 2 if is_separate_tiling else CHANNEL,
+                        group=group, sparse=n.input[1] in sparse_weight_nodes)
+
+def get_conv_memory_usage(g, input_tile_c, output_tile_c):
+    # inner +1 for biases
+    filter_len = ((input_tile_c * g.kW + 1) + 1) // 2 * 2 * 2 * g.kH
+    real_output_tile_c = output_tile_c
+    # *2 as in JAPARI, the number of footprint weights is up to the number of
+    # filters (e.g., batch size=1)
+    if Constants.JAPARI:
+        real_output_tile_c *= 2
+    ret = ((real_output_tile_c + 1) + Constants.TEMP_FILTER_WIDTH + g.sparse) * filter_len
+    logger.debug('Checking output_tile_c=%d, filter_len=%d, memory usage=%d', output_tile_c, filter_len, ret)
+    return ret
+
+def get_conv_params_len(g, input_tile_c):
+    return math.ceil(g.CHANNEL / input_tile_c) * g.OUTPUT_CHANNEL * g.OUTPUT_H * g.OUTPUT_W * 2
 
-    max_continuous_channels = CHANNEL
-    if is_separate_tiling:
-        max_continuous_channels //= 2
-    node_flags.input_tile_c = max_continuous_channels
+def determine_conv_tile_c(n):
+    logger.debug('Determine tile size for Conv node %s', n.name)
 
-    logger.debug('Initial input_tile_c=%d', node_flags.input_tile_c)
+    g = get_conv_geometry(n)
+    node_flags = n.flags.b.extra.conv
 
-    def get_memory_usage(output_tile_c, filter_len):
-        real_output_tile_c = output_tile_c
-        # *2 as in JAPARI, the number of footprint weights is up to the number of
-        # filters (e.g., batch size=1)
-        if Constants.JAPARI:
-            real_output_tile_c *= 2
-        ret = ((real_output_tile_c + 1) + Constants.TEMP_FILTER_WIDTH) * filter_len
-        logger.debug('Checking output_tile_c=%d, filter_len=%d, memory usage=%d', output_tile_c, filter_len, ret)
-        return ret
+    if g.group > 1:
+        # handle_group_conv loads all input channels used by a tile of output channels
+        node_flags.input_tile_c = g.CHANNEL * g.group
+        node_flags.output_tile_c = next(get_group_conv_tile_candidates(g), 0)
+        assert node_flags.output_tile_c, f'No tile sizes fit for grouped Conv node {n.name}'
+        node_flags.tile_h = 1
+        return
+
+    node_flags.input_tile_c = g.max_continuous_channels
+
+    logger.debug('Initial input_tile_c=%d', node_flags.input_tile_c)
 
     while True:
         input_tile_too_large = False
-        # inner +1 for biases
-        filter_len = ((node_flags.input_tile_c * kW + 1) + 1) // 2 * 2 * 2 * kH
-        output_tile_c = OUTPUT_CHANNEL
-        while get_memory_usage(output_tile_c, filter_len) > Constants.LEA_BUFFER_SIZE:
+        output_tile_c = g.OUTPUT_CHANNEL
+        while get_conv_memory_usage(g, node_flags.input_tile_c, output_tile_c) > Constants.LEA_BUFFER_SIZE:
             logger.debug('output_tile_c=%d', output_tile_c)
             output_tile_c //= 2
             if output_tile_c % 2 or output_tile_c < config['op_filters']:
@@ -436,7 +612,7 @@ def determine_conv_tile_c(n):
                 break
 
         if not input_tile_too_large:
-            params_len = math.ceil(CHANNEL / node_flags.input_tile_c) * OUTPUT_CHANNEL * OUTPUT_H * OUTPUT_W * 2
+            params_len = get_conv_params_len(g, node_flags.input_tile_c)
             if params_len < config['intermediate_values_size']:
                 break
             logger.debug(f'params_len={params_len}, too high!')
@@ -444,6 +620,294 @@ def determine_conv_tile_c(n):
         node_flags.input_tile_c //= 2
         logger.debug('input_tile_c=%d', node_flags.input_tile_c)
     node_flags.output_tile_c = output_tile_c
+    node_flags.tile_h = Constants.DEFAULT_TILE_H
+
+def padding_for_lea(n):
+    return (n + 1) // 2 * 2
+
+def get_group_conv_output_channel(g):
+    """OUTPUT_CHANNEL in handle_group_conv, including output padding of Stateful and footprints of JAPARI"""
+    output_channel = g.N_FILTERS
+    if Constants.STATEFUL or Constants.JAPARI:
+        output_channel = math.ceil(output_channel / Constants.BATCH_SIZE) * Constants.BATCH_SIZE
+    if Constants.JAPARI:
+        output_channel = extend_for_footprints(output_channel)
+    return output_channel
+
+def get_group_conv_tile_input_c(g, output_tile_c):
+    # A tile consists of whole groups or is in a group
+    return max(output_tile_c // (g.N_FILTERS // g.group), 1) * g.CHANNEL
+
+def get_in_order_outputs_reserved_len(max_len):
+    """Values at the end of lea_buffer for writing up to max_len output values in write_in_order_outputs"""
+    if Constants.JAPARI:
+        return padding_for_lea((max_len + Constants.BATCH_SIZE) // (Constants.BATCH_SIZE + 1))
+    return 0
+
+def get_group_conv_memory_usage(g, output_tile_c):
+    """Values in lea_buffer for handle_group_conv"""
+    output_channel = get_group_conv_output_channel(g)
+    tile_input_c = get_group_conv_tile_input_c(g, output_tile_c)
+    filter_len = g.kH * g.kW * g.CHANNEL
+    group_filters = g.N_FILTERS // g.group
+    # Output channels computed as a vector, as block_filters in handle_group_conv
+    if g.CHANNEL == 1 and group_filters == 1:
+        block_filters = output_tile_c
+    else:
+        block_filters = min(output_tile_c, group_filters)
+    # Output values at an output position, an input window, filters and biases of a tile, and sums and products
+    # of a block
+    return (padding_for_lea(output_channel) + g.kH * g.kW * padding_for_lea(tile_input_c) +
+            output_tile_c // block_filters * filter_len * padding_for_lea(block_filters) +
+            padding_for_lea(output_tile_c) + 2 * padding_for_lea(block_filters) + get_in_order_outputs_reserved_len(output_channel))
+
+def group_conv_tiles_fit(g, output_tile_c):
+    """Check tile sizes against buffers in handle_group_conv"""
+    group_filters = g.N_FILTERS // g.group
+    if (output_tile_c % group_filters and group_filters % output_tile_c) or g.N_FILTERS % output_tile_c:
+        return False
+    # Input values with footprints are loaded into input_buffer_with_footprints (INPUT_BUFFER_WITH_FOOTPRINTS_LEN)
+    tile_input_c = get_group_conv_tile_input_c(g, output_tile_c)
+    if Constants.JAPARI and extend_for_footprints(tile_input_c) + 1 > 256:
+        return False
+    if get_group_conv_memory_usage(g, output_tile_c) > Constants.LEA_BUFFER_SIZE:
+        return False
+    return get_conv_params_len(g, g.CHANNEL * g.group) < config['intermediate_values_size']
+
+def get_group_conv_tile_candidates(g):
+    """Tiles of output channels from the largest one"""
+    for output_tile_c in range(g.N_FILTERS, 0, -1):
+        if group_conv_tiles_fit(g, output_tile_c):
+            yield output_tile_c
+
+# Values in ConvDataflow of common/cnn_common.h
+CONV_DATAFLOW_FILTER_STATIONARY = 0
+CONV_DATAFLOW_INPUT_STATIONARY = 1
+
+def get_conv_dataflows(g, output_tile_c):
+    ret = [CONV_DATAFLOW_FILTER_STATIONARY]
+    # Input-stationary needs filter tiles contiguous in output rows (see handle_conv).
+    # Grouped Conv has its own loop order (see handle_group_conv)
+    if g.group == 1 and g.N_FILTERS > output_tile_c and g.N_FILTERS % output_tile_c == 0 and output_tile_c % Constants.BATCH_SIZE == 0:
+        ret.append(CONV_DATAFLOW_INPUT_STATIONARY)
+    return ret
+
+def get_conv_input_windows(g, input_tile_c, tile_h):
+    """Values and DMA commands for loading input windows of an input channel tile (see handle_conv_inner_loop)"""
+    slides_windows = conv_slides_windows(g, input_tile_c, tile_h)
+    tile_h = min(g.H, tile_h * g.stride)
+    n_values = n_commands = n_windows = 0
+    for input_w in range(-g.pads[1], g.W + g.pads[3] - g.kW + 1, g.stride):
+        window_w = min(input_w + g.kW, g.W) - max(input_w, 0)
+        if slides_windows and input_w != -g.pads[1]:
+            # Only columns not in the window of the previous output column are loaded
+            window_w = max(min(input_w + g.kW, g.W) - max(input_w + max(g.kW - g.stride, 0), 0), 0)
+        for input_h in range(-g.pads[0], g.H + g.pads[2] - g.kH + 1, tile_h):
+            window_h = min(input_h + tile_h + g.kH - g.stride, g.H) - max(input_h, 0)
+            n_values += window_h * window_w * input_tile_c
+            # A row is loaded at once if all channels are in the tile
+            if window_w:
+                n_commands += window_h * (1 if input_tile_c == g.max_continuous_channels else window_w)
+            n_windows += 1
+    return n_values, n_commands, n_windows
+
+def get_conv_loaded_values(g, input_tile_c, output_tile_c, tile_h, dataflow):
+    """Values and DMA commands for loading inputs and filters of an input channel tile
+
+    Filter-stationary loads each filter once and each input window once per filter tile, while
+    input-stationary loads each input window once and all filters once per output position, or only
+    once if all filter tiles stay in VM.
+    """
+    window_values, window_commands, _ = get_conv_input_windows(g, input_tile_c, tile_h)
+    n_filter_tiles = math.ceil(g.N_FILTERS / output_tile_c)
+    filter_values = g.N_FILTERS * g.kH * g.kW * input_tile_c
+    filter_commands = g.N_FILTERS * g.kH * g.kW
+    if dataflow == CONV_DATAFLOW_FILTER_STATIONARY:
+        return (filter_values + n_filter_tiles * window_values,
+                filter_commands + n_filter_tiles * window_commands)
+    if conv_filter_tiles_resident(g, input_tile_c, output_tile_c, tile_h):
+        return (filter_values + window_values,
+                filter_commands + window_commands)
+    n_outputs = g.OUTPUT_H * g.OUTPUT_W
+    return (n_outputs * filter_values + window_values,
+            n_outputs * filter_commands + window_commands)
+
+def determine_conv_dataflow(n):
+    """Pick the loop order of Conv with fewer values loaded from NVM"""
+    g = get_conv_geometry(n)
+    node_flags = n.flags.b.extra.conv
+
+    node_flags.dataflow = CONV_DATAFLOW_FILTER_STATIONARY
+    loaded_values = {}
+    for dataflow in get_conv_dataflows(g, node_flags.output_tile_c):
+        loaded_values[dataflow], _ = get_conv_loaded_values(g, node_flags.input_tile_c, node_flags.output_tile_c, node_flags.tile_h, dataflow)
+    logger.debug('Conv node %s: values loaded with each dataflow: %r', n.name, loaded_values)
+    node_flags.dataflow = min(loaded_values, key=loaded_values.get)
+
+class TilingCostWeights:
+    """Weights of the cost model for --autotune-tiles, relative to reading a byte from NVM"""
+    NVM_WRITE_BYTE = 1
+    # SPI command, address and DMA setup for each transfer
+    DMA_COMMAND = 16
+    # Expected power failures during a layer, each of which reloads a tile
+    POWER_FAILURES = 4
+
+def get_tiling_cost(read_bytes, written_bytes, n_commands, reexecution_bytes):
+    return (read_bytes + TilingCostWeights.NVM_WRITE_BYTE * written_bytes +
+            TilingCostWeights.DMA_COMMAND * n_commands + TilingCostWeights.POWER_FAILURES * reexecution_bytes)
+
+def conv_filter_tiles_resident(g, input_tile_c, output_tile_c, tile_h):
+    """Check if all filter tiles stay in VM with input-stationary, in the same way as handle_conv"""
+    n_filter_tiles = math.ceil(g.N_FILTERS / output_tile_c)
+    if g.sparse or n_filter_tiles > CONV_MAX_RESIDENT_FILTER_TILES:
+        return False
+    # OUTPUT_LEN in common/conv.cpp
+    output_len = 256 if Constants.USE_ARM_CMSIS else 100
+    max_n_filters = output_tile_c * (2 if Constants.JAPARI else 1)
+    dest_offset = (g.kW * input_tile_c + 1 + 1) // 2 * 2
+    inputs_len = (min(tile_h * g.stride, g.H) + 2 * ((g.kH - 1) // 2)) * dest_offset
+    filters_len = (n_filter_tiles * max_n_filters + Constants.TEMP_FILTER_WIDTH) * g.kH * dest_offset
+    return inputs_len + filters_len + output_len <= Constants.LEA_BUFFER_SIZE
+
+def conv_tiles_fit(g, input_tile_c, output_tile_c, tile_h):
+    """Check tile sizes against buffers in handle_conv and NVM for intermediate values"""
+    if get_conv_memory_usage(g, input_tile_c, output_tile_c) > Constants.LEA_BUFFER_SIZE:
+        return False
+    # OUTPUT_LEN in common/conv.cpp
+    output_len = 256 if Constants.USE_ARM_CMSIS else 100
+    max_n_filters = output_tile_c * (2 if Constants.JAPARI else 1)
+    dest_offset = (g.kW * input_tile_c + 1 + 1) // 2 * 2
+    window_rows = min(tile_h * g.stride + g.kH - g.stride, g.H)
+    inputs_len = window_rows * dest_offset
+    filters_len = (max_n_filters + Constants.TEMP_FILTER_WIDTH + g.sparse) * g.kH * dest_offset
+    if max_n_filters > output_len or inputs_len + filters_len + output_len > Constants.LEA_BUFFER_SIZE:
+        return False
+    return get_conv_params_len(g, input_tile_c) < config['intermediate_values_size']
+
+def get_conv_tile_candidates(g):
+    input_tile_c = g.max_continuous_channels
+    while True:
+        # States are stripped from input values in units of BATCH_SIZE (see handle_conv_inner_loop)
+        if not Constants.STATEFUL or input_tile_c % Constants.BATCH_SIZE == 0 or Constants.BATCH_SIZE % input_tile_c == 0:
+            output_tile_c = g.OUTPUT_CHANNEL
+            while True:
+                for tile_h in range(1, min(g.OUTPUT_H, 255 // g.stride) + 1):
+                    if conv_tiles_fit(g, input_tile_c, output_tile_c, tile_h):
+                        yield input_tile_c, output_tile_c, tile_h
+                output_tile_c //= 2
+                if output_tile_c % 2 or output_tile_c < config['op_filters']:
+                    break
+        if input_tile_c % 2:
+            break
+        input_tile_c //= 2
+
+def conv_needs_merge(g, input_tile_c, tile_h):
+    # Conv writes NWHC, which is the same as NHWC if OUTPUT_H or OUTPUT_W is 1. Otherwise, Conv with a single input
+    # channel tile writes NHWC with NHWC_OUTPUTS, which needs an output row at a time (tile_h=1) except for grouped Conv
+    if input_tile_c < g.CHANNEL:
+        return True
+    return g.group == 1 and tile_h > 1 and g.OUTPUT_H > 1 and g.OUTPUT_W > 1
+
+def conv_has_nhwc_outputs(g):
+    return g.OUTPUT_H > 1 and g.OUTPUT_W > 1
+
+def conv_slides_windows(g, input_tile_c, tile_h):
+    # With NHWC_OUTPUTS, input windows are slid along output rows (see handle_conv_inner_loop)
+    return (g.group == 1 and conv_has_nhwc_outputs(g) and not args.keep_merge_nodes and
+            not conv_needs_merge(g, input_tile_c, tile_h))
+
+def gemm_needs_merge(B_rows, tile_channel):
+    return tile_channel < B_rows
+
+def get_conv_tiling_cost(g, input_tile_c, output_tile_c, tile_h, dataflow):
+    n_tiles_c = math.ceil(g.CHANNEL / input_tile_c)
+    n_filter_tiles = math.ceil(g.N_FILTERS / output_tile_c)
+    loaded_values, n_commands = get_conv_loaded_values(g, input_tile_c, output_tile_c, tile_h, dataflow)
+    window_values, _, n_windows = get_conv_input_windows(g, input_tile_c, tile_h)
+    output_len = g.OUTPUT_CHANNEL * g.OUTPUT_H * g.OUTPUT_W
+    # Conv writes results for each input channel tile, and ConvMerge reads all of them
+    read_bytes = 2 * n_tiles_c * loaded_values
+    written_bytes = 2 * n_tiles_c * output_len
+    if conv_needs_merge(g, input_tile_c, tile_h) or args.keep_merge_nodes:
+        read_bytes += 2 * n_tiles_c * output_len
+        written_bytes += 2 * output_len
+    # Output values of a filter tile at an output position are written at once
+    n_commands = n_tiles_c * (n_commands + g.OUTPUT_H * g.OUTPUT_W * n_filter_tiles)
+    # The input window and filters in VM are reloaded after a power failure
+    window_len = window_values // n_windows
+    if conv_slides_windows(g, input_tile_c, tile_h):
+        # the whole window instead of slid columns
+        window_len = g.kH * g.kW * input_tile_c
+    reexecution_bytes = 2 * (window_len + output_tile_c * g.kH * g.kW * input_tile_c)
+    return get_tiling_cost(read_bytes, written_bytes, n_commands, reexecution_bytes)
+
+def get_group_conv_tiling_cost(g, output_tile_c):
+    n_outputs = g.OUTPUT_H * g.OUTPUT_W
+    n_filter_tiles = g.N_FILTERS // output_tile_c
+    filter_len = g.kH * g.kW * g.CHANNEL
+    tile_input_c = get_group_conv_tile_input_c(g, output_tile_c)
+    # Filters and biases stay in VM with a single tile, and are loaded for each output position otherwise
+    n_filter_loads = n_filter_tiles * (n_outputs if n_filter_tiles > 1 else 1)
+    output_len = g.OUTPUT_CHANNEL * n_outputs
+    needs_merge = conv_needs_merge(g, g.CHANNEL * g.group, 1) or args.keep_merge_nodes
+    if n_filter_tiles > 1:
+        n_window_pixels = n_outputs * n_filter_tiles * g.kH * g.kW
+    elif needs_merge or not conv_has_nhwc_outputs(g):
+        # Rows in input windows are kept while moving down an output column
+        n_window_pixels = g.OUTPUT_W * ((g.OUTPUT_H - 1) * min(g.stride, g.kH) + g.kH) * g.kW
+    else:
+        # Pixels in rows of input windows are kept while moving along an output row
+        n_window_pixels = g.OUTPUT_H * ((g.OUTPUT_W - 1) * min(g.stride, g.kW) + g.kW) * g.kH
+    read_bytes = 2 * (n_filter_loads * output_tile_c * (filter_len + 1) + n_window_pixels * tile_input_c)
+    written_bytes = 2 * output_len
+    if needs_merge:
+        read_bytes += 2 * output_len
+        written_bytes += 2 * output_len
+    # A command for each pixel in input windows and for output values at each output position
+    n_commands = n_filter_loads * (1 + output_tile_c) + n_window_pixels + n_outputs
+    reexecution_bytes = 2 * (g.kH * g.kW * tile_input_c + output_tile_c * filter_len)
+    return get_tiling_cost(read_bytes, written_bytes, n_commands, reexecution_bytes)
+
+def autotune_conv_tiles(n):
+    g = get_conv_geometry(n)
+    node_flags = n.flags.b.extra.conv
+
+    if g.group > 1:
+        costs = {output_tile_c: get_group_conv_tiling_cost(g, output_tile_c) for output_tile_c in get_group_conv_tile_candidates(g)}
+        logger.debug('Grouped Conv node %s: cost with each output_tile_c: %r', n.name, costs)
+        assert costs, f'No tile sizes fit for grouped Conv node {n.name}'
+        node_flags.input_tile_c = g.CHANNEL * g.group
+        node_flags.output_tile_c = min(costs, key=costs.get)
+        node_flags.tile_h = 1
+        node_flags.dataflow = CONV_DATAFLOW_FILTER_STATIONARY
+        return
+
+    best = None
+    for input_tile_c, output_tile_c, tile_h in get_conv_tile_candidates(g):
+        for dataflow in get_conv_dataflows(g, output_tile_c):
+            cost = get_conv_tiling_cost(g, input_tile_c, output_tile_c, tile_h, dataflow)
+            logger.debug('input_tile_c=%d, output_tile_c=%d, tile_h=%d, dataflow=%d: cost=%d',
+                         input_tile_c, output_tile_c, tile_h, dataflow, cost)
+            if not best or cost < best[0]:
+                best = (cost, input_tile_c, output_tile_c, tile_h, dataflow)
+    assert best, f'No tile sizes fit for Conv node {n.name}'
+    _, node_flags.input_tile_c, node_flags.output_tile_c, node_flags.tile_h, node_flags.dataflow = best
+
+def check_conv_tiles(n):
+    g = get_conv_geometry(n)
+    node_flags = n.flags.b.extra.conv
+    if g.group > 1:
+        assert node_flags.input_tile_c == g.CHANNEL * g.group, \
+            f'Input channels of grouped Conv node {n.name} cannot be tiled'
+        assert group_conv_tiles_fit(g, node_flags.output_tile_c), \
+            f'Tiles of grouped Conv node {n.name} should be whole groups or in a group, and fit'
+        return
+    assert g.max_continuous_channels % node_flags.input_tile_c == 0 and g.OUTPUT_CHANNEL % node_flags.output_tile_c == 0, \
+        f'Tile sizes of Conv node {n.name} should divide the channels'
+    assert conv_tiles_fit(g, node_flags.input_tile_c, node_flags.output_tile_c, node_flags.tile_h), \
+        f'Tiles of Conv node {n.name} do not fit'
+    assert node_flags.dataflow in get_conv_dataflows(g, node_flags.output_tile_c), \
+        f'Dataflow {node_flags.dataflow} is not supported with tiles of Conv node {n.name}'
 
 def determine_gemm_tile_sizes(n):
     logger.debug('Determine tile size for Gemm node %s', n.name)
@@ -458,6 +922,7 @@ def determine_gemm_tile_sizes(n):
 
     # writing a batch at a time is simpler and faster
     tile_size_unit = config['op_filters']
+    node_flags.op_filters = tile_size_unit
 
     while True:
         # LEA wants addresses to be 4 byte-aligned, or 2 Q15-aligned
@@ -470,6 +935,8 @@ def determine_gemm_tile_sizes(n):
         while node_flags.tile_channel > 0:
             tmp = int(math.ceil(B_rows / node_flags.tile_channel))
             needed_mem = (A_rows * A_cols + 2) + (node_flags.tile_channel + 2) * full_tile_width + A_rows * full_tile_width
+            if n.input[1] in sparse_weight_nodes:
+                needed_mem += get_gemm_sparse_inputs_len(node_flags.tile_channel)
             logger.debug("tile_channel=%d, tmp=%d, needed_mem=%d", node_flags.tile_channel, tmp, needed_mem)
             if needed_mem <= Constants.LEA_BUFFER_SIZE:
                 break
@@ -480,35 +947,357 @@ def determine_gemm_tile_sizes(n):
 
     assert (tile_size_unit * 2) * (node_flags.tile_channel + 2) <= Constants.ARM_PSTATE_LEN
 
+def get_gemm_shape(n):
+    A = find_tensor_value_info(onnx_model, n.input[0])
+    B = find_initializer(onnx_model, n.input[1])
+    return A.type.tensor_type.shape.dim[1].dim_value, B.dims[0], B.dims[1]
+
+def get_gemm_sparse_inputs_len(tile_channel):
+    """Values for inputs gathered with sparse weights in handle_gemm_tile, with 2 values for alignment"""
+    return tile_channel + 2 + 2
+
+def gemm_tiles_fit(A_cols, B_rows, tile_channel, op_filters, sparse):
+    """Check tile sizes against buffers in handle_gemm_tile"""
+    if tile_channel % op_filters or tile_channel > min(B_rows, config['gemm_tile_length'] or float('inf'), 512):
+        return False
+    if (op_filters * 2) * (tile_channel + 2) > Constants.ARM_PSTATE_LEN:
+        return False
+    full_tile_width = (extend_for_footprints(op_filters) + 1) // 2 * 2
+    # buffer_temp is for OP_FILTERS values
+    results_len = (extend_for_footprints(config['op_filters']) + 1) // 2 * 2
+    needed_mem = (A_cols + 4) + results_len + (tile_channel + 2) * full_tile_width
+    if sparse:
+        needed_mem += get_gemm_sparse_inputs_len(tile_channel)
+    return needed_mem <= Constants.LEA_BUFFER_SIZE
+
+def get_gemm_op_filters_candidates():
+    op_filters = config['op_filters']
+    yield op_filters
+    # move_weights() for JAPARI moves weights for OP_FILTERS output values
+    if Constants.JAPARI:
+        return
+    # LEA wants an even number of columns
+    while op_filters // 2 % 2 == 0 and op_filters // 2 % Constants.BATCH_SIZE == 0:
+        op_filters //= 2
+        yield op_filters
+
+def get_gemm_tiling_cost(A_cols, B_rows, B_cols, tile_channel, op_filters):
+    n_tiles = math.ceil(B_rows / tile_channel)
+    n_chunks = math.ceil(B_cols / op_filters)
+    # Gemm writes results for each tile, and GemmMerge reads all of them
+    read_bytes = 2 * (A_cols + B_rows * B_cols)
+    written_bytes = 2 * n_tiles * B_cols
+    if gemm_needs_merge(B_rows, tile_channel) or args.keep_merge_nodes:
+        read_bytes += 2 * n_tiles * B_cols
+        written_bytes += 2 * B_cols
+    # A command for inputs of a tile, and a command per row of weights and per output chunk
+    n_commands = n_tiles + B_rows * n_chunks + n_tiles * n_chunks
+    # Inputs and weights in VM are reloaded after a power failure
+    reexecution_bytes = 2 * (tile_channel + tile_channel * op_filters)
+    return get_tiling_cost(read_bytes, written_bytes, n_commands, reexecution_bytes)
+
+def autotune_gemm_tiles(n):
+    A_cols, B_rows, B_cols = get_gemm_shape(n)
+    node_flags = n.flags.b.extra.gemm
+
+    best = None
+    for op_filters in get_gemm_op_filters_candidates():
+        for tile_channel in range(op_filters, B_rows + 1, op_filters):
+            if not gemm_tiles_fit(A_cols, B_rows, tile_channel, op_filters, n.input[1] in sparse_weight_nodes):
+                continue
+            cost = get_gemm_tiling_cost(A_cols, B_rows, B_cols, tile_channel, op_filters)
+            logger.debug('tile_channel=%d, op_filters=%d: cost=%d', tile_channel, op_filters, cost)
+            if not best or cost < best[0]:
+                best = (cost, tile_channel, op_filters)
+    assert best, f'No tile sizes fit for Gemm node {n.name}'
+    _, node_flags.tile_channel, node_flags.op_filters = best
+
+def check_gemm_tiles(n):
+    A_cols, B_rows, _ = get_gemm_shape(n)
+    node_flags = n.flags.b.extra.gemm
+    assert node_flags.op_filters in get_gemm_op_filters_candidates(), \
+        f'op_filters of Gemm node {n.name} should be OP_FILTERS or OP_FILTERS divided by a power of 2'
+    assert gemm_tiles_fit(A_cols, B_rows, node_flags.tile_channel, node_flags.op_filters, n.input[1] in sparse_weight_nodes), \
+        f'Tiles of Gemm node {n.name} do not fit'
+
+# Fields of NodeFlags::extra in --tile-overrides and tiles.json
+tile_flag_names = {
+    'Conv': ('conv', ['input_tile_c', 'output_tile_c', 'tile_h', 'dataflow']),
+    'Gemm': ('gemm', ['tile_channel', 'op_filters']),
+}
+
+tile_overrides = {}
+if args.tile_overrides:
+    with open(args.tile_overrides) as f:
+        tile_overrides = json.load(f)
+
+def determine_tile_sizes(n):
+    node_key = n.name or n.output[0]
+    if n.op_type == 'Conv':
+        if args.autotune_tiles:
+            autotune_conv_tiles(n)
+        else:
+            determine_conv_tile_c(n)
+            determine_conv_dataflow(n)
+    else:
+        if args.autotune_tiles:
+            autotune_gemm_tiles(n)
+        else:
+            determine_gemm_tile_sizes(n)
+
+    extra_flags_name, flag_names = tile_flag_names[n.op_type]
+    node_flags = getattr(n.flags.b.extra, extra_flags_name)
+    for key, value in tile_overrides.get(node_key, {}).items():
+        assert key in flag_names, f'Unknown tile size {key} for {n.op_type} node {node_key}'
+        setattr(node_flags, key, value)
+    # Greedy tile sizes are not checked for compatibility
+    if args.autotune_tiles or node_key in tile_overrides:
+        if n.op_type == 'Conv':
+            check_conv_tiles(n)
+        else:
+            check_gemm_tiles(n)
+
+    node_tile_sizes = {key: getattr(node_flags, key) for key in flag_names}
+    logger.info('Tile sizes for %s node %s: %r', n.op_type, node_key, node_tile_sizes)
+    return node_key, node_tile_sizes
+
+graph_output_names = set(output.name for output in onnx_model.graph.output)
+
+def can_fuse(producer, n):
+    # Intermediate values of producer are dropped, so n should be the only consumer
+    if not producer or producer.output[0] in graph_output_names:
+        return False
+    return [consumer for consumer in nodes if producer.output[0] in consumer.input] == [n]
+
+def fuse_operators():
+    # Apply ReLU and MaxPool on outputs of ConvMerge, GemmMerge and MaxPool before
+    # they are written to NVM, instead of writing and reading back the whole feature map
+    # once more in separate layers. Fused nodes keep flags determined above, so the output
+    # layout is the same as the original last node.
+    for n in list(nodes):
+        if n.op_type not in ('Relu', 'MaxPool'):
+            continue
+        producer = find_node_by_output(nodes, n.input[0])
+        if not can_fuse(producer, n):
+            continue
+        producer_flags = producer.flags.b
+        if n.op_type == 'Relu':
+            if producer.op_type not in ('ConvMerge', 'GemmMerge', 'MaxPool') or producer_flags.generic & op_flag('FUSED_RELU'):
+                continue
+            producer_flags.generic += op_flag('FUSED_RELU')
+        else:
+            if producer.op_type != 'ConvMerge' or producer_flags.generic & op_flag('FUSED_MAXPOOL'):
+                continue
+            # Values are written in NCHW one by one in that case, which does not fit ConvMerge
+            if n.flags.b.generic & op_flag('NHWC2NCHW'):
+                continue
+            producer_flags.extra.maxpool = n.flags.b.extra.maxpool
+            producer_flags.generic += op_flag('FUSED_MAXPOOL') + (n.flags.b.generic & op_flag('MAXPOOL_CEIL'))
+        logger.info('Fusing %s node %s into %s node %s', n.op_type, n.name, producer.op_type, producer.name)
+        producer.output[0] = n.output[0]
+        nodes.remove(n)
+
+def eliminate_merge_nodes():
+    # ConvMerge and GemmMerge only copy values for layers with a single input channel tile
+    # and the final layout. Remove them so that Conv and Gemm write final outputs directly.
+    # Merge nodes with fused operators are kept, as they replace separate layers.
+    for n in list(nodes):
+        if n.op_type not in ('ConvMerge', 'GemmMerge') or n.flags.b.generic & (op_flag('FUSED_RELU') | op_flag('FUSED_MAXPOOL')):
+            continue
+        producer = find_node_by_output(nodes, n.input[0])
+        if producer.op_type == 'Conv':
+            g = get_conv_geometry(producer)
+            conv_flags = producer.flags.b.extra.conv
+            node_key = producer.name or producer.output[0]
+            # Greedy tile sizes are changed to an output row at a time, while autotuned or overridden tile sizes are kept,
+            # as their costs already include ConvMerge
+            if (g.group == 1 and conv_flags.input_tile_c == g.CHANNEL and conv_flags.tile_h > 1 and
+                    not args.autotune_tiles and node_key not in tile_overrides):
+                conv_flags.tile_h = 1
+                determine_conv_dataflow(producer)
+                tile_sizes[node_key].update(tile_h=conv_flags.tile_h, dataflow=conv_flags.dataflow)
+            needs_merge = conv_needs_merge(g, conv_flags.input_tile_c, conv_flags.tile_h)
+            if not needs_merge and conv_has_nhwc_outputs(g):
+                producer.flags.b.generic += op_flag('NHWC_OUTPUTS')
+        else:
+            _, B_rows, _ = get_gemm_shape(producer)
+            needs_merge = gemm_needs_merge(B_rows, producer.flags.b.extra.gemm.tile_channel)
+        if needs_merge:
+            continue
+        logger.info('Removing %s node %s', n.op_type, n.name)
+        producer.output[0] = n.output[0]
+        nodes.remove(n)
+
+tile_sizes = {}
+for n in nodes:
+    if n.op_type in ('Conv', 'Gemm'):
+        node_key, tile_sizes[node_key] = determine_tile_sizes(n)
+
+if args.fuse_operators:
+    fuse_operators()
+if not args.keep_merge_nodes:
+    eliminate_merge_nodes()
+
+for idx, n in enumerate(nodes):
+    if n.op_type == 'Dropout':
+        output = n.output[:1]  # we don't care the second output `mask`
+    else:
+        output = n.output
+    for output_ in output:
+        names[output_] = idx + Constants.N_INPUT
+
+pprint.pprint(names)
+
 graph = []
 for n in nodes:
-    if n.op_type == 'Conv':
-        determine_conv_tile_c(n)
-    if n.op_type == 'Gemm':
-        determine_gemm_tile_sizes(n)
     graph.append(Node(name=n.name or n.op_type,
                       output_name=n.output[0],
                       inputs=[names[i] for i in n.input],
                       op_type=n.op_type,
-                      flags=n.flags,
-                      max_output_id=0))
+                      flags=n.flags))
+
+def get_padded_values(C):
+    """An upper bound of channels from C channels after output padding of Stateful or alignment of JAPARI, without footprints"""
+    if Constants.STATEFUL:
+        return C + Constants.BATCH_SIZE - 1
+    if Constants.JAPARI:
+        return math.ceil(C / Constants.BATCH_SIZE) * Constants.BATCH_SIZE
+    return C
+
+def get_padded_channel(C):
+    """get_padded_values() with footprints of JAPARI"""
+    if Constants.JAPARI:
+        return extend_for_footprints(get_padded_values(C))
+    return get_padded_values(C)
+
+def get_output_params_len(n, input_params_len):
+    """An upper bound of params_len from allocators in common/, in bytes"""
+    if n.op_type in ('Relu', 'Add'):
+        # The same as the first input, as handle_node() copies ParameterInfo of the input
+        return input_params_len
+    if n.op_type == 'Conv':
+        g = get_conv_geometry(n)
+        if g.group != 1:
+            n_tiles_c = 1
+        else:
+            n_tiles_c = get_padded_values(g.CHANNEL) // n.flags.b.extra.conv.input_tile_c
+        return n_tiles_c * get_padded_channel(g.OUTPUT_CHANNEL) * g.OUTPUT_H * g.OUTPUT_W * 2
+    if n.op_type == 'Gemm':
+        _, B_rows, B_cols = get_gemm_shape(n)
+        return math.ceil(B_rows / n.flags.b.extra.gemm.tile_channel) * get_padded_channel(B_cols) * 2
+    dims = [dim.dim_value for dim in find_tensor_value_info(onnx_model, n.output[0]).type.tensor_type.shape.dim]
+    if n.op_type == 'MaxPool' and Constants.JAPARI and n.flags.b.generic & op_flag('NHWC2NCHW'):
+        # Footprints are moved from channels to the last dimension (see alloc_maxpool)
+        return get_padded_values(dims[1]) * int(np.prod(dims[2:-1])) * extend_for_footprints(dims[-1]) * 2
+    return get_padded_channel(dims[1]) * int(np.prod(dims[2:])) * 2
 
-for idx, node in enumerate(graph):
-    for inp in node.inputs:
-        if inp < Constants.N_INPUT:
+@dataclasses.dataclass
+class IntermediateValuesPlan:
+    # For each node, the node writing intermediate values used as the output, or None for model inputs
+    owners: List[int]
+    # For each node writing intermediate values
+    slots: dict
+    params_offsets: dict
+    # Sizes of regions for each node writing intermediate values, in bytes
+    params_lens: dict
+    # Bitwidths of intermediate values for each node writing intermediate values
+    bitwidths: dict
+    arena_size: int
+
+def plan_intermediate_values():
+    """Place intermediate values in a region (a slot) and at an offset of NVM for all intermediate values.
+
+    Intermediate values are live from the node writing them to the last node reading them, possibly via
+    nodes updating values in place or Concat. Intermediate values sharing NVM are placed at the start
+    of the same region, so that states of old values are known from the state bit and turning points
+    of the region (see SlotInfo in common/cnn_common.h). A region is as large as its largest values."""
+    owners = []
+    # Intermediate values read for the output of each node, which are more than one for Concat
+    storages = []
+    # Sizes of intermediate values as q15 values and as stored in NVM
+    q15_sizes = {}
+    sizes = {}
+    bitwidths = {}
+    for idx, (n, node) in enumerate(zip(nodes, graph)):
+        intermediate_inputs = [inp - Constants.N_INPUT for inp in node.inputs if inp >= Constants.N_INPUT]
+        if node.op_type in inplace_update_ops + ['Concat']:
+            first_input = node.inputs[0] - Constants.N_INPUT
+            owners.append(owners[first_input] if first_input >= 0 else None)
+            read_inputs = intermediate_inputs if node.op_type == 'Concat' else intermediate_inputs[:1]
+            storages.append(set().union(*(storages[inp] for inp in read_inputs)))
             continue
-        used_node = graph[inp - Constants.N_INPUT]
-        used_node.max_output_id = max([idx, used_node.max_output_id])
-
-# Inputs of Concat should be kept until Concat is processed
-for idx, node in enumerate(graph):
-    if node.op_type != 'Concat':
-        continue
-    for inp in node.inputs:
-        if inp < Constants.N_INPUT:
+        first_input = node.inputs[0] - Constants.N_INPUT
+        if first_input >= 0:
+            input_params_len = max(q15_sizes[owner] for owner in storages[first_input])
+        else:
+            input_params_len = config['total_sample_size'] * 2
+        owners.append(idx)
+        storages.append({idx})
+        q15_sizes[idx] = get_output_params_len(n, input_params_len)
+
+    for idx in q15_sizes:
+        bitwidths[idx] = int(args.activation_precision)
+    for idx, node in enumerate(graph):
+        if node.op_type not in ('ConvMerge', 'GemmMerge'):
             continue
-        used_node = graph[inp - Constants.N_INPUT]
-        used_node.max_output_id = max([used_node.max_output_id, node.max_output_id])
+        for owner in storages[node.inputs[0] - Constants.N_INPUT]:
+            bitwidths[owner] = 16
+    for owner in storages[-1]:
+        bitwidths[owner] = 16
+    for idx in q15_sizes:
+        sizes[idx] = q15_sizes[idx] * bitwidths[idx] // 16
+
+    live_until = {idx: idx for idx in sizes}
+    for idx, node in enumerate(graph):
+        for inp in node.inputs:
+            if inp < Constants.N_INPUT:
+                continue
+            for owner in storages[inp - Constants.N_INPUT]:
+                live_until[owner] = max(live_until[owner], idx)
+
+    def overlapped(a, b):
+        return a <= live_until[b] and b <= live_until[a]
+
+    # From the largest values, so that values never enlarge regions they share
+    regions = []
+    for idx in sorted(sizes, key=lambda idx: (-sizes[idx], idx)):
+        for region in regions:
+            if not any(overlapped(idx, other) for other in region):
+                region.append(idx)
+                break
+        else:
+            regions.append([idx])
+    if len(regions) > config['num_slots']:
+        # In the order of nodes, which needs the fewest regions
+        regions = []
+        for idx in sorted(sizes):
+            for region in regions:
+                if live_until[region[-1]] < idx:
+                    region.append(idx)
+                    break
+            else:
+                regions.append([idx])
+    assert len(regions) <= config['num_slots'], f'Intermediate values need {len(regions)} slots, more than num_slots={config["num_slots"]}'
+
+    slots = {}
+    params_offsets = {}
+    params_lens = {}
+    arena_size = 0
+    for slot_id, region in enumerate(regions):
+        region_size = max(sizes[idx] for idx in region)
+        for idx in region:
+            slots[idx] = slot_id
+            params_offsets[idx] = arena_size
+            params_lens[idx] = region_size
+        arena_size += region_size
+    logger.info('Intermediate values take %d bytes in %d slots, while the largest one takes %d bytes',
+                arena_size, len(regions), max(sizes.values()))
+    return IntermediateValuesPlan(owners=owners, slots=slots, params_offsets=params_offsets, params_lens=params_lens,
+                                  bitwidths=bitwidths, arena_size=arena_size)
+
+intermediate_values_plan = plan_intermediate_values()
+# From now on, intermediate_values_size is the size of NVM for all intermediate values, instead of the limit for a node
+config['intermediate_values_size'] = intermediate_values_plan.arena_size
 
 parameters = [None for _ in range(Constants.N_INPUT)]
 
@@ -550,18 +1339,22 @@ outputs = {
 }
 
 Constants.MODEL_NODES_LEN = len(graph)
+if args.bundle:
+    Constants.MAX_MODEL_NODES_LEN = BUNDLE_MAX_MODEL_NODES_LEN
+    assert Constants.MODEL_NODES_LEN <= Constants.MAX_MODEL_NODES_LEN, f'Too many nodes for model bundles: {Constants.MODEL_NODES_LEN}'
+else:
+    Constants.MAX_MODEL_NODES_LEN = Constants.MODEL_NODES_LEN
 
 model = outputs['model']
 model.write(to_bytes(0))  # Model.running
 model.write(to_bytes(0))  # Model.run_counter
 model.write(to_bytes(0))  # Model.layer_idx
-for _ in range(config['num_slots']): # Model.slots_info
-    if Constants.INDIRECT_RECOVERY:
+if Constants.INDIRECT_RECOVERY:
+    for _ in range(Constants.MAX_NUM_SLOTS): # Model.slots_info
         model.write(to_bytes(1, size=8)) # SlotInfo.state_bit
         model.write(to_bytes(0, size=8)) # SlotInfo.n_turning_points
         for __ in range(Constants.TURNING_POINTS_LEN):
             model.write(to_bytes(-1))   # SlotInfo.turning_points
-    model.write(to_bytes(-1))       # SlotInfo.user
 model.write(to_bytes(0, size=8))  # Model.dummy
 model.write(to_bytes(0, size=8))  # Model.version
 
@@ -575,10 +1368,16 @@ parameters_slot = ParametersSlot(offset=0, target=outputs['parameters'], slot_id
 
 output_nodes = outputs['nodes']
 for node in graph:
+    if args.bundle:
+        assert len(node.inputs) <= Constants.NUM_INPUTS, f'Too many inputs for model bundles: {node.name}'
     Constants.NUM_INPUTS = max(Constants.NUM_INPUTS, len(node.inputs))
 logger.info('Maximum number of inputs = %d', Constants.NUM_INPUTS)
 
 ops = get_model_ops(onnx_model)
+if args.bundle:
+    unsupported_ops = set(ops) - set(all_ops)
+    assert not unsupported_ops, f'Unsupported operators: {unsupported_ops}'
+    ops = all_ops
 
 def write_str(buffer: io.BytesIO, data: str):
     assert Constants.NODE_NAME_LEN >= len(data), f'String too long: {data}'
@@ -592,7 +1391,6 @@ for node in graph:
         output_nodes.write(to_bytes(inp))
     for _ in range(Constants.NUM_INPUTS - len(node.inputs)):
         output_nodes.write(to_bytes(0))
-    output_nodes.write(to_bytes(node.max_output_id))
     output_nodes.write(to_bytes(ops.index(node.op_type)))
     assert ctypes.sizeof(node.flags.as_bytes) == ctypes.sizeof(node.flags.b)
     for idx in range(ctypes.sizeof(node.flags.as_bytes)):
@@ -610,8 +1408,50 @@ def decode_raw_data(params):
     }[params.data_type]
     return list(map(lambda t: t[0], struct.iter_unpack(format_char, params.raw_data)))
 
+def get_sparse_weight_rows(n, q15_data, dims):
+    """Split weights into rows of blocks for block-CSR, which follow tiles of n.
+    Returns None if blocks cannot follow tiles"""
+
+    rows = []
+    if n.op_type == 'Conv':
+        # A row for each input channel tile and filter tile (see convTask). A block is
+        # output_tile_c filters x input_tile_c channels at a pixel in the kernel
+        node_flags = n.flags.b.extra.conv
+        N_FILTERS, kH, kW, CHANNEL = dims[0], dims[2], dims[3], dims[1]
+        input_tile_c, output_tile_c = node_flags.input_tile_c, node_flags.output_tile_c
+        if CHANNEL % input_tile_c:
+            return None
+        filters = np.reshape(q15_data, (N_FILTERS, kH, kW, CHANNEL))
+        for c in range(0, CHANNEL, input_tile_c):
+            for filter_idx in range(0, N_FILTERS, output_tile_c):
+                row = []
+                for kh, kw in itertools.product(range(kH), range(kW)):
+                    block = np.zeros((output_tile_c, input_tile_c), dtype=int)
+                    values = filters[filter_idx:filter_idx + output_tile_c, kh, kw, c:c + input_tile_c]
+                    block[:values.shape[0], :] = values
+                    row.append((kh * kW + kw, block))
+                rows.append(row)
+    else:
+        # A row for each tile of input channels and chunk of op_filters output values (see handle_gemm_tile).
+        # A block is a row of weights in the chunk
+        node_flags = n.flags.b.extra.gemm
+        B_rows, B_cols = dims
+        tile_channel, op_filters = node_flags.tile_channel, node_flags.op_filters
+        weights = np.reshape(q15_data, (B_rows, B_cols))
+        for i in range(0, B_rows, tile_channel):
+            for j in range(0, B_cols, op_filters):
+                row = []
+                for row_idx in range(min(tile_channel, B_rows - i)):
+                    block = np.zeros(op_filters, dtype=int)
+                    values = weights[i + row_idx, j:j + op_filters]
+                    block[:len(values)] = values
+                    row.append((row_idx, block))
+                rows.append(row)
+    return rows
+
 model_parameters_info = outputs['model_parameters_info']
 for params in parameters:
+    param_flags = 0
     if params is None:  # input
         # Actual data for test samples are added last
         dims = model_data.images[0].shape
@@ -639,14 +1479,55 @@ for params in parameters:
             assert data_len > 0
             slot = parameters_slot
             model_parameters_info.write(to_bytes(slot.offset, size=32))  # params_offset
-            model_parameters_info.write(to_bytes(data_len * 2, size=32))  # A _q15 is 16-bit
             if params.name in conv_param_names:
                 logger.info('Reorder conv param %s', params.name)
                 float_data = nchw2nhwc(float_data, params.dims)
             param_scale = config['scale']
-            slot.target.write(to_bytes(_Q15(np.array(float_data) / param_scale, 'Parameter')))
-            slot.offset += 2 * len(float_data)
-            model_parameters_info.write(to_bytes(16, size=8)) # bitwidth
+            q15_data = _Q15(np.array(float_data) / param_scale, 'Parameter')
+            bitwidth = 16
+            if params.name in sparse_weight_nodes:
+                n = sparse_weight_nodes[params.name]
+                rows = get_sparse_weight_rows(n, q15_data, params.dims)
+                if rows:
+                    sparse_values, sparse_indices, zero_block_ratio = to_block_csr(rows)
+                    logger.info('Ratio of zero blocks in weights of %s node %s: %.2f', n.op_type, n.name, zero_block_ratio)
+                    # Offsets of values are 16-bit (see my_memcpy_from_param)
+                    if zero_block_ratio >= SPARSE_MIN_ZERO_BLOCK_RATIO and len(sparse_values) < 2 ** 16:
+                        param_flags |= op_flag('SPARSE')
+            if param_flags & op_flag('SPARSE'):
+                # Sparse weights stay 16-bit, as 8-bit parameters are sliced by output channels (see read_q7_parameters())
+                model_parameters_info.write(to_bytes(len(sparse_values) * 2, size=32))
+                slot.target.write(to_bytes(sparse_values))
+                slot.target.write(to_bytes(sparse_indices))
+                slot.offset += 2 * (len(sparse_values) + len(sparse_indices))
+            elif params.name in weight_param_names and args.weight_precision != '16':
+                if len(params.dims) == 4:
+                    # A shift for each slice along dims[0], which is an output channel for Conv filters
+                    q7_data, shifts, sqnr = _Q7_with_shifts(q15_data, params.dims[0])
+                else:
+                    # A shift for each column along dims[1], which is an output channel for Gemm weights
+                    B_rows, B_cols = params.dims
+                    q7_data, shifts, sqnr = _Q7_with_shifts(np.reshape(q15_data, (B_rows, B_cols)).T, B_cols)
+                    q7_data = np.reshape(q7_data, (B_cols, B_rows)).T.flatten()
+                logger.info('Parameter %s: SQNR of q7 values = %.1f dB', params.name, sqnr)
+                if args.weight_precision == '8' or sqnr >= MIN_Q7_SQNR:
+                    bitwidth = 8
+            if param_flags & op_flag('SPARSE'):
+                pass
+            elif bitwidth == 8:
+                model_parameters_info.write(to_bytes(data_len, size=32))  # A q7 is 8-bit
+                slot.target.write(to_bytes(q7_data & 0xff, size=8))
+                # Shifts are 16-bit and aligned for DMA
+                q7_len = data_len + data_len % 2
+                if data_len % 2:
+                    slot.target.write(to_bytes(0, size=8))
+                slot.target.write(to_bytes(shifts))
+                slot.offset += q7_len + 2 * len(shifts)
+            else:
+                model_parameters_info.write(to_bytes(data_len * 2, size=32))  # A _q15 is 16-bit
+                slot.target.write(to_bytes(q15_data))
+                slot.offset += 2 * len(float_data)
+            model_parameters_info.write(to_bytes(bitwidth, size=8)) # bitwidth
         elif params.data_type == onnx.TensorProto.INT64:
             if params.int64_data:
                 int64_data = params.int64_data
@@ -678,19 +1559,28 @@ for params in parameters:
         model_parameters_info.write(to_bytes(param_scale))       # scale
 
     # common to input and non-inputs
-    model_parameters_info.write(to_bytes(0, size=8))                 # param_flags
+    model_parameters_info.write(to_bytes(param_flags, size=8))       # param_flags
     for _ in range(Constants.EXTRA_INFO_LEN):
         model_parameters_info.write(to_bytes(0, size=8))             # extra_info
     model_parameters_info.write(to_bytes(parameter_info_idx))        # parameter_info_idx
     parameter_info_idx += 1
 
-# Placeholder for ParameterInfo of intermediate values
+# Placeholder for ParameterInfo of intermediate values, except for the planned slot, offset, region size and bitwidth
 intermediate_parameters_info = outputs['intermediate_parameters_info']
 for idx, n in enumerate(nodes):
-    intermediate_parameters_info.write(to_bytes(0, size=32))  # params_offset
-    intermediate_parameters_info.write(to_bytes(0, size=32))  # params_len
-    intermediate_parameters_info.write(to_bytes(0, size=8))  # bitwidth
-    intermediate_parameters_info.write(to_bytes(0, size=8))  # slot
+    owner = intermediate_values_plan.owners[idx]
+    if owner is None:
+        # Nodes updating model inputs in place, which are at offset 0 of the test set
+        params_offset, params_len, slot_id, bitwidth = 0, config['total_sample_size'] * 2, Constants.SLOT_TEST_SET, 16
+    else:
+        params_offset = intermediate_values_plan.params_offsets[owner]
+        params_len = intermediate_values_plan.params_lens[owner]
+        slot_id = intermediate_values_plan.slots[owner]
+        bitwidth = intermediate_values_plan.bitwidths[owner]
+    intermediate_parameters_info.write(to_bytes(params_offset, size=32))  # params_offset
+    intermediate_parameters_info.write(to_bytes(params_len, size=32))  # params_len, the planned region size
+    intermediate_parameters_info.write(to_bytes(bitwidth, size=8))  # bitwidth, the planned one
+    intermediate_parameters_info.write(to_bytes(slot_id, size=8))  # slot
     intermediate_parameters_info.write(to_bytes(0))         # dummy
     for _ in range(4):  # dims[4]
         intermediate_parameters_info.write(to_bytes(0))
@@ -733,7 +1623,53 @@ if args.write_images:
 
 pathlib.Path(args.data_output_dir).mkdir(exist_ok=True)
 
-with open(f'{args.data_output_dir}/data.cpp', 'w') as output_c, open(f'{args.data_output_dir}/data.h', 'w') as output_h:
+def write_if_changed(path, content):
+    # Keep timestamps of unchanged files, so that switching model bundles does not trigger rebuilding
+    try:
+        with open(path) as f:
+            if f.read() == content:
+                return
+    except FileNotFoundError:
+        pass
+    with open(path, 'w') as f:
+        f.write(content)
+
+def write_model_bundle(path):
+    # Sections are in the order of ModelBundleSectionId in common/model_bundle.h
+    sections = [outputs[name].getvalue() for name in (
+        'parameters', 'samples', 'model', 'nodes', 'model_parameters_info', 'intermediate_parameters_info', 'labels',
+    )]
+    sections.append(struct.pack(f'<{len(Constants.FIRST_SAMPLE_OUTPUTS)}f', *Constants.FIRST_SAMPLE_OUTPUTS))
+
+    # Should match struct ModelBundleHeader
+    header_format = '<8sII16sIII16sIIIIIIIIIf' + 'II' * len(sections)
+    header_len = struct.calcsize(header_format)
+    # Sections are aligned so that they can be accessed as structs and arrays in place
+    alignment = 64
+    section_offsets = []
+    offset = header_len
+    for section in sections:
+        offset = (offset + alignment - 1) // alignment * alignment
+        section_offsets.append(offset)
+        offset += len(section)
+
+    section_table = []
+    for section_offset, section in zip(section_offsets, sections):
+        section_table.extend([section_offset, len(section)])
+    header = struct.pack(header_format,
+                         b'SCNNBNDL', MODEL_BUNDLE_VERSION, header_len,
+                         Constants.METHOD.encode('ascii'), Constants.BATCH_SIZE, Constants.LEA_BUFFER_SIZE, Constants.USE_ARM_CMSIS,
+                         args.config.encode('ascii'), Constants.MODEL_NODES_LEN, Constants.N_INPUT, config['num_slots'],
+                         config['intermediate_values_size'], Constants.NVM_SIZE, Constants.N_SAMPLES, config['n_all_samples'],
+                         config['total_sample_size'], config['op_filters'], config['fp32_accuracy'],
+                         *section_table)
+    with open(path, 'wb') as f:
+        f.write(header)
+        for section_offset, section in zip(section_offsets, sections):
+            f.write(b'\0' * (section_offset - f.tell()))
+            f.write(section)
+
+with io.StringIO() as output_c, io.StringIO() as output_h:
     output_h.write('''
 #pragma once
 
@@ -748,14 +1684,18 @@ struct Node;
         if hasattr(Constants, item):
             if item.startswith('__'):
                 continue
+            if args.bundle and item in bundle_runtime_constants:
+                continue
             val = getattr(Constants, item)
         else:
+            if args.bundle and item not in bundle_compile_time_configs:
+                continue
             val = config[item]
             # Somehow for integers, numpy.array uses int64 on Linux and int32 on Windows
             if not isinstance(val, (int, float, np.int64, np.int32)):
                 continue
         # Making it long to avoid overflow for expressions like
-        # INTERMEDIATE_VALUES_SIZE * NUM_SLOTS on 16-bit systems
+        # INTERMEDIATE_VALUES_OFFSET + INTERMEDIATE_VALUES_SIZE on 16-bit systems
         suffix = 'l' if item == 'intermediate_values_size' else ''
         output_h.write(f'#define {item.upper()} ')
         if isinstance(val, str):
@@ -788,14 +1728,16 @@ struct Node;
     for op in ops:
         output_c.write(f'    alloc_{op},\n'.lower())
     output_c.write('};\n')
+    # for profiler outputs
+    output_h.write('extern const char * const op_names[];\n')
+    output_c.write('const char * const op_names[] = {\n')
+    for op in ops:
+        output_c.write(f'    "{op}",\n')
+    output_c.write('};\n')
     for op in ops:
         if op in inplace_update_ops:
             output_c.write(textwrap.dedent(f'''
-                void alloc_{op.lower()}(struct Model *model, const struct ParameterInfo *[], struct ParameterInfo *output, const struct Node*) {{
-                    SlotInfo *cur_slot_info = get_slot_info(model, output->slot);
-                    if (cur_slot_info) {{
-                        cur_slot_info->user = model->layer_idx;
-                    }}
+                void alloc_{op.lower()}(struct Model *, const struct ParameterInfo *[], struct ParameterInfo *, const struct Node*) {{
                 }}
             '''))
         else:
@@ -839,14 +1781,22 @@ const uint8_t _{var_name}[{len(data)}] = {{
 const uint8_t * const {var_name} = _{var_name};
 ''')
 
-    for var_name, data_obj in outputs.items():
-        full_var_name = var_name + '_data'
-        data_obj.seek(0)
-        if full_var_name == 'samples_data':
-            data = data_obj.read(2*config['total_sample_size'])
-        else:
-            data = data_obj.read()
-        define_var(full_var_name, data)
+    if args.bundle:
+        write_model_bundle(f'{args.data_output_dir}/model.bundle')
+        output_h.write('\n#include "model_bundle.h"\n')
+    else:
+        for var_name, data_obj in outputs.items():
+            full_var_name = var_name + '_data'
+            data_obj.seek(0)
+            if full_var_name == 'samples_data':
+                data = data_obj.read(2*config['total_sample_size'])
+            else:
+                data = data_obj.read()
+            define_var(full_var_name, data)
+
+    write_if_changed(f'{args.data_output_dir}/data.cpp', output_c.getvalue())
+    write_if_changed(f'{args.data_output_dir}/data.h', output_h.getvalue())
+    write_if_changed(f'{args.data_output_dir}/tiles.json', json.dumps(tile_sizes, indent=4) + '\n')
 
 with open('samples.bin', 'wb') as f:
     samples = outputs['samples']
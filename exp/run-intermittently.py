@@ -12,13 +12,16 @@ logger = logging.getLogger('run-intermittently')
 CHUNK_SIZE = 2000
 CHUNK_LINES = 20
 
-def run_one_inference(program, interval, logfile, shutdown_after_writes, power_cycles_limit) -> int:
+def run_one_inference(program, interval, logfile, shutdown_after_writes, power_cycles_limit, bytewise_writes) -> int:
     first_run = True
     timeout_counter = 0
     while True:
         cmd = [program, '1']
         if first_run and shutdown_after_writes:
             cmd.extend(['-c', str(shutdown_after_writes)])
+        if bytewise_writes:
+            # Byte-wise NVM writes make it more likely that timeouts interrupt writes
+            cmd.append('-w')
         with Popen(cmd, stdout=logfile, stderr=logfile) as proc:
             try:
                 kwargs = {}
@@ -53,6 +56,8 @@ def main():
     parser.add_argument('--interval', type=float, default=0.01)
     parser.add_argument('--shutdown-after-writes', type=int, default=0)
     parser.add_argument('--power-cycles-limit', type=int, default=200)
+    parser.add_argument('--bytewise-writes', default=False, action='store_true',
+                        help='Write NVM byte by byte (-w), so that timeouts are more likely to interrupt writes')
     parser.add_argument('--suffix', default='')
     parser.add_argument('--compress', default=False, action='store_true')
     parser.add_argument('program')
@@ -75,7 +80,7 @@ def main():
             logfile_path = logdir / f'intermittent-cnn-{rounds}'
         compressed_logfile_path = logfile_path.with_suffix('.zst')
         with open(logfile_path, mode='w+b') as logfile:
-            ret = run_one_inference(args.program, args.interval, logfile, args.shutdown_after_writes, args.power_cycles_limit)
+            ret = run_one_inference(args.program, args.interval, logfile, args.shutdown_after_writes, args.power_cycles_limit, args.bytewise_writes)
 
         if args.compress:
             check_call(['touch', log_archive])
@@ -1,7 +1,20 @@
+set -e
+
 python3 -m pip install --user --upgrade pip setuptools
 python3 -m pip install -r requirements.txt
 
 python3 dnn-models/transform.py --target msp430 --stateful har
 cmake -B build
 make -C build
+make -C build bench
+./build/intermittent-cnn
+# Conv with sparse or 8-bit filters and with 8-bit outputs is checked against dense Conv
+./build/bench/bench -t 1 conv
+
+python3 dnn-models/transform.py --target msp430 --stateful --sparse-weights har
+make -C build
+./build/intermittent-cnn
+
+python3 dnn-models/transform.py --target msp430 --stateful --activation-precision 8 har
+make -C build
 ./build/intermittent-cnn